@@ -0,0 +1,224 @@
+# Compiles data/web into the plugin.
+#
+# embed_web_assets(<target> <dir> [BUNDLE <page>...]) adds a generated
+# web-assets.cpp to the target. The same file, run in script mode at build
+# time, writes that source: every file under <dir> as a constexpr byte
+# array, a gzip variant, a brotli variant when a brotli binary was found,
+# and an ETag taken from the file's SHA-256. Variants that aren't smaller
+# than the file are left out.
+#
+# BUNDLE pages get their local stylesheets and scripts inlined, minified,
+# so they load in one request. The page as written is kept beside the
+# bundle for when one of the inlined files is overridden on disk.
+
+if(CMAKE_SCRIPT_MODE_FILE)
+  cmake_minimum_required(VERSION 3.21)
+  # Inputs: WEB_DIR, OUTPUT, BROTLI (path or *-NOTFOUND), BUNDLE (comma-separated pages)
+  string(REPLACE "," ";" BUNDLE "${BUNDLE}")
+  function(_web_asset_array name path out_var size_var)
+    file(READ "${path}" hex HEX)
+    string(LENGTH "${hex}" length)
+    math(EXPR size "${length} / 2")
+    if(size EQUAL 0)
+      set(body "0,")
+    else()
+      string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," body "${hex}")
+      # 16 bytes per line; CMake regexes have no {n}
+      string(REPEAT "0x..," 16 line)
+      string(REGEX REPLACE "(${line})" "\\1\n    " body "${body}")
+    endif()
+    set(${out_var} "constexpr unsigned char ${name}[] = {\n    ${body}\n};\n" PARENT_SCOPE)
+    set(${size_var} ${size} PARENT_SCOPE)
+  endfunction()
+
+  # Conservative on purpose: comments and layout whitespace only, nothing
+  # that needs a parser to get right
+  function(_web_minify_css text out_var)
+    string(REGEX REPLACE "/\\*([^*]|\\*+[^*/])*\\*+/" "" text "${text}")
+    string(REGEX REPLACE "[ \t\r\n]+" " " text "${text}")
+    string(REGEX REPLACE " ?([{};]) ?" "\\1" text "${text}")
+    string(STRIP "${text}" text)
+    set(${out_var} "${text}" PARENT_SCOPE)
+  endfunction()
+
+  function(_web_minify_js text out_var)
+    string(REGEX REPLACE "\r" "" text "\n${text}")
+    string(REGEX REPLACE "\n[ \t]+" "\n" text "${text}")
+    string(REGEX REPLACE "[ \t]+\n" "\n" text "${text}")
+    string(REGEX REPLACE "\n//[^\n]*" "" text "${text}")
+    string(REGEX REPLACE "\n\n+" "\n" text "${text}")
+    string(REPLACE "</script" "<\\/script" text "${text}")
+    string(STRIP "${text}" text)
+    set(${out_var} "${text}" PARENT_SCOPE)
+  endfunction()
+
+  # Writes the bundled page to out_path; inlined_var gets the files it swallowed
+  function(_web_bundle page out_path inlined_var)
+    file(READ "${WEB_DIR}/${page}" html)
+    set(inlined "")
+    string(REGEX MATCHALL "<link rel=\"stylesheet\" href=\"[^\":]+\">" links "${html}")
+    foreach(link IN LISTS links)
+      string(REGEX REPLACE ".*href=\"([^\"]+)\".*" "\\1" href "${link}")
+      if(EXISTS "${WEB_DIR}/${href}")
+        file(READ "${WEB_DIR}/${href}" css)
+        _web_minify_css("${css}" css)
+        string(REPLACE "${link}" "<style>${css}</style>" html "${html}")
+        list(APPEND inlined "${href}")
+      endif()
+    endforeach()
+    string(REGEX MATCHALL "<script src=\"[^\":]+\"></script>" scripts "${html}")
+    foreach(script IN LISTS scripts)
+      string(REGEX REPLACE ".*src=\"([^\"]+)\".*" "\\1" src "${script}")
+      if(EXISTS "${WEB_DIR}/${src}")
+        file(READ "${WEB_DIR}/${src}" js)
+        _web_minify_js("${js}" js)
+        string(REPLACE "${script}" "<script>${js}</script>" html "${html}")
+        list(APPEND inlined "${src}")
+      endif()
+    endforeach()
+    file(WRITE "${out_path}" "${html}")
+    list(JOIN inlined "," inlined)
+    set(${inlined_var} "${inlined}" PARENT_SCOPE)
+  endfunction()
+
+  set(work_dir "${OUTPUT}.work")
+  file(REMOVE_RECURSE "${work_dir}")
+  file(MAKE_DIRECTORY "${work_dir}")
+
+  file(GLOB_RECURSE files LIST_DIRECTORIES false RELATIVE "${WEB_DIR}" "${WEB_DIR}/*")
+  list(SORT files)
+
+  set(arrays "")
+  set(entries "")
+  set(index 0)
+  foreach(name IN LISTS files)
+    set(path "${WEB_DIR}/${name}")
+    get_filename_component(ext "${name}" LAST_EXT)
+    string(TOLOWER "${ext}" ext)
+    if(ext STREQUAL ".html")
+      set(mime "text/html")
+    elseif(ext STREQUAL ".css")
+      set(mime "text/css")
+    elseif(ext STREQUAL ".js")
+      set(mime "application/javascript")
+    elseif(ext STREQUAL ".json")
+      set(mime "application/json")
+    elseif(ext STREQUAL ".svg")
+      set(mime "image/svg+xml")
+    elseif(ext STREQUAL ".png")
+      set(mime "image/png")
+    elseif(ext STREQUAL ".woff2")
+      set(mime "font/woff2")
+    else()
+      set(mime "application/octet-stream")
+    endif()
+
+    set(inlined "")
+    set(source "nullptr, 0, nullptr")
+    if(name IN_LIST BUNDLE)
+      file(SHA256 "${path}" sha)
+      string(SUBSTRING "${sha}" 0 32 etag)
+      _web_asset_array("asset_${index}_source" "${path}" array source_size)
+      string(APPEND arrays "${array}")
+      set(source "asset_${index}_source, ${source_size}, \"\\\"${etag}\\\"\"")
+      _web_bundle("${name}" "${work_dir}/${index}.bundle" inlined)
+      set(path "${work_dir}/${index}.bundle")
+    endif()
+
+    file(SHA256 "${path}" sha)
+    string(SUBSTRING "${sha}" 0 32 etag)
+
+    _web_asset_array("asset_${index}" "${path}" array size)
+    string(APPEND arrays "${array}")
+
+    file(ARCHIVE_CREATE OUTPUT "${work_dir}/${index}.gz" PATHS "${path}" FORMAT raw COMPRESSION GZip
+         COMPRESSION_LEVEL 9)
+    file(SIZE "${work_dir}/${index}.gz" gzip_size)
+    if(gzip_size LESS size)
+      _web_asset_array("asset_${index}_gzip" "${work_dir}/${index}.gz" array gzip_size)
+      string(APPEND arrays "${array}")
+      set(gzip "asset_${index}_gzip, ${gzip_size}")
+    else()
+      set(gzip "nullptr, 0")
+    endif()
+
+    set(brotli "nullptr, 0")
+    if(BROTLI)
+      execute_process(
+        COMMAND "${BROTLI}" -q 11 -f -o "${work_dir}/${index}.br" "${path}"
+        RESULT_VARIABLE result
+      )
+      if(result EQUAL 0)
+        file(SIZE "${work_dir}/${index}.br" brotli_size)
+        if(brotli_size LESS size)
+          _web_asset_array("asset_${index}_brotli" "${work_dir}/${index}.br" array brotli_size)
+          string(APPEND arrays "${array}")
+          set(brotli "asset_${index}_brotli, ${brotli_size}")
+        endif()
+      endif()
+    endif()
+
+    string(
+      APPEND
+      entries
+      "    { \"${name}\", \"${mime}\", \"\\\"${etag}\\\"\", \"\\\"${etag}-gz\\\"\", \"\\\"${etag}-br\\\"\",\n"
+      "      asset_${index}, ${size}, ${gzip}, ${brotli}, \"${inlined}\", ${source} },\n"
+    )
+    math(EXPR index "${index} + 1")
+  endforeach()
+
+  if(index EQUAL 0)
+    message(FATAL_ERROR "No web assets found in ${WEB_DIR}")
+  endif()
+
+  file(REMOVE_RECURSE "${work_dir}")
+  file(
+    WRITE "${OUTPUT}"
+    "// Generated by cmake/embed-web-assets.cmake from data/web. Do not edit.
+#include \"web-assets.hpp\"
+
+namespace {
+
+${arrays}
+constexpr EmbeddedAsset kAssets[] = {
+${entries}};
+
+} // namespace
+
+std::span<const EmbeddedAsset> EmbeddedAssets() {
+    return kAssets;
+}
+
+const EmbeddedAsset* FindEmbeddedAsset(std::string_view name) {
+    for (const auto& asset : kAssets) {
+        if (asset.name == name) return &asset;
+    }
+    return nullptr;
+}
+"
+  )
+  return()
+endif()
+
+function(embed_web_assets target dir)
+  cmake_parse_arguments(PARSE_ARGV 2 arg "" "" "BUNDLE")
+  file(GLOB_RECURSE files LIST_DIRECTORIES false CONFIGURE_DEPENDS "${dir}/*")
+  find_program(BROTLI_EXECUTABLE brotli)
+  if(NOT BROTLI_EXECUTABLE)
+    message(STATUS "brotli not found, web assets are embedded with gzip variants only")
+  endif()
+
+  list(JOIN arg_BUNDLE "," bundle)
+  set(output "${CMAKE_CURRENT_BINARY_DIR}/web-assets.cpp")
+  add_custom_command(
+    OUTPUT "${output}"
+    COMMAND
+      "${CMAKE_COMMAND}" "-DWEB_DIR=${dir}" "-DOUTPUT=${output}" "-DBROTLI=${BROTLI_EXECUTABLE}"
+      "-DBUNDLE=${bundle}" -P "${CMAKE_CURRENT_FUNCTION_LIST_FILE}"
+    DEPENDS ${files} "${CMAKE_CURRENT_FUNCTION_LIST_FILE}"
+    COMMENT "Embedding web assets"
+    VERBATIM
+  )
+  target_sources(${target} PRIVATE "${output}")
+  target_include_directories(${target} PRIVATE "${CMAKE_CURRENT_SOURCE_DIR}/src")
+endfunction()
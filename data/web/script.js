@@ -18,97 +18,167 @@ const QRS_WAVE = [
     -3, -5, -2, 0 // T wave
 ];
 
+// Overlays for a specific band use index.html?device=<id>
+const hrDevice = new URLSearchParams(location.search).get('device');
+
+// Set by startThemeUpdates(); receives {version, theme} from the server
+let onThemeUpdate = null;
+
 function startHRPoll() {
     // Start Animation Loop immediately
     startWaveformAnimation();
 
+    // The trend graph advances once a second however often readings arrive
     setInterval(() => {
-        fetch('/api/hr')
+        // Push 0 while disconnected so the graph shows the gap
+        hrHistory.push(isConnected ? currentBpm : 0);
+        if (hrHistory.length > 50) hrHistory.shift();
+    }, 1000);
+
+    const query = hrDevice ? '?device=' + encodeURIComponent(hrDevice) : '';
+    if (!window.EventSource) {
+        pollHeartRate(query);
+        return;
+    }
+
+    // Readings are pushed as they arrive; EventSource reconnects by itself
+    // and resumes from the last event id
+    let opened = false;
+    const source = new EventSource('/api/hr/stream' + query);
+    source.onopen = () => { opened = true; };
+    source.onmessage = e => {
+        try {
+            updateHeartRate(JSON.parse(e.data));
+        } catch (err) {
+            console.error(err);
+        }
+    };
+    // Sent on connect and whenever the theme is saved
+    source.addEventListener('theme', e => {
+        try {
+            if (onThemeUpdate) onThemeUpdate(JSON.parse(e.data));
+        } catch (err) {
+            console.error(err);
+        }
+    });
+    source.onerror = () => {
+        // Never opened (older plugin, proxy): fall back to polling
+        if (!opened || source.readyState === EventSource.CLOSED) {
+            source.close();
+            pollHeartRate(query);
+            if (onThemeUpdate) startStatePoll();
+        }
+    };
+}
+
+function pollHeartRate(query) {
+    // Long-poll: each request waits server-side for the next sample
+    let since = 0;
+    const sep = query ? '&' : '?';
+    const next = () => {
+        fetch('/api/hr' + query + sep + 'since=' + since + '&timeout=20000', { cache: 'no-store' })
             .then(r => r.json())
             .then(data => {
-                const connected = data.hr > 0;
-                const text = connected ? data.hr : '--';
-                
-                // Update Globals
-                currentBpm = connected ? data.hr : 0;
-                isConnected = connected;
-
-                // Update History
-                if (connected) {
-                    hrHistory.push(data.hr);
-                    if (hrHistory.length > 50) hrHistory.shift();
-                } else {
-                    // Optional: Push 0 or keep last? 
-                    // For trend graph, maybe push 0 to show disconnect
-                    hrHistory.push(0);
-                    if (hrHistory.length > 50) hrHistory.shift();
-                }
-
-                const el = document.getElementById('heart-rate-value');
-                if (el) el.innerText = text;
-
-                const el2 = document.getElementById('hr-display');
-                if (el2) el2.innerText = text;
-                
-                // Handle animation state
-                const visual = document.querySelector('.heart-visual');
-                if (visual) {
-                    if (connected) {
-                        visual.classList.remove('disconnected');
-                    } else {
-                        visual.classList.add('disconnected');
-                    }
-                }
-
-                // Update settings page badge
-                const badge = document.getElementById('connection-badge');
-                const scanBtn = document.getElementById('scan-btn');
-                const disconnectBtn = document.getElementById('disconnect-btn');
-
-                if (badge) {
-                    if (connected) {
-                        badge.innerText = '已连接';
-                        badge.classList.remove('disconnected');
-                        badge.classList.add('connected');
-                        
-                        // Connected State: Disable Scan, Enable Disconnect
-                        if (scanBtn) scanBtn.disabled = true;
-                        if (disconnectBtn) disconnectBtn.disabled = false;
-                    } else {
-                        badge.innerText = '未连接';
-                        badge.classList.remove('connected');
-                        badge.classList.add('disconnected');
-                        
-                        // Disconnected State: Enable Scan (if not currently scanning), Disable Disconnect
-                        if (scanBtn && !isScanning) scanBtn.disabled = false;
-                        if (disconnectBtn) disconnectBtn.disabled = true;
-                    }
-                }
-
-                // Update OBS status text
-                const obsStatus = document.getElementById('obs-status-text');
-                if (obsStatus) {
-                    obsStatus.style.display = connected ? 'none' : 'block';
-                }
+                since = data.seq;
+                updateHeartRate(data);
+                // Servers without long-poll answer at once; don't spin on them
+                setTimeout(next, data.samples ? 0 : 1000);
             })
-            .catch(e => console.error(e));
-    }, 1000);
+            .catch(e => {
+                console.error(e);
+                setTimeout(next, 1000);
+            });
+    };
+    next();
+}
+
+function updateHeartRate(data) {
+    const connected = data.hr > 0;
+    const text = connected ? data.hr : '--';
+    
+    // Update Globals
+    currentBpm = connected ? data.hr : 0;
+    isConnected = connected;
+
+    const el = document.getElementById('heart-rate-value');
+    if (el) el.innerText = text;
+
+    const el2 = document.getElementById('hr-display');
+    if (el2) el2.innerText = text;
+    
+    // Handle animation state
+    const visual = document.querySelector('.heart-visual');
+    if (visual) {
+        if (connected) {
+            visual.classList.remove('disconnected');
+        } else {
+            visual.classList.add('disconnected');
+        }
+    }
+
+    // Update settings page badge
+    const badge = document.getElementById('connection-badge');
+    const scanBtn = document.getElementById('scan-btn');
+    const disconnectBtn = document.getElementById('disconnect-btn');
+
+    if (badge) {
+        if (connected) {
+            badge.innerText = '已连接';
+            badge.classList.remove('disconnected');
+            badge.classList.add('connected');
+            
+            // Connected State: Scan stays available for adding more bands
+            if (scanBtn && !isScanning) scanBtn.disabled = false;
+            if (disconnectBtn) disconnectBtn.disabled = false;
+        } else {
+            badge.innerText = '未连接';
+            badge.classList.remove('connected');
+            badge.classList.add('disconnected');
+            
+            // Disconnected State: Enable Scan (if not currently scanning), Disable Disconnect
+            if (scanBtn && !isScanning) scanBtn.disabled = false;
+            if (disconnectBtn) disconnectBtn.disabled = true;
+        }
+    }
+
+    // Update OBS status text
+    const obsStatus = document.getElementById('obs-status-text');
+    if (obsStatus) {
+        obsStatus.style.display = connected ? 'none' : 'block';
+    }
+}
+
+function startThemeUpdates() {
+    let currentVersion = 0;
+    onThemeUpdate = data => {
+        if (!data.theme || !data.theme.theme || data.version === currentVersion) return;
+        currentVersion = data.version;
+        applyTheme(data.theme.theme);
+    };
+    // Otherwise themes arrive on the stream opened by startHRPoll
+    if (!window.EventSource) startStatePoll();
 }
 
-function startThemePoll() {
-    let currentThemeStr = '';
+let statePollStarted = false;
 
-    // Poll theme every 1 second
+function startStatePoll() {
+    if (statePollStarted) return;
+    statePollStarted = true;
+    let etag = '';
+
+    // Without a live stream: poll once a second, answered with 304 until
+    // the theme changes
     setInterval(() => {
-        // Add timestamp to prevent caching
-        fetch('/api/theme?t=' + Date.now(), { cache: "no-store" })
-            .then(r => r.json())
+        const headers = etag ? { 'If-None-Match': etag } : {};
+        fetch('/api/state?parts=theme', { cache: 'no-store', headers })
+            .then(r => {
+                if (r.status === 304) return null;
+                if (!r.ok) throw new Error('HTTP ' + r.status);
+                etag = r.headers.get('ETag') || '';
+                return r.json();
+            })
             .then(data => {
-                if (!data.theme) return;
-                if (data.theme === currentThemeStr) return;
-                currentThemeStr = data.theme;
-
-                applyTheme(data.theme);
+                if (data && onThemeUpdate) onThemeUpdate({ version: data.versions.theme, theme: data.theme });
             })
             .catch(e => { });
     }, 1000);
@@ -317,9 +387,11 @@ function startScan() {
 function connect(id) {
     const status = document.getElementById('status');
     status.innerText = '连接中...';
+    const broadcast = document.getElementById('broadcast-mode');
+    const mode = broadcast && broadcast.checked ? 'advertisement' : 'gatt';
     fetch('/api/connect', {
         method: 'POST',
-        body: JSON.stringify({ id: id }),
+        body: JSON.stringify({ id: id, mode: mode }),
         headers: { 'Content-Type': 'application/json' }
     })
         .then(r => r.json())
@@ -340,6 +412,19 @@ function disconnect() {
         });
 }
 
+function disconnectDevice(id) {
+    const status = document.getElementById('status');
+    fetch('/api/disconnect', {
+        method: 'POST',
+        body: JSON.stringify({ id: id }),
+        headers: { 'Content-Type': 'application/json' }
+    })
+        .then(r => r.json())
+        .then(data => {
+            if(status) status.innerText = '已断开';
+        });
+}
+
 function reset() {
     if(!confirm('确定要重置吗？这将清除保存的设备并断开连接。')) return;
     const status = document.getElementById('status');
@@ -0,0 +1,213 @@
+#include "asset-cache.hpp"
+#include <obs-module.h>
+#include <sys/stat.h>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined(__linux__)
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// FNV-1a; only needs to tell versions of the same file apart
+uint64_t content_hash(const std::string& data) {
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string http_date(time_t t) {
+    struct tm tm_utc;
+#ifdef _WIN32
+    gmtime_s(&tm_utc, &t);
+#else
+    gmtime_r(&t, &tm_utc);
+#endif
+    char buf[64];
+    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm_utc);
+    return buf;
+}
+
+bool stat_file(const std::string& path, time_t& mtime, uint64_t& size) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    mtime = st.st_mtime;
+    size = (uint64_t)st.st_size;
+    return true;
+}
+
+} // namespace
+
+AssetCache::AssetCache(std::string dir) : dir_(std::move(dir)) {
+    watching_ = StartWatching();
+    if (watching_) {
+        watcher_ = std::thread([this]() { Watch(); });
+    } else {
+        blog(LOG_INFO, "Web directory is not watched; assets are revalidated per request");
+    }
+}
+
+AssetCache::~AssetCache() {
+#ifdef _WIN32
+    if (stop_event_) SetEvent(stop_event_);
+    if (watcher_.joinable()) watcher_.join();
+    if (change_handle_) FindCloseChangeNotification(change_handle_);
+    if (stop_event_) CloseHandle(stop_event_);
+#else
+    if (wake_fd_ >= 0) {
+        uint64_t one = 1;
+        if (write(wake_fd_, &one, sizeof(one)) < 0) blog(LOG_WARNING, "Failed to wake the web directory watcher");
+    }
+    if (watcher_.joinable()) watcher_.join();
+    if (watch_fd_ >= 0) close(watch_fd_);
+    if (wake_fd_ >= 0) close(wake_fd_);
+#endif
+}
+
+std::shared_ptr<const Asset> AssetCache::Get(const std::string& name) {
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(name);
+        if (it != entries_.end()) {
+            if (watching_) return it->second;
+            time_t mtime;
+            uint64_t size;
+            if (it->second && stat_file(dir_ + "/" + name, mtime, size) && mtime == it->second->mtime &&
+                size == it->second->body.size()) {
+                return it->second;
+            }
+            entries_.erase(it);
+        }
+        generation = generation_;
+    }
+
+    // Read outside the lock; concurrent misses for one file both load it.
+    // While watched, a missing file is remembered too: creating it
+    // invalidates the entry like any other change.
+    auto asset = Load(name);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation == generation_ && (asset || watching_)) entries_[name] = asset;
+    return asset;
+}
+
+void AssetCache::Invalidate(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (name.empty()) {
+        entries_.clear();
+    } else {
+        entries_.erase(name);
+    }
+    ++generation_;
+}
+
+std::shared_ptr<const Asset> AssetCache::Load(const std::string& name) const {
+    std::string path = dir_ + "/" + name;
+    auto asset = std::make_shared<Asset>();
+    uint64_t size;
+    if (!stat_file(path, asset->mtime, size)) return nullptr;
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return nullptr;
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    asset->body = buffer.str();
+
+    char etag[48];
+    snprintf(etag, sizeof(etag), "\"%zx-%016llx\"", asset->body.size(),
+             (unsigned long long)content_hash(asset->body));
+    asset->etag = etag;
+    asset->last_modified = http_date(asset->mtime);
+    return asset;
+}
+
+#ifdef _WIN32
+
+bool AssetCache::StartWatching() {
+    stop_event_ = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+    if (!stop_event_) return false;
+    HANDLE change = FindFirstChangeNotificationA(
+        dir_.c_str(), FALSE,
+        FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+    if (change == INVALID_HANDLE_VALUE) {
+        blog(LOG_WARNING, "Cannot watch %s (error %lu)", dir_.c_str(), GetLastError());
+        return false;
+    }
+    change_handle_ = change;
+    return true;
+}
+
+void AssetCache::Watch() {
+    // The notification doesn't say which file changed; drop them all
+    HANDLE handles[2] = { stop_event_, change_handle_ };
+    for (;;) {
+        DWORD result = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+        if (result != WAIT_OBJECT_0 + 1) return;
+        Invalidate("");
+        if (!FindNextChangeNotification(change_handle_)) return;
+    }
+}
+
+#elif defined(__linux__)
+
+bool AssetCache::StartWatching() {
+    watch_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch_fd_ < 0) return false;
+    // IN_MODIFY as well as IN_CLOSE_WRITE: an editor may keep the file open
+    if (inotify_add_watch(watch_fd_, dir_.c_str(),
+                          IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                              IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF) < 0) {
+        blog(LOG_WARNING, "Cannot watch %s", dir_.c_str());
+        return false;
+    }
+    wake_fd_ = eventfd(0, EFD_CLOEXEC);
+    return wake_fd_ >= 0;
+}
+
+void AssetCache::Watch() {
+    alignas(struct inotify_event) char buf[4096];
+    for (;;) {
+        struct pollfd fds[2] = { { watch_fd_, POLLIN, 0 }, { wake_fd_, POLLIN, 0 } };
+        if (poll(fds, 2, -1) < 0) continue;
+        if (fds[1].revents) return;
+        ssize_t len;
+        while ((len = read(watch_fd_, buf, sizeof(buf))) > 0) {
+            for (char* p = buf; p < buf + len;) {
+                auto* event = reinterpret_cast<struct inotify_event*>(p);
+                if (event->mask & IN_IGNORED) {
+                    // The directory itself went away; fall back to revalidating
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    watching_ = false;
+                    entries_.clear();
+                    ++generation_;
+                    return;
+                }
+                if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_Q_OVERFLOW)) {
+                    Invalidate("");
+                } else if (event->len > 0) {
+                    Invalidate(event->name);
+                }
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+    }
+}
+
+#else
+
+bool AssetCache::StartWatching() {
+    return false;
+}
+
+void AssetCache::Watch() {}
+
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// One web file as served. Immutable once loaded; handlers keep the
+// shared_ptr for as long as the response body is being written.
+struct Asset {
+    std::string body;
+    std::string etag;           // strong, quoted; derived from the content
+    std::string last_modified;  // IMF-fixdate from the file's mtime
+    time_t mtime = 0;
+};
+
+// Web files loaded on first request and kept in memory until they change
+// on disk. A watcher thread drops entries as files are written (inotify on
+// Linux, change notifications on Windows); where neither is available each
+// Get() compares the file's mtime and size instead.
+class AssetCache {
+public:
+    explicit AssetCache(std::string dir);
+    ~AssetCache();
+
+    AssetCache(const AssetCache&) = delete;
+    AssetCache& operator=(const AssetCache&) = delete;
+
+    // nullptr if the file doesn't exist or can't be read
+    std::shared_ptr<const Asset> Get(const std::string& name);
+
+    // Forgets one file, or all of them for an empty name
+    void Invalidate(const std::string& name);
+
+private:
+    std::shared_ptr<const Asset> Load(const std::string& name) const;
+    bool StartWatching();
+    void Watch();
+
+    std::string dir_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<const Asset>> entries_;
+    uint64_t generation_ = 0;  // bumped by Invalidate; a load that raced one isn't kept
+    bool watching_ = false;
+
+#ifdef _WIN32
+    void* change_handle_ = nullptr;
+    void* stop_event_ = nullptr;
+#else
+    int watch_fd_ = -1;
+    int wake_fd_ = -1;
+#endif
+    std::thread watcher_;
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include "ble-manager.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Factories for the concrete BleManager backends. BleManager::Create()
+// picks one at runtime; see ble-manager.cpp.
+
+#ifdef _WIN32
+std::shared_ptr<BleManager> CreateWinRTBleManager();
+#endif
+
+#ifdef HAVE_BLUEZ
+std::shared_ptr<BleManager> CreateBlueZBleManager();
+#endif
+
+struct SimBleOptions {
+    int device_count = 3;
+    double rate_hz = 1.0;              // notifications per second per device
+    int base_bpm = 72;
+    uint32_t jitter_ms = 0;            // random delivery delay on top of the schedule
+    uint32_t disconnect_every_s = 0;   // inject a link drop this often, 0 = never
+    uint32_t disconnect_for_ms = 2000; // how long an injected drop lasts
+    uint32_t connect_fail_percent = 0; // chance that a connect attempt fails
+};
+
+// Reads MIBAND_HR_SIM_* environment variables on top of the defaults
+SimBleOptions SimBleOptionsFromEnv();
+std::shared_ptr<BleManager> CreateSimBleManager(const SimBleOptions& options);
+
+struct ReplayBleOptions {
+    std::string path;
+    double speed = 1.0;  // 1 = real time, 0 = as fast as possible
+    bool loop = false;
+};
+
+// Reads MIBAND_HR_REPLAY_SPEED / MIBAND_HR_REPLAY_LOOP on top of the defaults
+ReplayBleOptions ReplayBleOptionsFromEnv(const std::string& path);
+std::shared_ptr<BleManager> CreateReplayBleManager(const ReplayBleOptions& options);
@@ -0,0 +1,762 @@
+#include "ble-backends.hpp"
+#include "reconnector.hpp"
+#include "hr-advertisement.hpp"
+#include <obs-module.h>
+
+#include <systemd/sd-bus.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Linux backend over BlueZ's D-Bus API (org.bluez). One thread owns the bus
+// and sleeps in poll() on the bus fd plus an eventfd for commands posted by
+// the public methods; everything else is driven by D-Bus signals
+// (InterfacesAdded / PropertiesChanged), never by polling.
+//
+// MIBAND_HR_BLUEZ_BUS=session talks to a mock org.bluez on the session bus
+// (e.g. python-dbusmock's bluez5 template) so it can be exercised without a
+// radio; MIBAND_HR_BLUEZ_ADAPTER overrides the adapter object path. The
+// template has adapters and devices but no GATT objects: notifications need
+// a GattCharacteristic1 with the 0x2A37 UUID added under the device, whose
+// Value is then changed through the mock.
+
+static const char* BLUEZ = "org.bluez";
+static const char* HR_SERVICE_UUID = "0000180d-0000-1000-8000-00805f9b34fb";
+static const char* HR_MEASUREMENT_CHAR_UUID = "00002a37-0000-1000-8000-00805f9b34fb";
+
+static uint64_t ParseAddress(const char* text) {
+    uint64_t address = 0;
+    int nibbles = 0;
+    for (const char* p = text; *p; ++p) {
+        int v;
+        if (*p >= '0' && *p <= '9') v = *p - '0';
+        else if (*p >= 'a' && *p <= 'f') v = *p - 'a' + 10;
+        else if (*p >= 'A' && *p <= 'F') v = *p - 'A' + 10;
+        else continue;
+        address = (address << 4) | (uint64_t)v;
+        nibbles++;
+    }
+    return nibbles == 12 ? address : 0;
+}
+
+static std::string DevicePath(const std::string& adapter, uint64_t address) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "/dev_%02X_%02X_%02X_%02X_%02X_%02X",
+             (unsigned)(address >> 40) & 0xFF, (unsigned)(address >> 32) & 0xFF, (unsigned)(address >> 24) & 0xFF,
+             (unsigned)(address >> 16) & 0xFF, (unsigned)(address >> 8) & 0xFF, (unsigned)address & 0xFF);
+    return adapter + buf;
+}
+
+static bool HasPrefix(const std::string& s, const std::string& prefix) {
+    return s.size() > prefix.size() && s.compare(0, prefix.size(), prefix) == 0 && s[prefix.size()] == '/';
+}
+
+// Reads an "as" value, checking for `needle` without keeping the strings
+static bool StrvContains(sd_bus_message* m, const char* needle) {
+    bool found = false;
+    if (sd_bus_message_enter_container(m, 'a', "s") < 0) return false;
+    const char* value;
+    while (sd_bus_message_read(m, "s", &value) > 0) {
+        if (strcasecmp(value, needle) == 0) found = true;
+    }
+    sd_bus_message_exit_container(m);
+    return found;
+}
+
+// Walks an a{sv} dictionary. fn(name, signature) is called with the message
+// positioned inside the variant; it returns false to have the value skipped.
+template <typename Fn>
+static int ForEachProperty(sd_bus_message* m, Fn&& fn) {
+    int r = sd_bus_message_enter_container(m, 'a', "{sv}");
+    if (r < 0) return r;
+    while ((r = sd_bus_message_enter_container(m, 'e', "sv")) > 0) {
+        const char* name;
+        const char* contents;
+        if ((r = sd_bus_message_read(m, "s", &name)) < 0) return r;
+        if ((r = sd_bus_message_peek_type(m, nullptr, &contents)) < 0) return r;
+        if ((r = sd_bus_message_enter_container(m, 'v', contents)) < 0) return r;
+        if (!fn(name, contents)) {
+            if ((r = sd_bus_message_skip(m, contents)) < 0) return r;
+        }
+        sd_bus_message_exit_container(m);
+        sd_bus_message_exit_container(m);
+    }
+    if (r < 0) return r;
+    return sd_bus_message_exit_container(m);
+}
+
+// ManufacturerData a{qv}, values are ay
+static void ReadManufacturerData(sd_bus_message* m, AdvertisementBuilder& ad) {
+    if (sd_bus_message_enter_container(m, 'a', "{qv}") < 0) return;
+    while (sd_bus_message_enter_container(m, 'e', "qv") > 0) {
+        uint16_t company;
+        const void* data;
+        size_t size;
+        if (sd_bus_message_read(m, "q", &company) >= 0 && sd_bus_message_enter_container(m, 'v', "ay") >= 0) {
+            if (sd_bus_message_read_array(m, 'y', &data, &size) >= 0) {
+                ad.AppendManufacturer(company, { static_cast<const uint8_t*>(data), size });
+            }
+            sd_bus_message_exit_container(m);
+        }
+        sd_bus_message_exit_container(m);
+    }
+    sd_bus_message_exit_container(m);
+}
+
+// ServiceData a{sv} keyed by 128-bit UUID string, values are ay. Only
+// 16-bit UUIDs on the Bluetooth base UUID matter here.
+static void ReadServiceData(sd_bus_message* m, AdvertisementBuilder& ad) {
+    if (sd_bus_message_enter_container(m, 'a', "{sv}") < 0) return;
+    while (sd_bus_message_enter_container(m, 'e', "sv") > 0) {
+        const char* uuid;
+        const void* data;
+        size_t size;
+        if (sd_bus_message_read(m, "s", &uuid) >= 0 && sd_bus_message_enter_container(m, 'v', "ay") >= 0) {
+            if (sd_bus_message_read_array(m, 'y', &data, &size) >= 0 && strlen(uuid) == 36 &&
+                strncmp(uuid, "0000", 4) == 0 && strcasecmp(uuid + 8, "-0000-1000-8000-00805f9b34fb") == 0) {
+                uint16_t uuid16 = (uint16_t)strtoul(std::string(uuid + 4, 4).c_str(), nullptr, 16);
+                ad.AppendServiceData16(uuid16, { static_cast<const uint8_t*>(data), size });
+            }
+            sd_bus_message_exit_container(m);
+        }
+        sd_bus_message_exit_container(m);
+    }
+    sd_bus_message_exit_container(m);
+}
+
+class BleManagerBlueZ : public BleManager {
+    struct DeviceInfo {
+        uint64_t address = 0;
+        std::string name;
+        bool has_hr_service = false;
+        bool connected = false;
+        bool services_resolved = false;
+    };
+
+    // One connected (or listened-to) band. Everything but the reconnector
+    // is loop-thread state.
+    struct Session {
+        BleManagerBlueZ* owner = nullptr;
+        uint32_t stream_id = 0;
+        uint64_t address = 0;
+        bool passive = false;       // advertisement ingest, no link
+        std::string path;
+        std::string notifying_path;
+        bool connect_pending = false;
+        // Owning the call slots lets StopSession drop replies for a dead session
+        sd_bus_slot* connect_slot = nullptr;
+        sd_bus_slot* notify_slot = nullptr;
+        // Last member: attempts are posted to the loop thread; outcomes come
+        // back from the D-Bus replies and Device1.Connected changes
+        std::unique_ptr<Reconnector> reconnector;
+
+        ~Session() {
+            reconnector.reset();
+            sd_bus_slot_unref(connect_slot);
+            sd_bus_slot_unref(notify_slot);
+        }
+    };
+
+    // Loop thread state; only touched from loop_thread_
+    sd_bus* bus_ = nullptr;
+    std::string adapter_path_;
+    std::map<std::string, DeviceInfo> devices_;
+    std::map<std::string, std::string> hr_chars_;  // device path -> characteristic path
+    std::shared_ptr<Session> live_[kMaxStreams];
+    std::unordered_map<std::string, uint32_t> notifying_;  // characteristic path -> stream
+    bool discovering_ = false;
+    bool discovery_passive_ = false;
+
+    // Cross-thread state
+    std::thread loop_thread_;
+    int wake_fd_ = -1;
+    std::atomic<bool> running_{true};
+    mutable std::mutex mutex_;
+    std::vector<std::function<void()>> commands_;
+    bool is_scanning_ = false;
+    std::shared_ptr<Session> sessions_[kMaxStreams];
+
+public:
+    BleManagerBlueZ() {
+        wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        loop_thread_ = std::thread([this]() { Run(); });
+    }
+
+    ~BleManagerBlueZ() {
+        DisconnectAll();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+        }
+        Wake();
+        if (loop_thread_.joinable()) loop_thread_.join();
+        if (wake_fd_ >= 0) close(wake_fd_);
+    }
+
+protected:
+    void StartScanning() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (is_scanning_) return;
+            is_scanning_ = true;
+        }
+        Post([this]() {
+            UpdateDiscovery();
+            // Bands BlueZ already knows about won't be re-added; report them now
+            for (auto& [path, dev] : devices_) {
+                if (dev.has_hr_service) ReportDevice(dev);
+            }
+        });
+    }
+
+    void StopScanning() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!is_scanning_) return;
+            is_scanning_ = false;
+        }
+        Post([this]() { UpdateDiscovery(); });
+    }
+
+    bool OpenSession(uint32_t stream_id, const std::string& device_id, IngestMode mode) override {
+        uint64_t address = 0;
+        try {
+            address = std::stoull(device_id);
+        } catch (...) {
+            return false;
+        }
+        auto session = std::make_shared<Session>();
+        session->owner = this;
+        session->stream_id = stream_id;
+        session->address = address;
+        session->passive = mode == IngestMode::Advertisement;
+        session->reconnector = std::make_unique<Reconnector>([this, stream_id]() {
+            Post([this, stream_id]() { ConnectTarget(stream_id); });
+        });
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            sessions_[stream_id] = session;
+        }
+        Post([this, session]() { StartSession(session); });
+        if (!session->passive) session->reconnector->Enable();
+        return true;
+    }
+
+    void CloseSession(uint32_t stream_id) override {
+        std::shared_ptr<Session> session;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            session.swap(sessions_[stream_id]);
+        }
+        if (!session) return;
+        session->reconnector->Disable();
+        Post([this, session]() { StopSession(session); });
+    }
+
+    ReconnectStats SessionReconnectStats(uint32_t stream_id) const override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const Session* session = sessions_[stream_id].get();
+        return session ? session->reconnector->Stats() : ReconnectStats{};
+    }
+
+private:
+    void Wake() {
+        uint64_t one = 1;
+        if (write(wake_fd_, &one, sizeof(one)) < 0) {
+            // Counter saturated; the loop is awake anyway
+        }
+    }
+
+    // Replies can still arrive for a session that is closed but not yet
+    // stopped on the loop thread; its link state no longer counts
+    void ReportLink(Session* session, bool connected) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (sessions_[session->stream_id].get() == session) PublishLinkState(session->stream_id, connected);
+    }
+
+    void Post(std::function<void()> command) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) return;
+        commands_.push_back(std::move(command));
+        Wake();
+    }
+
+    void Run() {
+        const char* which = getenv("MIBAND_HR_BLUEZ_BUS");
+        bool session = which && strcmp(which, "session") == 0;
+        int r = session ? sd_bus_open_user(&bus_) : sd_bus_open_system(&bus_);
+        if (r < 0) {
+            blog(LOG_ERROR, "BlueZ: failed to open %s bus: %s", session ? "session" : "system", strerror(-r));
+            bus_ = nullptr;
+        } else {
+            sd_bus_match_signal(bus_, nullptr, BLUEZ, nullptr, "org.freedesktop.DBus.ObjectManager",
+                                "InterfacesAdded", &BleManagerBlueZ::OnInterfacesAdded, this);
+            sd_bus_match_signal(bus_, nullptr, BLUEZ, nullptr, "org.freedesktop.DBus.ObjectManager",
+                                "InterfacesRemoved", &BleManagerBlueZ::OnInterfacesRemoved, this);
+            sd_bus_match_signal(bus_, nullptr, BLUEZ, nullptr, "org.freedesktop.DBus.Properties",
+                                "PropertiesChanged", &BleManagerBlueZ::OnPropertiesChanged, this);
+            LoadManagedObjects();
+        }
+
+        while (running_) {
+            RunCommands();
+            if (bus_) {
+                while ((r = sd_bus_process(bus_, nullptr)) > 0) {
+                }
+                if (r < 0) {
+                    blog(LOG_ERROR, "BlueZ: bus processing failed: %s", strerror(-r));
+                    break;
+                }
+            }
+
+            // Sleep until the bus or a posted command needs us
+            struct pollfd fds[2] = {};
+            fds[0].fd = wake_fd_;
+            fds[0].events = POLLIN;
+            int nfds = 1;
+            int timeout_ms = -1;
+            if (bus_) {
+                fds[1].fd = sd_bus_get_fd(bus_);
+                fds[1].events = (short)sd_bus_get_events(bus_);
+                nfds = 2;
+                uint64_t usec;
+                if (sd_bus_get_timeout(bus_, &usec) >= 0 && usec != UINT64_MAX) {
+                    struct timespec ts;
+                    clock_gettime(CLOCK_MONOTONIC, &ts);
+                    uint64_t now_us = (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+                    timeout_ms = usec > now_us ? (int)((usec - now_us + 999) / 1000) : 0;
+                }
+            }
+            poll(fds, (nfds_t)nfds, timeout_ms);
+
+            uint64_t drained;
+            if (read(wake_fd_, &drained, sizeof(drained)) < 0) {
+                // Nothing posted
+            }
+        }
+
+        RunCommands();
+        if (bus_) {
+            for (auto& session : live_) {
+                if (session) StopSession(session);
+            }
+            bus_ = sd_bus_flush_close_unref(bus_);
+        }
+    }
+
+    void RunCommands() {
+        std::vector<std::function<void()>> commands;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            commands.swap(commands_);
+        }
+        for (auto& command : commands) command();
+    }
+
+    // ---- Object tracking -------------------------------------------------
+
+    void LoadManagedObjects() {
+        sd_bus_error error = SD_BUS_ERROR_NULL;
+        sd_bus_message* reply = nullptr;
+        int r = sd_bus_call_method(bus_, BLUEZ, "/", "org.freedesktop.DBus.ObjectManager", "GetManagedObjects",
+                                   &error, &reply, "");
+        if (r < 0) {
+            blog(LOG_WARNING, "BlueZ: GetManagedObjects failed: %s", error.message ? error.message : strerror(-r));
+            sd_bus_error_free(&error);
+            return;
+        }
+
+        if (sd_bus_message_enter_container(reply, 'a', "{oa{sa{sv}}}") >= 0) {
+            while (sd_bus_message_enter_container(reply, 'e', "oa{sa{sv}}") > 0) {
+                const char* path;
+                sd_bus_message_read(reply, "o", &path);
+                ParseInterfaces(path, reply);
+                sd_bus_message_exit_container(reply);
+            }
+            sd_bus_message_exit_container(reply);
+        }
+        sd_bus_message_unref(reply);
+
+        if (const char* adapter = getenv("MIBAND_HR_BLUEZ_ADAPTER")) {
+            adapter_path_ = adapter;
+        }
+        if (adapter_path_.empty()) {
+            blog(LOG_WARNING, "BlueZ: no Bluetooth adapter found");
+        } else {
+            blog(LOG_INFO, "BlueZ: using adapter %s", adapter_path_.c_str());
+        }
+    }
+
+    // Parses a{sa{sv}} for one object, as in GetManagedObjects / InterfacesAdded
+    void ParseInterfaces(const std::string& path, sd_bus_message* m) {
+        if (sd_bus_message_enter_container(m, 'a', "{sa{sv}}") < 0) return;
+        while (sd_bus_message_enter_container(m, 'e', "sa{sv}") > 0) {
+            const char* iface;
+            sd_bus_message_read(m, "s", &iface);
+            if (strcmp(iface, "org.bluez.Adapter1") == 0) {
+                if (adapter_path_.empty()) adapter_path_ = path;
+                sd_bus_message_skip(m, "a{sv}");
+            } else if (strcmp(iface, "org.bluez.Device1") == 0) {
+                UpdateDevice(path, m);
+            } else if (strcmp(iface, "org.bluez.GattCharacteristic1") == 0) {
+                AddCharacteristic(path, m);
+            } else {
+                sd_bus_message_skip(m, "a{sv}");
+            }
+            sd_bus_message_exit_container(m);
+        }
+        sd_bus_message_exit_container(m);
+    }
+
+    void UpdateDevice(const std::string& path, sd_bus_message* m) {
+        DeviceInfo& dev = devices_[path];
+        if (dev.address == 0) {
+            // PropertiesChanged only carries what changed; the path has the address
+            size_t pos = path.rfind("/dev_");
+            if (pos != std::string::npos) dev.address = ParseAddress(path.c_str() + pos + 5);
+        }
+        bool was_connected = dev.connected;
+        bool was_resolved = dev.services_resolved;
+        bool changed = false;
+        AdvertisementBuilder ad;
+
+        ForEachProperty(m, [&](const char* name, const char* sig) {
+            if (strcmp(name, "Address") == 0 && strcmp(sig, "s") == 0) {
+                const char* s;
+                sd_bus_message_read(m, "s", &s);
+                dev.address = ParseAddress(s);
+            } else if ((strcmp(name, "Name") == 0 || (strcmp(name, "Alias") == 0 && dev.name.empty())) &&
+                       strcmp(sig, "s") == 0) {
+                const char* s;
+                sd_bus_message_read(m, "s", &s);
+                if (dev.name != s) {
+                    dev.name = s;
+                    changed = true;
+                }
+            } else if (strcmp(name, "UUIDs") == 0 && strcmp(sig, "as") == 0) {
+                bool has = StrvContains(m, HR_SERVICE_UUID);
+                changed |= has != dev.has_hr_service;
+                dev.has_hr_service = has;
+            } else if (strcmp(name, "Connected") == 0 && strcmp(sig, "b") == 0) {
+                int b;
+                sd_bus_message_read(m, "b", &b);
+                dev.connected = b != 0;
+            } else if (strcmp(name, "ServicesResolved") == 0 && strcmp(sig, "b") == 0) {
+                int b;
+                sd_bus_message_read(m, "b", &b);
+                dev.services_resolved = b != 0;
+            } else if (strcmp(name, "ManufacturerData") == 0 && strcmp(sig, "a{qv}") == 0) {
+                ReadManufacturerData(m, ad);
+            } else if (strcmp(name, "ServiceData") == 0 && strcmp(sig, "a{sv}") == 0) {
+                ReadServiceData(m, ad);
+            } else {
+                return false;
+            }
+            return true;
+        });
+
+        Session* session = SessionForPath(path);
+        if (!ad.data().empty()) {
+            bool has_hr;
+            if (session && session->passive) {
+                // BlueZ reports no reception time; the manager stamps receipt itself
+                has_hr = PublishAdvertisement(session->stream_id, ad.data(), 0);
+            } else {
+                HeartRateMeasurement hr;
+                has_hr = DecodeAdvertisementHeartRate(ad.data(), hr);
+            }
+            // Broadcasting bands don't always list the HR service UUID
+            if (has_hr && !dev.has_hr_service) {
+                dev.has_hr_service = true;
+                changed = true;
+            }
+        }
+
+        if (changed && dev.has_hr_service) {
+            ReportDevice(dev);
+        }
+
+        if (!session || session->passive) return;
+        if (was_connected && !dev.connected) {
+            blog(LOG_INFO, "BlueZ: %s disconnected", path.c_str());
+            ReportLink(session, false);
+            notifying_.erase(session->notifying_path);
+            session->notifying_path.clear();
+            session->reconnector->OnDisconnected();
+        }
+        if (dev.services_resolved && !was_resolved) {
+            Subscribe(*session);
+        }
+    }
+
+    Session* SessionForPath(const std::string& path) {
+        for (auto& session : live_) {
+            if (session && session->path == path) return session.get();
+        }
+        return nullptr;
+    }
+
+    void AddCharacteristic(const std::string& path, sd_bus_message* m) {
+        bool is_hr = false;
+        ForEachProperty(m, [&](const char* name, const char* sig) {
+            if (strcmp(name, "UUID") != 0 || strcmp(sig, "s") != 0) return false;
+            const char* s;
+            sd_bus_message_read(m, "s", &s);
+            is_hr = strcasecmp(s, HR_MEASUREMENT_CHAR_UUID) == 0;
+            return true;
+        });
+        if (!is_hr) return;
+
+        // .../dev_XX/serviceNNNN/charMMMM -> .../dev_XX
+        std::string device = path.substr(0, path.rfind('/'));
+        device = device.substr(0, device.rfind('/'));
+        hr_chars_[device] = path;
+
+        Session* session = SessionForPath(device);
+        if (session && !session->passive && devices_[device].services_resolved) {
+            Subscribe(*session);
+        }
+    }
+
+    void ReportDevice(const DeviceInfo& info) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!is_scanning_) return;
+        }
+        if (info.address == 0) return;
+
+        BleDevice dev;
+        dev.bluetooth_address = info.address;
+        dev.id = std::to_string(info.address);
+        dev.name = info.name.empty() ? "Unknown Device (" + dev.id + ")" : info.name;
+        PublishDevice(dev);
+    }
+
+    // ---- Connection ------------------------------------------------------
+
+    void CallAdapter(const char* method) {
+        sd_bus_call_method_async(bus_, nullptr, BLUEZ, adapter_path_.c_str(), "org.bluez.Adapter1", method,
+                                 &BleManagerBlueZ::OnCallDone, (void*)method, "");
+    }
+
+    // Discovery runs while scanning or while any session ingests advertisements
+    void UpdateDiscovery() {
+        if (!bus_ || adapter_path_.empty()) return;
+        bool scanning;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            scanning = is_scanning_;
+        }
+        bool passive = false;
+        for (auto& session : live_) {
+            if (session && session->passive) passive = true;
+        }
+        bool wanted = scanning || passive;
+        if (wanted && (!discovering_ || discovery_passive_ != passive)) {
+            SetDiscoveryFilter(passive);
+            if (!discovering_) CallAdapter("StartDiscovery");
+            discovering_ = true;
+            discovery_passive_ = passive;
+        } else if (!wanted && discovering_) {
+            CallAdapter("StopDiscovery");
+            discovering_ = false;
+        }
+    }
+
+    void SetDiscoveryFilter(bool passive) {
+        sd_bus_message* m = nullptr;
+        if (sd_bus_message_new_method_call(bus_, &m, BLUEZ, adapter_path_.c_str(), "org.bluez.Adapter1",
+                                           "SetDiscoveryFilter") < 0) {
+            return;
+        }
+        sd_bus_message_open_container(m, 'a', "{sv}");
+        if (passive) {
+            // Broadcasting bands may not list the HR service, and the BPM
+            // often repeats, so ask for every advertisement
+            sd_bus_message_append(m, "{sv}", "DuplicateData", "b", 1);
+        } else {
+            sd_bus_message_append(m, "{sv}", "UUIDs", "as", 1, HR_SERVICE_UUID);
+        }
+        sd_bus_message_append(m, "{sv}", "Transport", "s", "le");
+        sd_bus_message_close_container(m);
+        sd_bus_call_async(bus_, nullptr, m, &BleManagerBlueZ::OnCallDone, (void*)"SetDiscoveryFilter", 0);
+        sd_bus_message_unref(m);
+    }
+
+    void StartSession(const std::shared_ptr<Session>& session) {
+        if (!bus_ || adapter_path_.empty()) {
+            blog(LOG_WARNING, "BlueZ: no adapter, cannot connect");
+        } else {
+            session->path = DevicePath(adapter_path_, session->address);
+        }
+        live_[session->stream_id] = session;
+        if (session->passive && !session->path.empty()) {
+            // Only listen: no Device1.Connect, no GATT discovery, no StartNotify
+            blog(LOG_INFO, "BlueZ: listening for heart rate broadcasts from %s", session->path.c_str());
+            UpdateDiscovery();
+        }
+    }
+
+    void StopSession(const std::shared_ptr<Session>& session) {
+        if (live_[session->stream_id] == session) live_[session->stream_id].reset();
+        // Drop any reply still in flight for this session
+        session->connect_slot = sd_bus_slot_unref(session->connect_slot);
+        session->notify_slot = sd_bus_slot_unref(session->notify_slot);
+        if (session->passive) {
+            UpdateDiscovery();
+            return;
+        }
+        if (!bus_ || session->path.empty()) return;
+        if (!session->notifying_path.empty()) {
+            sd_bus_call_method_async(bus_, nullptr, BLUEZ, session->notifying_path.c_str(),
+                                     "org.bluez.GattCharacteristic1", "StopNotify", &BleManagerBlueZ::OnCallDone,
+                                     (void*)"StopNotify", "");
+            notifying_.erase(session->notifying_path);
+            session->notifying_path.clear();
+        }
+        sd_bus_call_method_async(bus_, nullptr, BLUEZ, session->path.c_str(), "org.bluez.Device1", "Disconnect",
+                                 &BleManagerBlueZ::OnCallDone, (void*)"Disconnect", "");
+    }
+
+    void ConnectTarget(uint32_t stream_id) {
+        Session* session = live_[stream_id].get();
+        if (!session) return;
+        if (!bus_ || session->path.empty()) {
+            session->reconnector->OnAttemptFailed();
+            return;
+        }
+        if (session->connect_pending) return;
+        DeviceInfo& dev = devices_[session->path];
+        if (dev.connected && dev.services_resolved) {
+            Subscribe(*session);
+            return;
+        }
+        blog(LOG_INFO, "BlueZ: connecting to %s", session->path.c_str());
+        session->connect_pending = true;
+        session->connect_slot = sd_bus_slot_unref(session->connect_slot);
+        sd_bus_call_method_async(bus_, &session->connect_slot, BLUEZ, session->path.c_str(), "org.bluez.Device1",
+                                 "Connect", &BleManagerBlueZ::OnConnectDone, session, "");
+    }
+
+    void Subscribe(Session& session) {
+        auto it = hr_chars_.find(session.path);
+        if (it == hr_chars_.end()) {
+            // Characteristics may still be arriving via InterfacesAdded
+            return;
+        }
+        if (session.notifying_path == it->second) return;
+        session.notifying_path = it->second;
+        notifying_[session.notifying_path] = session.stream_id;
+        blog(LOG_INFO, "BlueZ: subscribing to %s", session.notifying_path.c_str());
+        session.notify_slot = sd_bus_slot_unref(session.notify_slot);
+        sd_bus_call_method_async(bus_, &session.notify_slot, BLUEZ, session.notifying_path.c_str(),
+                                 "org.bluez.GattCharacteristic1", "StartNotify", &BleManagerBlueZ::OnStartNotifyDone,
+                                 &session, "");
+    }
+
+    // ---- D-Bus callbacks (loop thread) -------------------------------------
+
+    static int OnCallDone(sd_bus_message* reply, void* userdata, sd_bus_error*) {
+        const sd_bus_error* error = sd_bus_message_get_error(reply);
+        if (error) {
+            blog(LOG_WARNING, "BlueZ: %s failed: %s", (const char*)userdata, error->message);
+        }
+        return 0;
+    }
+
+    static int OnConnectDone(sd_bus_message* reply, void* userdata, sd_bus_error*) {
+        auto* session = static_cast<Session*>(userdata);
+        session->connect_pending = false;
+        const sd_bus_error* error = sd_bus_message_get_error(reply);
+        if (error) {
+            blog(LOG_WARNING, "BlueZ: connect to %s failed: %s", session->path.c_str(), error->message);
+            session->reconnector->OnAttemptFailed();
+        }
+        // Success is handled once ServicesResolved flips to true
+        return 0;
+    }
+
+    static int OnStartNotifyDone(sd_bus_message* reply, void* userdata, sd_bus_error*) {
+        auto* session = static_cast<Session*>(userdata);
+        const sd_bus_error* error = sd_bus_message_get_error(reply);
+        if (error) {
+            blog(LOG_WARNING, "BlueZ: StartNotify on %s failed: %s", session->path.c_str(), error->message);
+            session->owner->notifying_.erase(session->notifying_path);
+            session->notifying_path.clear();
+            session->reconnector->OnAttemptFailed();
+            return 0;
+        }
+        blog(LOG_INFO, "BlueZ: subscribed to %s", session->path.c_str());
+        session->owner->ReportLink(session, true);
+        session->reconnector->OnConnected();
+        return 0;
+    }
+
+    static int OnInterfacesAdded(sd_bus_message* m, void* userdata, sd_bus_error*) {
+        auto* self = static_cast<BleManagerBlueZ*>(userdata);
+        const char* path;
+        if (sd_bus_message_read(m, "o", &path) < 0) return 0;
+        self->ParseInterfaces(path, m);
+        return 0;
+    }
+
+    static int OnInterfacesRemoved(sd_bus_message* m, void* userdata, sd_bus_error*) {
+        auto* self = static_cast<BleManagerBlueZ*>(userdata);
+        const char* path;
+        if (sd_bus_message_read(m, "o", &path) < 0) return 0;
+        if (sd_bus_message_enter_container(m, 'a', "s") < 0) return 0;
+        const char* iface;
+        while (sd_bus_message_read(m, "s", &iface) > 0) {
+            if (strcmp(iface, "org.bluez.Device1") == 0) {
+                self->devices_.erase(path);
+                self->hr_chars_.erase(path);
+            }
+        }
+        return 0;
+    }
+
+    static int OnPropertiesChanged(sd_bus_message* m, void* userdata, sd_bus_error*) {
+        auto* self = static_cast<BleManagerBlueZ*>(userdata);
+        const char* iface;
+        if (sd_bus_message_read(m, "s", &iface) < 0) return 0;
+        std::string path = sd_bus_message_get_path(m);
+
+        if (strcmp(iface, "org.bluez.GattCharacteristic1") == 0) {
+            auto it = self->notifying_.find(path);
+            if (it == self->notifying_.end()) return 0;
+            uint32_t stream_id = it->second;
+            ForEachProperty(m, [&](const char* name, const char* sig) {
+                if (strcmp(name, "Value") != 0 || strcmp(sig, "ay") != 0) return false;
+                const void* data;
+                size_t size;
+                if (sd_bus_message_read_array(m, 'y', &data, &size) >= 0) {
+                    // No stack timestamp over D-Bus; PublishNotification stamps receipt
+                    self->PublishNotification(stream_id, { static_cast<const uint8_t*>(data), size }, 0);
+                }
+                return true;
+            });
+        } else if (strcmp(iface, "org.bluez.Device1") == 0) {
+            if (self->devices_.count(path) || HasPrefix(path, self->adapter_path_)) {
+                self->UpdateDevice(path, m);
+            }
+        }
+        return 0;
+    }
+};
+
+std::shared_ptr<BleManager> CreateBlueZBleManager() {
+    return std::make_shared<BleManagerBlueZ>();
+}
@@ -0,0 +1,185 @@
+#include "ble-backends.hpp"
+#include "hr-capture.hpp"
+#include <obs-module.h>
+#include <util/platform.h>
+
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Replay backend: advertises one device per band in a .hrcap capture and,
+// once connected, feeds that band's notifications through
+// PublishNotification at 1x (or any multiple) or as fast as the pipeline
+// will take it. It waits for room in the dispatch queue rather than
+// dropping, so a max-speed run delivers every record. Bands are told
+// apart by the stream they were captured on.
+
+static const uint64_t REPLAY_ADDRESS = 0xFEED00000001ull;  // + captured stream
+
+ReplayBleOptions ReplayBleOptionsFromEnv(const std::string& path) {
+    ReplayBleOptions options;
+    options.path = path;
+    if (const char* speed = getenv("MIBAND_HR_REPLAY_SPEED")) {
+        double value = strtod(speed, nullptr);
+        if (value >= 0) options.speed = value;
+    }
+    if (const char* loop = getenv("MIBAND_HR_REPLAY_LOOP")) {
+        options.loop = *loop && *loop != '0';
+    }
+    return options;
+}
+
+class BleManagerReplay : public BleManager {
+    ReplayBleOptions options_;
+    CaptureReader reader_;
+    uint32_t captured_streams_ = 0;  // bit n: the capture has records for stream n
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool is_scanning_ = false;
+    bool shutdown_ = false;
+    std::thread scan_thread_;
+
+    // Indexed by the live stream a captured band was connected on
+    std::thread replay_threads_[kMaxStreams];
+    bool stopping_[kMaxStreams] = {};  // under mutex_
+
+public:
+    explicit BleManagerReplay(const ReplayBleOptions& options) : options_(options) {
+        if (reader_.Load(options_.path)) {
+            CaptureRecord record;
+            while (reader_.Next(record)) {
+                if (record.stream_id < kMaxStreams) captured_streams_ |= 1u << record.stream_id;
+            }
+            blog(LOG_INFO, "Replay BLE: %s, %d band(s) at %s%s", options_.path.c_str(),
+                 std::popcount(captured_streams_),
+                 options_.speed > 0 ? (std::to_string(options_.speed) + "x").c_str() : "max speed",
+                 options_.loop ? ", looping" : "");
+        }
+    }
+
+    ~BleManagerReplay() {
+        DisconnectAll();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            is_scanning_ = false;
+            shutdown_ = true;
+        }
+        cv_.notify_all();
+        if (scan_thread_.joinable()) scan_thread_.join();
+    }
+
+protected:
+    void StartScanning() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            is_scanning_ = true;
+            if (!scan_thread_.joinable()) {
+                scan_thread_ = std::thread([this]() { ScanLoop(); });
+            }
+        }
+        cv_.notify_all();
+    }
+
+    void StopScanning() override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        is_scanning_ = false;
+    }
+
+    bool OpenSession(uint32_t stream_id, const std::string& device_id, IngestMode) override {
+        uint32_t captured = kInvalidStream;
+        for (uint32_t i = 0; i < kMaxStreams; ++i) {
+            if ((captured_streams_ & (1u << i)) && device_id == std::to_string(REPLAY_ADDRESS + i)) captured = i;
+        }
+        if (captured == kInvalidStream) {
+            blog(LOG_WARNING, "Replay BLE: unknown device %s", device_id.c_str());
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_[stream_id] = false;
+        }
+        replay_threads_[stream_id] = std::thread([this, stream_id, captured]() { ReplayLoop(stream_id, captured); });
+        return true;
+    }
+
+    void CloseSession(uint32_t stream_id) override {
+        if (!replay_threads_[stream_id].joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_[stream_id] = true;
+        }
+        cv_.notify_all();
+        replay_threads_[stream_id].join();
+    }
+
+private:
+    void ScanLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!shutdown_) {
+            if (!is_scanning_) {
+                cv_.wait(lock, [this]() { return is_scanning_ || shutdown_; });
+                continue;
+            }
+            lock.unlock();
+            std::string name = "Replay: " + options_.path.substr(options_.path.find_last_of("/\\") + 1);
+            for (uint32_t i = 0; i < kMaxStreams; ++i) {
+                if (!(captured_streams_ & (1u << i))) continue;
+                BleDevice dev;
+                dev.bluetooth_address = REPLAY_ADDRESS + i;
+                dev.id = std::to_string(dev.bluetooth_address);
+                dev.name = std::has_single_bit(captured_streams_) ? name : name + " #" + std::to_string(i);
+                PublishDevice(dev);
+            }
+            lock.lock();
+            cv_.wait_for(lock, std::chrono::milliseconds(500), [this]() { return !is_scanning_ || shutdown_; });
+        }
+    }
+
+    // Plays the records of one captured band; each session has its own
+    // position in the shared capture
+    void ReplayLoop(uint32_t stream_id, uint32_t captured) {
+        using clock = std::chrono::steady_clock;
+        PublishLinkState(stream_id, true);
+
+        CaptureReader reader = reader_;
+        uint64_t delivered = 0;
+        uint64_t dropped = 0;
+        uint64_t start_ns = os_gettime_ns();
+        do {
+            reader.Rewind();
+            auto start = clock::now();
+            CaptureRecord record;
+            while (reader.Next(record)) {
+                if (record.stream_id != captured) continue;
+                if (options_.speed > 0) {
+                    auto due = start + std::chrono::microseconds((int64_t)(record.offset_us / options_.speed));
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    if (cv_.wait_until(lock, due, [this, stream_id]() { return stopping_[stream_id]; })) return;
+                } else {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (stopping_[stream_id]) return;
+                }
+                if (PublishNotification(stream_id, record.payload, 0, QueueFull::Wait)) {
+                    ++delivered;
+                } else {
+                    ++dropped;
+                }
+            }
+        } while (options_.loop && delivered + dropped > 0);
+
+        double secs = (os_gettime_ns() - start_ns) / 1e9;
+        blog(LOG_INFO, "Replay BLE: stream %u finished, %llu notifications delivered, %llu dropped in %.3f s (%.0f/s)",
+             stream_id, (unsigned long long)delivered, (unsigned long long)dropped, secs,
+             secs > 0 ? delivered / secs : 0.0);
+        PublishLinkState(stream_id, false);
+    }
+};
+
+std::shared_ptr<BleManager> CreateReplayBleManager(const ReplayBleOptions& options) {
+    return std::make_shared<BleManagerReplay>(options);
+}
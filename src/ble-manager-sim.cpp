@@ -0,0 +1,319 @@
+#include "ble-backends.hpp"
+#include "reconnector.hpp"
+#include "hr-advertisement.hpp"
+#include <obs-module.h>
+#include <util/platform.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Simulated backend: advertises a handful of fake bands and generates
+// synthetic 0x2A37 payloads (BPM, RR intervals, contact, energy) at a
+// configurable rate, so the whole pipeline runs without a radio. In
+// advertisement mode the same readings go out as Huami broadcasts instead.
+// At rates the dispatcher can't keep up with, a band waits for queue room
+// rather than dropping readings.
+// Every band can be connected at the same time, each on its own stream.
+
+static const uint64_t SIM_BASE_ADDRESS = 0xC0FFEE000000ull;
+
+static uint32_t EnvU32(const char* name, uint32_t fallback) {
+    const char* value = getenv(name);
+    if (!value || !*value) return fallback;
+    return (uint32_t)strtoul(value, nullptr, 10);
+}
+
+SimBleOptions SimBleOptionsFromEnv() {
+    SimBleOptions options;
+    options.device_count = (int)EnvU32("MIBAND_HR_SIM_DEVICES", (uint32_t)options.device_count);
+    options.base_bpm = (int)EnvU32("MIBAND_HR_SIM_BPM", (uint32_t)options.base_bpm);
+    options.jitter_ms = EnvU32("MIBAND_HR_SIM_JITTER_MS", options.jitter_ms);
+    options.disconnect_every_s = EnvU32("MIBAND_HR_SIM_DISCONNECT_S", options.disconnect_every_s);
+    options.disconnect_for_ms = EnvU32("MIBAND_HR_SIM_DISCONNECT_MS", options.disconnect_for_ms);
+    options.connect_fail_percent = EnvU32("MIBAND_HR_SIM_CONNECT_FAIL", options.connect_fail_percent);
+    if (const char* rate = getenv("MIBAND_HR_SIM_RATE")) {
+        double hz = strtod(rate, nullptr);
+        if (hz > 0) options.rate_hz = hz;
+    }
+    if (options.device_count < 1) options.device_count = 1;
+    return options;
+}
+
+class BleManagerSim : public BleManager {
+    // One simulated band link. Link fields are guarded by the manager's
+    // mutex_; the stream and reconnector threads only touch their own session.
+    struct Session {
+        uint64_t address = 0;
+        uint32_t stream_id = 0;
+        int index = 0;
+        bool passive = false;
+        std::thread stream_thread;
+        bool link_up = false;
+        bool stopping = false;
+        std::chrono::steady_clock::time_point unreachable_until;
+        // Last member: its thread calls AttemptConnect and must stop first
+        std::unique_ptr<Reconnector> reconnector;
+    };
+
+    SimBleOptions options_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    bool is_scanning_ = false;
+    bool shutdown_ = false;
+    std::thread scan_thread_;
+
+    std::unique_ptr<Session> sessions_[kMaxStreams];
+    std::mt19937 connect_rng_{ 1234 };
+
+public:
+    explicit BleManagerSim(const SimBleOptions& options) : options_(options) {
+        blog(LOG_INFO, "Simulated BLE: %d devices at %.1f Hz, jitter %u ms, drop every %u s",
+             options_.device_count, options_.rate_hz, options_.jitter_ms, options_.disconnect_every_s);
+    }
+
+    ~BleManagerSim() {
+        DisconnectAll();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            is_scanning_ = false;
+            shutdown_ = true;
+        }
+        cv_.notify_all();
+        if (scan_thread_.joinable()) scan_thread_.join();
+    }
+
+protected:
+    void StartScanning() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            is_scanning_ = true;
+            // The advertiser thread lives until destruction; callers may hold
+            // their own locks here, so never join it from Start/StopScan.
+            if (!scan_thread_.joinable()) {
+                scan_thread_ = std::thread([this]() { ScanLoop(); });
+            }
+        }
+        cv_.notify_all();
+    }
+
+    void StopScanning() override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        is_scanning_ = false;
+    }
+
+    bool OpenSession(uint32_t stream_id, const std::string& device_id, IngestMode mode) override {
+        uint64_t address = 0;
+        try {
+            address = std::stoull(device_id);
+        } catch (...) {
+            return false;
+        }
+        if (address < SIM_BASE_ADDRESS || address >= SIM_BASE_ADDRESS + (uint64_t)options_.device_count) {
+            blog(LOG_WARNING, "Simulated BLE: unknown device %s", device_id.c_str());
+            return false;
+        }
+
+        auto session = std::make_unique<Session>();
+        Session* s = session.get();
+        s->address = address;
+        s->stream_id = stream_id;
+        s->index = (int)(address - SIM_BASE_ADDRESS);
+        // Broadcasts need no link; the band is "up" as soon as we listen
+        s->passive = mode == IngestMode::Advertisement;
+        s->link_up = s->passive;
+        s->reconnector = std::make_unique<Reconnector>([this, s]() { AttemptConnect(*s); });
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            sessions_[stream_id] = std::move(session);
+        }
+        s->stream_thread = std::thread([this, s]() { StreamLoop(*s); });
+        if (!s->passive) s->reconnector->Enable();
+        return true;
+    }
+
+    void CloseSession(uint32_t stream_id) override {
+        std::unique_ptr<Session> session;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            session = std::move(sessions_[stream_id]);
+            if (!session) return;
+            session->stopping = true;
+            session->link_up = false;
+        }
+        session->reconnector->Disable();
+        cv_.notify_all();
+        if (session->stream_thread.joinable()) session->stream_thread.join();
+        // ~Session stops the reconnector thread; an in-flight attempt sees `stopping`
+    }
+
+    ReconnectStats SessionReconnectStats(uint32_t stream_id) const override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const Session* s = sessions_[stream_id].get();
+        return s ? s->reconnector->Stats() : ReconnectStats{};
+    }
+
+private:
+    void ScanLoop() {
+        // Re-advertise every device periodically, like a real watcher does
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!shutdown_) {
+            if (!is_scanning_) {
+                cv_.wait(lock, [this]() { return is_scanning_ || shutdown_; });
+                continue;
+            }
+            lock.unlock();
+            for (int i = 0; i < options_.device_count; ++i) {
+                BleDevice dev;
+                dev.bluetooth_address = SIM_BASE_ADDRESS + (uint64_t)i;
+                dev.id = std::to_string(dev.bluetooth_address);
+                dev.name = "Simulated Band " + std::to_string(i + 1);
+                PublishDevice(dev);
+            }
+            lock.lock();
+            cv_.wait_for(lock, std::chrono::milliseconds(500), [this]() { return !is_scanning_ || shutdown_; });
+        }
+    }
+
+    // Runs on the session's reconnector thread. Link setup "takes" 100 ms
+    // and fails while an injected outage lasts, or at the configured rate.
+    void AttemptConnect(Session& s) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (cv_.wait_for(lock, std::chrono::milliseconds(100), [&s]() { return s.stopping; })) return;
+
+        bool fail = std::chrono::steady_clock::now() < s.unreachable_until ||
+                    (options_.connect_fail_percent > 0 && connect_rng_() % 100 < options_.connect_fail_percent);
+        if (fail) {
+            lock.unlock();
+            s.reconnector->OnAttemptFailed();
+            return;
+        }
+        s.link_up = true;
+        PublishLinkState(s.stream_id, true);
+        lock.unlock();
+        cv_.notify_all();
+        blog(LOG_INFO, "Simulated BLE: connected to %llu", (unsigned long long)s.address);
+        s.reconnector->OnConnected();
+    }
+
+    // Sleeps until `deadline` unless the session is stopped
+    bool WaitUntil(Session& s, std::chrono::steady_clock::time_point deadline) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return !cv_.wait_until(lock, deadline, [&s]() { return s.stopping; });
+    }
+
+    // Blocks while the link is down; false once the session is stopped
+    bool WaitForLink(Session& s) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&s]() { return s.stopping || s.link_up; });
+        return !s.stopping;
+    }
+
+    void StreamLoop(Session& s) {
+        using clock = std::chrono::steady_clock;
+        const auto period = std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>(1.0 / options_.rate_hz));
+        const auto drop_every = options_.disconnect_every_s ? clock::duration(std::chrono::seconds(options_.disconnect_every_s))
+                                                            : clock::duration::max();
+
+        std::mt19937 rng((uint32_t)s.address);
+        std::uniform_int_distribution<uint32_t> jitter(0, options_.jitter_ms * 1000);
+        std::normal_distribution<double> noise(0.0, 1.5);
+        // Spread the bands out so a multi-device overlay is easy to read
+        const double base_bpm = options_.base_bpm + 6.0 * s.index;
+
+        auto start = clock::now();
+        auto next = start;
+        auto next_drop = clock::time_point::max();
+        bool up = false;
+        uint16_t energy = 0;
+        uint64_t n = 0;
+
+        for (;;) {
+            if (!up) {
+                if (!WaitForLink(s)) return;
+                up = true;
+                next = clock::now();
+                next_drop = drop_every == clock::duration::max() ? clock::time_point::max() : next + drop_every;
+            }
+
+            if (clock::now() >= next_drop && s.passive) {
+                // Out of radio range: broadcasts stop, nothing to reconnect
+                blog(LOG_INFO, "Simulated BLE: injected broadcast gap on stream %u", s.stream_id);
+                if (!WaitUntil(s, clock::now() + std::chrono::milliseconds(options_.disconnect_for_ms))) return;
+                next = clock::now();
+                next_drop = next + drop_every;
+                continue;
+            }
+
+            if (clock::now() >= next_drop) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    s.link_up = false;
+                    s.unreachable_until = clock::now() + std::chrono::milliseconds(options_.disconnect_for_ms);
+                    PublishLinkState(s.stream_id, false);
+                }
+                up = false;
+                blog(LOG_INFO, "Simulated BLE: injected disconnect on stream %u", s.stream_id);
+                s.reconnector->OnDisconnected();
+                continue;
+            }
+
+            if (!WaitUntil(s, next)) return;
+            uint64_t scheduled_ns = os_gettime_ns();
+
+            if (options_.jitter_ms > 0) {
+                if (!WaitUntil(s, clock::now() + std::chrono::microseconds(jitter(rng)))) return;
+            }
+
+            // Slow breathing-like drift around the base rate plus noise
+            double t = std::chrono::duration<double>(clock::now() - start).count();
+            double bpm = base_bpm + 8.0 * std::sin(t * 0.2) + noise(rng);
+            if (bpm < 30) bpm = 30;
+            if (bpm > 250) bpm = 250;
+            uint16_t rr = (uint16_t)std::lround(60.0 * 1024.0 / bpm);
+
+            if (s.passive) {
+                // Huami layout: 3 opaque bytes, then the BPM
+                const uint8_t huami[] = { 0x02, 0x00, 0x00, (uint8_t)std::lround(bpm) };
+                AdvertisementBuilder ad;
+                ad.AppendManufacturer(COMPANY_ID_HUAMI, huami);
+                PublishAdvertisement(s.stream_id, ad.data(), scheduled_ns, QueueFull::Wait);
+            } else {
+                uint8_t payload[8];
+                size_t len = 0;
+                bool with_energy = (n % 10) == 0;
+                payload[len++] = HR_FLAG_CONTACT_SUPPORTED | HR_FLAG_CONTACT_DETECTED | HR_FLAG_RR_PRESENT |
+                                 (with_energy ? HR_FLAG_ENERGY_PRESENT : 0);
+                payload[len++] = (uint8_t)std::lround(bpm);
+                if (with_energy) {
+                    payload[len++] = (uint8_t)(energy & 0xFF);
+                    payload[len++] = (uint8_t)(energy >> 8);
+                    energy++;
+                }
+                payload[len++] = (uint8_t)(rr & 0xFF);
+                payload[len++] = (uint8_t)(rr >> 8);
+
+                PublishNotification(s.stream_id, { payload, len }, scheduled_ns, QueueFull::Wait);
+            }
+
+            ++n;
+            next += period;
+            // Don't try to catch up a backlog after a stall
+            if (next < clock::now() - period * 4) next = clock::now();
+        }
+    }
+};
+
+std::shared_ptr<BleManager> CreateSimBleManager(const SimBleOptions& options) {
+    return std::make_shared<BleManagerSim>(options);
+}
@@ -1,7 +1,10 @@
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
-#include "ble-manager.hpp"
+#include "ble-backends.hpp"
+#include "reconnector.hpp"
+#include "hr-advertisement.hpp"
 #include <obs-module.h>
+#include <util/platform.h>
 
 #include <winrt/Windows.Foundation.h>
 #include <winrt/Windows.Foundation.Collections.h>
@@ -16,6 +19,10 @@
 #include <iomanip>
 #include <vector>
 #include <atomic>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <utility>
 
 using namespace winrt;
 using namespace Windows::Foundation;
@@ -65,6 +72,17 @@ static void TrimRawBytes(std::vector<uint8_t>& bytes) {
     }
 }
 
+// WinRT stamps notifications with wall-clock time; move that into the
+// os_gettime_ns() domain by measuring how old the stamp is right now.
+static uint64_t ToMonotonicNs(DateTime stamp) {
+    uint64_t now_ns = os_gettime_ns();
+    auto age = std::chrono::system_clock::now() - winrt::clock::to_sys(stamp);
+    int64_t age_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(age).count();
+    if (age_ns < 0) age_ns = 0;
+    if ((uint64_t)age_ns > now_ns) return 0;
+    return now_ns - (uint64_t)age_ns;
+}
+
 // UUIDs
 // 0000180d-0000-1000-8000-00805f9b34fb
 static const guid HR_SERVICE_UUID = { 0x0000180d, 0x0000, 0x1000, { 0x80, 0x00, 0x00, 0x80, 0x5f, 0x9b, 0x34, 0xfb } };
@@ -72,24 +90,32 @@ static const guid HR_SERVICE_UUID = { 0x0000180d, 0x0000, 0x1000, { 0x80, 0x00,
 static const guid HR_MEASUREMENT_CHAR_UUID = { 0x00002a37, 0x0000, 0x1000, { 0x80, 0x00, 0x00, 0x80, 0x5f, 0x9b, 0x34, 0xfb } };
 
 class BleManagerWinRT : public BleManager, public std::enable_shared_from_this<BleManagerWinRT> {
+    // One band. WinRT objects, tokens and `closed` are guarded by the
+    // manager's mutex_.
+    struct Session : std::enable_shared_from_this<Session> {
+        uint32_t stream_id = 0;
+        uint64_t address = 0;
+        bool passive = false;  // advertisement ingest: no GATT link at all
+        bool closed = false;   // CloseSession ran; late async results are dropped
+        BluetoothLEDevice device{ nullptr };
+        GattCharacteristic hr_characteristic{ nullptr };
+        event_token value_changed_token;
+        event_token connection_status_token;
+        std::atomic<bool> is_connecting{false};
+        // Last member: auto-reconnect, driven by ConnectionStatusChanged
+        std::unique_ptr<Reconnector> reconnector;
+    };
+
     BluetoothLEAdvertisementWatcher watcher_{ nullptr };
-    BluetoothLEDevice device_{ nullptr };
-    GattCharacteristic hr_characteristic_{ nullptr };
-    event_token value_changed_token_;
-    event_token connection_status_token_;
-    
-    ScanCallback scan_callback_;
-    HeartRateCallback hr_callback_;
-    
-    std::mutex mutex_;
+
+    mutable std::mutex mutex_;
     bool is_scanning_ = false;
-    
-    // Auto-reconnect logic
-    bool should_reconnect_ = false;
-    uint64_t target_address_ = 0;
-    std::thread reconnect_thread_;
-    std::atomic<bool> reconnect_thread_active_{false};
-    std::atomic<bool> is_connecting_{false};
+    bool watcher_running_ = false;
+    std::shared_ptr<Session> sessions_[kMaxStreams];
+    // Advertisement ingest targets, so a broadcast is routed in O(1)
+    std::unordered_map<uint64_t, uint32_t> passive_streams_;
+    // CCCD "None" writes still in flight after CloseDevice
+    std::vector<IAsyncOperation<GattCommunicationStatus>> pending_unsubscribes_;
 
 public:
     BleManagerWinRT() {
@@ -97,8 +123,32 @@ public:
         watcher_.ScanningMode(BluetoothLEScanningMode::Active);
         
         watcher_.Received([this](BluetoothLEAdvertisementWatcher sender, BluetoothLEAdvertisementReceivedEventArgs args) {
+            uint64_t address = args.BluetoothAddress();
+
+            // Connectionless heart rate from the target's broadcasts
+            AdvertisementBuilder ad;
+            for (auto section : args.Advertisement().DataSections()) {
+                auto data = section.Data();
+                ad.Append(section.DataType(), { data.data(), data.Length() });
+            }
+            uint32_t passive_stream = kInvalidStream;
+            bool scanning;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto it = passive_streams_.find(address);
+                if (it != passive_streams_.end()) passive_stream = it->second;
+                scanning = is_scanning_;
+            }
+            bool has_broadcast_hr = false;
+            if (passive_stream != kInvalidStream) {
+                has_broadcast_hr = PublishAdvertisement(passive_stream, ad.data(), ToMonotonicNs(args.Timestamp()));
+            } else {
+                HeartRateMeasurement m;
+                has_broadcast_hr = DecodeAdvertisementHeartRate(ad.data(), m);
+            }
+
             // Check for Heart Rate Service
-            bool has_hr_service = false;
+            bool has_hr_service = has_broadcast_hr;
             for (auto uuid : args.Advertisement().ServiceUuids()) {
                 if (uuid == HR_SERVICE_UUID) {
                     has_hr_service = true;
@@ -109,9 +159,9 @@ public:
             // We can also check Company ID if needed for filtering specific bands, 
             // but standard service is the requirement for 10 series.
             
-            if (has_hr_service) {
+            if (has_hr_service && scanning) {
                  BleDevice dev;
-                 dev.bluetooth_address = args.BluetoothAddress();
+                 dev.bluetooth_address = address;
                  dev.id = std::to_string(dev.bluetooth_address);
                  
                  // Try to decode name manually to handle GBK/garbled text
@@ -152,114 +202,126 @@ public:
                      dev.name = "Unknown Device (" + dev.id + ")";
                  }
 
-                 std::lock_guard<std::mutex> lock(mutex_);
-                 if (scan_callback_) {
-                     scan_callback_(dev);
-                 }
+                 PublishDevice(dev);
             }
         });
     }
     
     ~BleManagerWinRT() {
         StopScan();
-        Disconnect();
-        StopReconnectThread();
+        DisconnectAll();
+        WaitForUnsubscribes(std::chrono::milliseconds(1000));
     }
 
-    void StopReconnectThread() {
-        reconnect_thread_active_ = false;
-        if (reconnect_thread_.joinable()) {
-            reconnect_thread_.join();
-        }
+protected:
+    void StartScanning() override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        is_scanning_ = true;
+        UpdateWatcherLocked();
     }
 
-    void StartReconnectThread() {
-        if (reconnect_thread_active_) return;
-        reconnect_thread_active_ = true;
-        reconnect_thread_ = std::thread([this]() {
-            while (reconnect_thread_active_) {
-                if (should_reconnect_ && target_address_ != 0) {
-                     // Check if connected
-                     bool connected = false;
-                     {
-                         std::lock_guard<std::mutex> lock(mutex_);
-                         if (device_) {
-                             try {
-                                 connected = (device_.ConnectionStatus() == BluetoothConnectionStatus::Connected);
-                             } catch(...) {}
-                         }
-                     }
-                     
-                     if (!connected && !is_connecting_) {
-                         blog(LOG_INFO, "Auto-reconnect: Attempting to connect...");
-                         ConnectAsync(target_address_);
-                     }
-                }
-                
-                // Sleep for 5s
-                for (int i = 0; i < 50; i++) {
-                    if (!reconnect_thread_active_) break;
-                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                }
-            }
-        });
+    void StopScanning() override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        is_scanning_ = false;
+        UpdateWatcherLocked();
     }
 
-    void StartScan(ScanCallback callback) override {
-        std::lock_guard<std::mutex> lock(mutex_);
-        scan_callback_ = callback;
-        if (!is_scanning_) {
-            try {
+    // The watcher serves both the scan list and advertisement ingest
+    void UpdateWatcherLocked() {
+        bool wanted = is_scanning_ || !passive_streams_.empty();
+        try {
+            if (wanted && !watcher_running_) {
                 watcher_.Start();
-                is_scanning_ = true;
-            } catch(...) {
-                // Handle start failure
+                watcher_running_ = true;
+            } else if (!wanted && watcher_running_) {
+                watcher_.Stop();
+                watcher_running_ = false;
             }
+        } catch (...) {
+            // Handle start failure
         }
     }
 
-    void StopScan() override {
+    bool OpenSession(uint32_t stream_id, const std::string& device_id, IngestMode mode) override {
+        uint64_t address = 0;
+        try {
+            address = std::stoull(device_id);
+        } catch (...) {
+            return false;  // Invalid ID
+        }
+        auto session = std::make_shared<Session>();
+        session->stream_id = stream_id;
+        session->address = address;
+        session->passive = mode == IngestMode::Advertisement;
+        Session* raw = session.get();
+        session->reconnector = std::make_unique<Reconnector>([this, raw]() { AttemptReconnect(*raw); });
+
         std::lock_guard<std::mutex> lock(mutex_);
-        if (is_scanning_) {
-            watcher_.Stop();
-            is_scanning_ = false;
+        sessions_[stream_id] = session;
+        if (session->passive) {
+            // No GATT at all: skip discovery and the CCCD write
+            blog(LOG_INFO, "Listening for heart rate broadcasts from %llu", address);
+            passive_streams_[address] = stream_id;
+            UpdateWatcherLocked();
+        } else {
+            // First attempt runs immediately on the reconnector thread
+            session->reconnector->Enable();
         }
+        return true;
     }
 
-    void Connect(const std::string& device_id_str) override {
-        try {
-            uint64_t address = std::stoull(device_id_str);
-            
-            // Set up auto-reconnect
-            {
-                std::lock_guard<std::mutex> lock(mutex_);
-                should_reconnect_ = true;
-                target_address_ = address;
+    void CloseSession(uint32_t stream_id) override {
+        std::shared_ptr<Session> session;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            session.swap(sessions_[stream_id]);
+            if (!session) return;
+            session->closed = true;
+            if (session->passive) {
+                passive_streams_.erase(session->address);
+                UpdateWatcherLocked();
             }
-            
-            ConnectAsync(address);
-            StartReconnectThread();
-        } catch (...) {
-            // Invalid ID
         }
+        // User explicitly disconnected, so disable auto-reconnect
+        session->reconnector->Disable();
+        CloseDevice(*session);
+        // An in-flight ConnectAsync holds its own reference
     }
-    
-    fire_and_forget ConnectAsync(uint64_t address) {
-        // Keep alive while async
-        auto self = shared_from_this();
 
-        bool expected = false;
-        if (!is_connecting_.compare_exchange_strong(expected, true)) {
-            blog(LOG_INFO, "Connection already in progress, skipping request for %llu", address);
-            co_return;
-        }
+    ReconnectStats SessionReconnectStats(uint32_t stream_id) const override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const Session* session = sessions_[stream_id].get();
+        return session ? session->reconnector->Stats() : ReconnectStats{};
+    }
+
+private:
+    // Sessions own their reconnector thread, so the last reference to one
+    // must never be dropped on that thread: the coroutine hops to the thread
+    // pool before it takes any references.
+    fire_and_forget ConnectAsync(std::weak_ptr<BleManagerWinRT> weak_self, std::weak_ptr<Session> weak_session) {
+        co_await resume_background();
+        auto self = weak_self.lock();
+        auto session = weak_session.lock();
+        if (!self || !session) co_return;
+        uint64_t address = session->address;
+        uint32_t stream_id = session->stream_id;
 
+        // Every early co_return is a failed attempt as far as the
+        // reconnector is concerned
         struct ConnectionGuard {
-            std::atomic<bool>& flag;
-            ConnectionGuard(std::atomic<bool>& f) : flag(f) {}
-            ~ConnectionGuard() { flag = false; }
+            Session& session;
+            bool subscribed = false;
+            ConnectionGuard(Session& s) : session(s) {}
+            ~ConnectionGuard() {
+                session.is_connecting = false;
+                if (subscribed) {
+                    session.reconnector->OnConnected();
+                } else {
+                    session.reconnector->OnAttemptFailed();
+                }
+            }
         };
-        ConnectionGuard guard(is_connecting_);
+        ConnectionGuard guard(*session);
         
         try {
             blog(LOG_INFO, "Connecting to device address: %llu", address);
@@ -271,7 +333,22 @@ public:
             
             {
                 std::lock_guard<std::mutex> lock(mutex_);
-                device_ = device;
+                if (session->closed) {
+                    device.Close();
+                    co_return;
+                }
+                if (session->device && session->connection_status_token.value != 0) {
+                    try {
+                        session->device.ConnectionStatusChanged(session->connection_status_token);
+                    } catch (...) {}
+                }
+                session->device = device;
+                session->connection_status_token = device.ConnectionStatusChanged(
+                    [weak_self, weak_session](BluetoothLEDevice const& sender, IInspectable const&) {
+                        auto self = weak_self.lock();
+                        auto strong = weak_session.lock();
+                        if (self && strong) self->OnConnectionStatusChanged(*strong, sender);
+                    });
             }
 
             blog(LOG_INFO, "Discovering services...");
@@ -311,18 +388,28 @@ public:
                  co_return;
             }
             
-            {
-                std::lock_guard<std::mutex> lock(mutex_);
-                hr_characteristic_ = characteristic;
-            }
-
             // Subscribe
             blog(LOG_INFO, "Subscribing to notifications...");
             auto status = co_await characteristic.WriteClientCharacteristicConfigurationDescriptorAsync(GattClientCharacteristicConfigurationDescriptorValue::Notify);
             if (status == GattCommunicationStatus::Success) {
-                 blog(LOG_INFO, "Subscribed successfully");
+                 blog(LOG_INFO, "Subscribed successfully (stream %u)", stream_id);
                  std::lock_guard<std::mutex> lock(mutex_);
-                 value_changed_token_ = characteristic.ValueChanged({ this, &BleManagerWinRT::OnValueChanged });
+                 if (session->closed) co_return;
+                 if (session->hr_characteristic && session->value_changed_token.value != 0) {
+                     try {
+                         session->hr_characteristic.ValueChanged(session->value_changed_token);
+                     } catch (...) {}
+                 }
+                 session->hr_characteristic = characteristic;
+                 // The stream id rides along in the handler, so routing is free
+                 session->value_changed_token = characteristic.ValueChanged(
+                     [this, stream_id](GattCharacteristic const&, GattValueChangedEventArgs const& args) {
+                         OnValueChanged(stream_id, args);
+                     });
+                 guard.subscribed = true;
+                 // The band may have been connected before the handler was
+                 // registered, so no change event would say so
+                 PublishLinkState(stream_id, true);
                  
                  // If success, we should try to read once if possible or wait for notify.
                  // But HR measurement is usually Notify only.
@@ -331,100 +418,112 @@ public:
             }
         } catch (...) {
             blog(LOG_ERROR, "Exception in ConnectAsync");
-            Disconnect();
+            CloseDevice(*session);
         }
     }
 
-    void Disconnect() override {
-        // User explicitly called disconnect, so disable auto-reconnect
+    // Tears the link down without touching the reconnect state. The CCCD
+    // write that tells the band to stop notifying is not awaited (it used to
+    // block for up to 1 s under mutex_): the device is closed from its
+    // completion handler, and the destructor bounds how long stragglers get.
+    void CloseDevice(Session& session) {
+        GattCharacteristic characteristic{ nullptr };
+        BluetoothLEDevice device{ nullptr };
         {
             std::lock_guard<std::mutex> lock(mutex_);
-            should_reconnect_ = false;
-        }
-        
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (hr_characteristic_) {
-            if (value_changed_token_.value != 0) {
-                 try {
-                    hr_characteristic_.ValueChanged(value_changed_token_);
-                 } catch(...) {}
-                 value_changed_token_ = {};
-            }
-            
-            // Try to write None to CCCD to stop notifications on the device
-            try {
-                auto op = hr_characteristic_.WriteClientCharacteristicConfigurationDescriptorAsync(GattClientCharacteristicConfigurationDescriptorValue::None);
-                // Simple block wait with timeout to avoid hanging UI/Shutdown
-                if (op.wait_for(std::chrono::seconds(1)) != AsyncStatus::Completed) {
-                    op.Cancel();
-                }
-            } catch (...) {
-                // Ignore errors during disconnect
+            if (session.hr_characteristic && session.value_changed_token.value != 0) {
+                try {
+                    session.hr_characteristic.ValueChanged(session.value_changed_token);
+                } catch(...) {}
+                session.value_changed_token = {};
             }
-
-            hr_characteristic_ = nullptr;
-        }
-        
-        if (device_) {
-            // Unsubscribe connection status
-            if (connection_status_token_.value != 0) {
+            if (session.device && session.connection_status_token.value != 0) {
                 try {
-                    device_.ConnectionStatusChanged(connection_status_token_);
+                    session.device.ConnectionStatusChanged(session.connection_status_token);
                 } catch(...) {}
-                connection_status_token_ = {};
+                session.connection_status_token = {};
             }
-            
-            device_.Close();
-            device_ = nullptr;
+            characteristic = std::exchange(session.hr_characteristic, nullptr);
+            device = std::exchange(session.device, nullptr);
+            if (!session.closed) PublishLinkState(session.stream_id, false);
         }
-    }
 
-    void SetHeartRateCallback(HeartRateCallback callback) override {
-        std::lock_guard<std::mutex> lock(mutex_);
-        hr_callback_ = callback;
-    }
-    
-    bool IsConnected() const override {
-        // Simple check
-        if (!device_) return false;
+        if (!characteristic) {
+            if (device) device.Close();
+            return;
+        }
         try {
-            return device_.ConnectionStatus() == BluetoothConnectionStatus::Connected;
-        } catch(...) {
-            return false;
+            auto op = characteristic.WriteClientCharacteristicConfigurationDescriptorAsync(GattClientCharacteristicConfigurationDescriptorValue::None);
+            op.Completed([device](auto const&, AsyncStatus) {
+                if (device) device.Close();
+            });
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::erase_if(pending_unsubscribes_, [](auto const& pending) { return pending.Status() != AsyncStatus::Started; });
+            pending_unsubscribes_.push_back(op);
+        } catch (...) {
+            // Ignore errors during disconnect
+            if (device) device.Close();
         }
     }
 
-private:
-    void OnValueChanged(GattCharacteristic const&, GattValueChangedEventArgs const& args) {
-        auto reader = DataReader::FromBuffer(args.CharacteristicValue());
-        reader.ByteOrder(ByteOrder::LittleEndian); // Important!
-        
-        if (reader.UnconsumedBufferLength() == 0) return;
-        
-        uint8_t flags = reader.ReadByte();
-        bool is_u16 = flags & 0x01;
-        
-        int hr = 0;
-        if (is_u16) {
-             if (reader.UnconsumedBufferLength() >= 2)
-                hr = reader.ReadUInt16();
-        } else {
-             if (reader.UnconsumedBufferLength() >= 1)
-                hr = reader.ReadByte();
+    // Gives outstanding unsubscribe writes one shared budget, then cancels
+    // them; cancelling still runs the completion handler that closes the device
+    void WaitForUnsubscribes(std::chrono::milliseconds budget) {
+        std::vector<IAsyncOperation<GattCommunicationStatus>> pending;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending.swap(pending_unsubscribes_);
         }
-        
-        // Debug output
-        // std::stringstream ss;
-        // ss << "HR: " << hr;
-        // OutputDebugStringA(ss.str().c_str());
+        auto deadline = std::chrono::steady_clock::now() + budget;
+        for (auto& op : pending) {
+            auto left = deadline - std::chrono::steady_clock::now();
+            if (left < std::chrono::steady_clock::duration::zero()) left = {};
+            try {
+                if (op.wait_for(std::chrono::duration_cast<TimeSpan>(left)) != AsyncStatus::Completed) {
+                    op.Cancel();
+                }
+            } catch (...) {}
+        }
+    }
 
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (hr_callback_) {
-            hr_callback_(hr);
+    // Runs on the session's reconnector thread
+    void AttemptReconnect(Session& session) {
+        bool expected = false;
+        if (!session.is_connecting.compare_exchange_strong(expected, true)) {
+            // The in-flight ConnectAsync reports the outcome
+            return;
+        }
+        blog(LOG_INFO, "Auto-reconnect: Attempting to connect to %llu...", session.address);
+        ConnectAsync(weak_from_this(), session.weak_from_this());
+    }
+
+    // The only place the link state is read from WinRT; requests see the
+    // copy published here
+    void OnConnectionStatusChanged(Session& session, BluetoothLEDevice const& sender) {
+        BluetoothConnectionStatus status;
+        try {
+            status = sender.ConnectionStatus();
+        } catch (...) {
+            return;
         }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (session.closed) return;
+            PublishLinkState(session.stream_id, status == BluetoothConnectionStatus::Connected);
+        }
+        if (status == BluetoothConnectionStatus::Disconnected) {
+            blog(LOG_INFO, "Device %llu reported disconnect", session.address);
+            session.reconnector->OnDisconnected();
+        }
+    }
+
+    void OnValueChanged(uint32_t stream_id, GattValueChangedEventArgs const& args) {
+        // Decode straight out of the notification buffer, no DataReader copy
+        auto buffer = args.CharacteristicValue();
+        PublishNotification(stream_id, { buffer.data(), buffer.Length() }, ToMonotonicNs(args.Timestamp()));
     }
 };
 
-std::shared_ptr<BleManager> BleManager::Create() {
+std::shared_ptr<BleManager> CreateWinRTBleManager() {
     return std::make_shared<BleManagerWinRT>();
 }
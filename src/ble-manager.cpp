@@ -0,0 +1,463 @@
+#include "ble-manager.hpp"
+#include "ble-backends.hpp"
+#include "hr-capture.hpp"
+#include "hr-advertisement.hpp"
+#include <obs-module.h>
+#include <util/platform.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// MIBAND_HR_BACKEND selects the backend at runtime:
+//   (unset)  the platform's radio backend (WinRT, or BlueZ on Linux)
+//   sim      synthetic devices, see SimBleOptions for the knobs
+//   replay   plays back the capture named by MIBAND_HR_REPLAY
+// MIBAND_HR_CAPTURE=<path> records raw notifications from any backend.
+static std::shared_ptr<BleManager> CreateBackend() {
+    const char* backend = getenv("MIBAND_HR_BACKEND");
+    if (backend && strcmp(backend, "sim") == 0) {
+        blog(LOG_INFO, "Using simulated BLE backend");
+        return CreateSimBleManager(SimBleOptionsFromEnv());
+    }
+    if (backend && strcmp(backend, "replay") == 0) {
+        const char* path = getenv("MIBAND_HR_REPLAY");
+        if (!path || !*path) {
+            blog(LOG_WARNING, "MIBAND_HR_BACKEND=replay needs MIBAND_HR_REPLAY=<capture file>");
+            return nullptr;
+        }
+        blog(LOG_INFO, "Using replay BLE backend: %s", path);
+        return CreateReplayBleManager(ReplayBleOptionsFromEnv(path));
+    }
+    if (backend && *backend) {
+        blog(LOG_WARNING, "Unknown BLE backend '%s', using the platform default", backend);
+    }
+
+#ifdef _WIN32
+    return CreateWinRTBleManager();
+#elif defined(HAVE_BLUEZ)
+    return CreateBlueZBleManager();
+#else
+    blog(LOG_WARNING, "No BLE radio backend on this platform; set MIBAND_HR_BACKEND=sim to simulate one");
+    return nullptr;
+#endif
+}
+
+std::shared_ptr<BleManager> BleManager::Create() {
+    auto manager = CreateBackend();
+    const char* capture = getenv("MIBAND_HR_CAPTURE");
+    if (manager && capture && *capture) {
+        manager->SetCaptureWriter(CaptureWriter::Open(capture));
+    }
+    return manager;
+}
+
+BleManager::BleManager() {
+    dispatch_thread_ = std::thread(&BleManager::DispatchLoop, this);
+}
+
+BleManager::~BleManager() {
+    // Backends have stopped their radio threads by now; whatever is still
+    // queued is dropped rather than delivered into a half-torn-down plugin
+    StopCallbacks();
+}
+
+void BleManager::StopCallbacks() {
+    std::call_once(dispatch_stop_once_, [this]() {
+        dispatch_stop_ = true;
+        dispatch_wake_.fetch_add(1, std::memory_order_release);
+        dispatch_wake_.notify_one();
+        WakeRoomWaiters();
+        if (dispatch_thread_.joinable()) dispatch_thread_.join();
+    });
+}
+
+void BleManager::SetHeartRateCallback(HeartRateCallback callback) {
+    auto shared = callback ? std::make_shared<const HeartRateCallback>(std::move(callback)) : nullptr;
+    std::lock_guard<std::mutex> lock(callback_mutex_);
+    hr_callback_ = std::move(shared);
+}
+
+void BleManager::SetLinkCallback(LinkCallback callback) {
+    auto shared = callback ? std::make_shared<const LinkCallback>(std::move(callback)) : nullptr;
+    std::lock_guard<std::mutex> lock(callback_mutex_);
+    link_callback_ = std::move(shared);
+}
+
+void BleManager::SetCaptureWriter(std::shared_ptr<CaptureWriter> writer) {
+    capture_.store(std::move(writer));
+}
+
+void BleManager::StartScan(ScanCallback callback) {
+    {
+        auto shared = callback ? std::make_shared<const ScanCallback>(std::move(callback)) : nullptr;
+        std::lock_guard<std::mutex> lock(callback_mutex_);
+        scan_callback_ = std::move(shared);
+    }
+    StartScanning();
+}
+
+void BleManager::StopScan() {
+    StopScanning();
+}
+
+uint32_t BleManager::Connect(const std::string& device_id, IngestMode mode) {
+    if (device_id.empty()) return kInvalidStream;
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    uint32_t stream_id = kInvalidStream;
+    for (uint32_t i = 0; i < kMaxStreams; ++i) {
+        if (stream_devices_[i] == device_id) {
+            // Same band again: restart it, e.g. to switch ingest mode
+            EndSession(i);
+            stream_id = i;
+            break;
+        }
+        if (stream_id == kInvalidStream && stream_devices_[i].empty()) stream_id = i;
+    }
+    if (stream_id == kInvalidStream) {
+        blog(LOG_WARNING, "Cannot connect %s: all %u streams are in use", device_id.c_str(), kMaxStreams);
+        return kInvalidStream;
+    }
+
+    last_advertisement_ns_[stream_id] = 0;
+    ResetSnapshot(stream_id, mode);
+    if (!OpenSession(stream_id, device_id, mode)) {
+        ResetSnapshot(stream_id, IngestMode::Gatt);
+        stream_devices_[stream_id].clear();
+        streams_version_.fetch_add(1, std::memory_order_release);
+        return kInvalidStream;
+    }
+    stream_devices_[stream_id] = device_id;
+    stream_modes_[stream_id] = mode;
+    streams_version_.fetch_add(1, std::memory_order_release);
+    blog(LOG_INFO, "Stream %u: %s (%s)", stream_id, device_id.c_str(),
+         mode == IngestMode::Advertisement ? "advertisement" : "gatt");
+    return stream_id;
+}
+
+void BleManager::Disconnect(const std::string& device_id) {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    for (uint32_t i = 0; i < kMaxStreams; ++i) {
+        if (stream_devices_[i] == device_id) {
+            EndSession(i);
+            stream_devices_[i].clear();
+            streams_version_.fetch_add(1, std::memory_order_release);
+            return;
+        }
+    }
+}
+
+void BleManager::DisconnectAll() {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    for (uint32_t i = 0; i < kMaxStreams; ++i) {
+        if (stream_devices_[i].empty()) continue;
+        EndSession(i);
+        stream_devices_[i].clear();
+        streams_version_.fetch_add(1, std::memory_order_release);
+    }
+}
+
+bool BleManager::IsConnected(uint32_t stream_id) const {
+    if (stream_id >= kMaxStreams) return false;
+    const SnapshotSlot& slot = snapshots_[stream_id];
+    if (slot.link_up.load(std::memory_order_relaxed)) return true;
+    return slot.passive.load(std::memory_order_relaxed) && AdvertisementsFresh(stream_id);
+}
+
+StreamSnapshot BleManager::GetSnapshot(uint32_t stream_id) const {
+    StreamSnapshot snapshot;
+    if (stream_id >= kMaxStreams) return snapshot;
+    const SnapshotSlot& slot = snapshots_[stream_id];
+    bool passive;
+    for (;;) {
+        uint32_t version = slot.version.load(std::memory_order_acquire);
+        if (version & 1) continue;  // a writer is mid-update; it holds no lock we need
+        snapshot.session = slot.session.load(std::memory_order_relaxed);
+        snapshot.connected = slot.link_up.load(std::memory_order_relaxed);
+        passive = slot.passive.load(std::memory_order_relaxed);
+        snapshot.bpm = slot.bpm.load(std::memory_order_relaxed);
+        snapshot.seq = slot.seq.load(std::memory_order_relaxed);
+        snapshot.receive_timestamp_ns = slot.receive_timestamp_ns.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.version.load(std::memory_order_relaxed) == version) break;
+    }
+    if (!snapshot.connected && passive) snapshot.connected = AdvertisementsFresh(stream_id);
+    return snapshot;
+}
+
+template <typename F>
+void BleManager::WriteSnapshot(uint32_t stream_id, F&& write) {
+    SnapshotSlot& slot = snapshots_[stream_id];
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    uint32_t version = slot.version.load(std::memory_order_relaxed);
+    slot.version.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    write(slot);
+    slot.version.store(version + 2, std::memory_order_release);
+}
+
+void BleManager::ResetSnapshot(uint32_t stream_id, IngestMode mode) {
+    WriteSnapshot(stream_id, [mode](SnapshotSlot& slot) {
+        slot.session.store(slot.session.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        slot.link_up.store(false, std::memory_order_relaxed);
+        slot.passive.store(mode == IngestMode::Advertisement, std::memory_order_relaxed);
+        slot.bpm.store(0, std::memory_order_relaxed);
+        slot.seq.store(0, std::memory_order_relaxed);
+        slot.receive_timestamp_ns.store(0, std::memory_order_relaxed);
+    });
+    // A producer waiting for room on the old session gives up
+    WakeRoomWaiters();
+}
+
+void BleManager::EndSession(uint32_t stream_id) {
+    ResetSnapshot(stream_id, IngestMode::Gatt);
+    CloseSession(stream_id);
+    ResetSnapshot(stream_id, IngestMode::Gatt);
+}
+
+void BleManager::PublishLinkState(uint32_t stream_id, bool connected) {
+    if (stream_id >= kMaxStreams) return;
+    WriteSnapshot(stream_id, [connected](SnapshotSlot& slot) {
+        slot.link_up.store(connected, std::memory_order_relaxed);
+    });
+
+    Event event;
+    event.kind = Event::Kind::Link;
+    event.stream_id = stream_id;
+    event.session = CurrentSession(stream_id);
+    event.receive_timestamp_ns = os_gettime_ns();
+    event.connected = connected;
+    Enqueue(event);
+}
+
+ReconnectStats BleManager::GetReconnectStats(uint32_t stream_id) const {
+    if (stream_id >= kMaxStreams) return {};
+    return SessionReconnectStats(stream_id);
+}
+
+std::vector<StreamInfo> BleManager::GetStreams() const {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    std::vector<StreamInfo> streams;
+    for (uint32_t i = 0; i < kMaxStreams; ++i) {
+        if (!stream_devices_[i].empty()) streams.push_back({ i, stream_devices_[i], stream_modes_[i] });
+    }
+    return streams;
+}
+
+uint32_t BleManager::FindStream(const std::string& device_id) const {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    for (uint32_t i = 0; i < kMaxStreams; ++i) {
+        if (stream_devices_[i] == device_id) return i;
+    }
+    return kInvalidStream;
+}
+
+bool BleManager::PublishNotification(uint32_t stream_id, std::span<const uint8_t> payload,
+                                     uint64_t notify_timestamp_ns, QueueFull full) {
+    if (stream_id >= kMaxStreams) return false;
+    Event event;
+    event.kind = Event::Kind::Notification;
+    event.stream_id = stream_id;
+    event.session = CurrentSession(stream_id);
+    event.notify_timestamp_ns = notify_timestamp_ns;
+    event.receive_timestamp_ns = os_gettime_ns();
+    // Recorded whole and before the queue can drop it, malformed or not;
+    // those are the interesting ones
+    if (std::shared_ptr<CaptureWriter> capture = capture_.load()) {
+        capture->Write(stream_id, notify_timestamp_ns ? notify_timestamp_ns : event.receive_timestamp_ns, payload);
+    }
+    event.payload_size = (uint16_t)std::min(payload.size(), Event::kMaxPayload);
+    memcpy(event.payload, payload.data(), event.payload_size);
+    return Enqueue(event, full);
+}
+
+// Bands broadcast every few hundred ms; a few seconds of silence means the
+// band is out of range or stopped broadcasting
+static const uint64_t ADVERTISEMENT_STALE_NS = 5000000000ull;
+
+bool BleManager::PublishAdvertisement(uint32_t stream_id, std::span<const uint8_t> ad_structures,
+                                      uint64_t notify_timestamp_ns, QueueFull full) {
+    HeartRateMeasurement measurement;
+    if (stream_id >= kMaxStreams || !DecodeAdvertisementHeartRate(ad_structures, measurement)) return false;
+
+    uint64_t now = os_gettime_ns();
+    last_advertisement_ns_[stream_id] = now;
+    PublishMeasurement(stream_id, measurement, now, notify_timestamp_ns, full);
+    return true;
+}
+
+bool BleManager::AdvertisementsFresh(uint32_t stream_id) const {
+    uint64_t last = last_advertisement_ns_[stream_id];
+    return last != 0 && os_gettime_ns() - last < ADVERTISEMENT_STALE_NS;
+}
+
+void BleManager::PublishMeasurement(uint32_t stream_id, const HeartRateMeasurement& measurement,
+                                    uint64_t receive_timestamp_ns, uint64_t notify_timestamp_ns, QueueFull full) {
+    Event event;
+    event.kind = Event::Kind::Measurement;
+    event.stream_id = stream_id;
+    event.session = CurrentSession(stream_id);
+    event.notify_timestamp_ns = notify_timestamp_ns;
+    event.receive_timestamp_ns = receive_timestamp_ns;
+    event.measurement = measurement;
+    Enqueue(event, full);
+}
+
+void BleManager::PublishDevice(const BleDevice& device) {
+    Event event;
+    event.kind = Event::Kind::Device;
+    event.receive_timestamp_ns = os_gettime_ns();
+    event.address = device.bluetooth_address;
+
+    // Clip long names on a UTF-8 character boundary
+    size_t size = std::min(device.name.size(), Event::kMaxName - 1);
+    if (size < device.name.size()) {
+        while (size > 0 && ((uint8_t)device.name[size] & 0xC0) == 0x80) --size;
+    }
+    memcpy(event.name, device.name.data(), size);
+    event.name[size] = 0;
+    Enqueue(event);
+}
+
+bool BleManager::Enqueue(const Event& event, QueueFull full) {
+    while (!events_.TryPush(event)) {
+        // The consumer is behind or wedged in a slow callback. Dropping keeps
+        // a radio thread moving and the counter makes it visible.
+        if (full == QueueFull::Drop || !WaitForRoom(event)) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+    dispatch_wake_.fetch_add(1, std::memory_order_release);
+    dispatch_wake_.notify_one();
+    return true;
+}
+
+bool BleManager::WaitForRoom(const Event& event) {
+    // Registered before looking, and the waker fences before checking for
+    // waiters, so a pop, reset or stop after this point always wakes us
+    room_waiters_.fetch_add(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint32_t room = room_.load(std::memory_order_acquire);
+    bool live = !dispatch_stop_ && (event.kind == Event::Kind::Device || event.session == CurrentSession(event.stream_id));
+    if (live && events_.Depth() >= events_.capacity()) room_.wait(room, std::memory_order_acquire);
+    room_waiters_.fetch_sub(1, std::memory_order_relaxed);
+    return live;
+}
+
+void BleManager::WakeRoomWaiters() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (room_waiters_.load(std::memory_order_relaxed) == 0) return;
+    room_.fetch_add(1, std::memory_order_release);
+    room_.notify_all();
+}
+
+static void RaiseMax(std::atomic<uint64_t>& max, uint64_t value) {
+    uint64_t current = max.load(std::memory_order_relaxed);
+    while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+}
+
+void BleManager::DispatchLoop() {
+    Event event;
+    for (;;) {
+        uint32_t wake = dispatch_wake_.load(std::memory_order_acquire);
+        if (dispatch_stop_) break;
+
+        // Callbacks are picked up once per batch, outside the lock, so a
+        // callback may call back into the manager
+        std::shared_ptr<const HeartRateCallback> hr_callback;
+        std::shared_ptr<const ScanCallback> scan_callback;
+        std::shared_ptr<const LinkCallback> link_callback;
+        {
+            std::lock_guard<std::mutex> lock(callback_mutex_);
+            hr_callback = hr_callback_;
+            scan_callback = scan_callback_;
+            link_callback = link_callback_;
+        }
+
+        for (;;) {
+            // Sampled before each pop so a backlog shows up while it lasts
+            uint32_t depth = (uint32_t)events_.Depth();
+            if (depth > max_depth_.load(std::memory_order_relaxed)) max_depth_.store(depth, std::memory_order_relaxed);
+            if (dispatch_stop_ || !events_.TryPop(event)) break;
+            WakeRoomWaiters();
+
+            uint64_t start = os_gettime_ns();
+            uint64_t latency = start > event.receive_timestamp_ns ? start - event.receive_timestamp_ns : 0;
+
+            switch (event.kind) {
+            case Event::Kind::Notification: {
+                std::span<const uint8_t> payload(event.payload, event.payload_size);
+                if (!DecodeHeartRateMeasurement(payload, event.measurement)) break;
+                [[fallthrough]];
+            }
+            case Event::Kind::Measurement: {
+                HeartRateSample sample;
+                sample.stream_id = event.stream_id;
+                sample.session = event.session;
+                sample.notify_timestamp_ns = event.notify_timestamp_ns;
+                sample.receive_timestamp_ns = event.receive_timestamp_ns;
+                sample.measurement = event.measurement;
+                // Before the callback, so whatever it wakes sees this sample.
+                // The session is compared under the snapshot lock: once a
+                // reset has moved it, nothing older lands in the slot.
+                bool current = false;
+                WriteSnapshot(sample.stream_id, [&](SnapshotSlot& slot) {
+                    if (slot.session.load(std::memory_order_relaxed) != sample.session) return;
+                    current = true;
+                    sample.seq = next_seq_++;
+                    slot.bpm.store(sample.measurement.bpm, std::memory_order_relaxed);
+                    slot.seq.store(sample.seq, std::memory_order_relaxed);
+                    slot.receive_timestamp_ns.store(sample.receive_timestamp_ns, std::memory_order_relaxed);
+                });
+                if (!current) {
+                    stale_.fetch_add(1, std::memory_order_relaxed);
+                    break;
+                }
+                if (hr_callback) (*hr_callback)(sample);
+                break;
+            }
+            case Event::Kind::Device: {
+                if (!scan_callback) break;
+                BleDevice dev;
+                dev.bluetooth_address = event.address;
+                dev.id = std::to_string(event.address);
+                dev.name = event.name;
+                (*scan_callback)(dev);
+                break;
+            }
+            case Event::Kind::Link:
+                if (event.session != CurrentSession(event.stream_id)) {
+                    stale_.fetch_add(1, std::memory_order_relaxed);
+                    break;
+                }
+                if (link_callback) (*link_callback)(event.stream_id, event.connected);
+                break;
+            }
+
+            uint64_t end = os_gettime_ns();
+            delivered_.fetch_add(1, std::memory_order_relaxed);
+            total_latency_ns_.fetch_add(latency, std::memory_order_relaxed);
+            RaiseMax(max_latency_ns_, latency);
+            RaiseMax(max_callback_ns_, end - start);
+        }
+        if (dispatch_stop_) break;
+
+        // A push after the load above bumps the counter, so this can't sleep
+        // through it
+        dispatch_wake_.wait(wake, std::memory_order_acquire);
+    }
+}
+
+DispatchStats BleManager::GetDispatchStats() const {
+    DispatchStats stats;
+    stats.delivered = delivered_.load(std::memory_order_relaxed);
+    stats.dropped = dropped_.load(std::memory_order_relaxed);
+    stats.stale = stale_.load(std::memory_order_relaxed);
+    stats.depth = (uint32_t)events_.Depth();
+    stats.max_depth = max_depth_.load(std::memory_order_relaxed);
+    stats.capacity = (uint32_t)events_.capacity();
+    stats.avg_latency_ns = stats.delivered ? total_latency_ns_.load(std::memory_order_relaxed) / stats.delivered : 0;
+    stats.max_latency_ns = max_latency_ns_.load(std::memory_order_relaxed);
+    stats.max_callback_ns = max_callback_ns_.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -1,8 +1,17 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <atomic>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include "event-queue.hpp"
+#include "hr-measurement.hpp"
+#include "reconnector.hpp"
+
+class CaptureWriter;
 
 struct BleDevice {
     std::string id;
@@ -10,19 +19,241 @@ struct BleDevice {
     uint64_t bluetooth_address;
 };
 
-using HeartRateCallback = std::function<void(int heart_rate)>;
+// Several bands can be connected at once. Each session gets a small stream
+// id that indexes fixed-size arrays, so routing a sample costs the same
+// whether one band or kMaxStreams are live.
+constexpr uint32_t kMaxStreams = 8;
+constexpr uint32_t kInvalidStream = UINT32_MAX;
+
+// One heart rate notification as it leaves the BLE layer. Both timestamps
+// are in the os_gettime_ns() monotonic domain so they can be subtracted.
+struct HeartRateSample {
+    uint64_t seq = 0;                   // per manager, +1 for every notification
+    uint32_t stream_id = 0;             // session that produced it, < kMaxStreams
+    uint32_t session = 0;               // StreamSnapshot::session it was published under
+    uint64_t notify_timestamp_ns = 0;   // when the BLE stack stamped it, 0 if unknown
+    uint64_t receive_timestamp_ns = 0;  // when our handler saw it
+    HeartRateMeasurement measurement;
+};
+
+// How Connect() obtains heart rate: a GATT subscription to 0x2A37, or
+// decoding the target's advertisements without ever connecting
+enum class IngestMode {
+    Gatt,
+    Advertisement,
+};
+
+// A stream's link state together with its newest sample, copied as one
+// consistent tuple. Backends report link changes as they happen, so reading
+// this never touches the radio stack.
+struct StreamSnapshot {
+    uint32_t session = 0;               // moves whenever a session starts or ends on the stream
+    bool connected = false;
+    uint16_t bpm = 0;
+    uint64_t seq = 0;                   // HeartRateSample::seq of the newest sample, 0 = none yet
+    uint64_t receive_timestamp_ns = 0;
+};
+
+struct StreamInfo {
+    uint32_t stream_id;
+    std::string device_id;
+    IngestMode mode;
+};
+
+// Event dispatcher counters. Latency runs from the moment a backend handed
+// an event over to the moment its callback started.
+struct DispatchStats {
+    uint64_t delivered = 0;
+    uint64_t dropped = 0;           // queue was full; the event was discarded
+    uint64_t stale = 0;             // from a session that ended while it was queued; discarded
+    uint32_t depth = 0;             // events waiting right now
+    uint32_t max_depth = 0;
+    uint32_t capacity = 0;
+    uint64_t avg_latency_ns = 0;
+    uint64_t max_latency_ns = 0;
+    uint64_t max_callback_ns = 0;   // slowest single callback
+};
+
+using HeartRateCallback = std::function<void(const HeartRateSample& sample)>;
 using ScanCallback = std::function<void(const BleDevice& device)>;
+using LinkCallback = std::function<void(uint32_t stream_id, bool connected)>;
 
 class BleManager {
 public:
-    virtual ~BleManager() = default;
-    
-    virtual void StartScan(ScanCallback callback) = 0;
-    virtual void StopScan() = 0;
-    virtual void Connect(const std::string& device_id) = 0;
-    virtual void Disconnect() = 0;
-    virtual void SetHeartRateCallback(HeartRateCallback callback) = 0;
-    virtual bool IsConnected() const = 0;
-    
+    BleManager();
+    virtual ~BleManager();
+
+    // Callbacks (scan, heart rate and link alike) run on one dispatcher thread,
+    // never on a radio thread and never with backend locks held
+    void StartScan(ScanCallback callback);
+    void StopScan();
+
+    // Adds a session for the device alongside any existing ones and
+    // returns its stream id, or kInvalidStream if the id is unknown or all
+    // streams are taken. Connecting a device again restarts its session.
+    uint32_t Connect(const std::string& device_id, IngestMode mode = IngestMode::Gatt);
+    void Disconnect(const std::string& device_id);
+    void DisconnectAll();
+
+    // Lock-free, from any thread
+    bool IsConnected(uint32_t stream_id) const;
+    StreamSnapshot GetSnapshot(uint32_t stream_id) const;
+    ReconnectStats GetReconnectStats(uint32_t stream_id) const;
+    std::vector<StreamInfo> GetStreams() const;
+    uint32_t FindStream(const std::string& device_id) const;
+    // Moves whenever the stream table changes, so a caller can keep its own
+    // copy of GetStreams() and only take the lock again when it is stale
+    uint64_t StreamsVersion() const { return streams_version_.load(std::memory_order_acquire); }
+
+    void SetHeartRateCallback(HeartRateCallback callback);
+    // Every link change a backend reports, in order with the samples
+    void SetLinkCallback(LinkCallback callback);
+    // Logs every raw notification payload as the backend delivers it, on
+    // the backend's thread; nullptr stops
+    void SetCaptureWriter(std::shared_ptr<CaptureWriter> writer);
+    // Stops the dispatcher: once this returns no callback is running or will
+    // run again, and events still queued or published later are dropped.
+    // For teardown, before the state the callbacks touch goes away. Never
+    // from a callback.
+    void StopCallbacks();
+    DispatchStats GetDispatchStats() const;
+
     static std::shared_ptr<BleManager> Create();
+
+protected:
+    // Backend half of StartScan / StopScan; report devices with PublishDevice
+    virtual void StartScanning() = 0;
+    virtual void StopScanning() = 0;
+
+    // Backend half of Connect / Disconnect. Calls for one stream are
+    // serialised; each session keeps its own link and reconnect state.
+    // OpenSession returns false if the device id isn't usable.
+    virtual bool OpenSession(uint32_t stream_id, const std::string& device_id, IngestMode mode) = 0;
+    virtual void CloseSession(uint32_t stream_id) = 0;
+    virtual ReconnectStats SessionReconnectStats(uint32_t) const { return {}; }
+
+    // What a publish does when the dispatch queue is full. A radio thread
+    // must never stall, so it drops the event and counts it. A producer
+    // that sets its own pace (replay, the simulator) waits for room, so a
+    // run as fast as the dispatcher goes loses nothing; it gives up and
+    // drops only once its session ends or the dispatcher stops. Never
+    // wait from a callback.
+    enum class QueueFull { Drop, Wait };
+
+    // Backends report every link change of a session as it happens. Once
+    // CloseSession has returned, nothing more may be reported for it.
+    // Advertisement sessions also count as connected while broadcasts arrive.
+    void PublishLinkState(uint32_t stream_id, bool connected);
+    // Decodes a raw 0x2A37 payload, stamps it and hands it to the callback.
+    // Backends call this from their notification handler. Returns false if
+    // the event was dropped.
+    bool PublishNotification(uint32_t stream_id, std::span<const uint8_t> payload, uint64_t notify_timestamp_ns,
+                             QueueFull full = QueueFull::Drop);
+    // Decodes a raw AD structure stream from a session's band and
+    // publishes it if it carries a heart rate. Returns whether it did.
+    bool PublishAdvertisement(uint32_t stream_id, std::span<const uint8_t> ad_structures, uint64_t notify_timestamp_ns,
+                              QueueFull full = QueueFull::Drop);
+    // Advertisement mode has no link; call it alive while broadcasts arrive
+    bool AdvertisementsFresh(uint32_t stream_id) const;
+    // Hands a scan result to the scan callback
+    void PublishDevice(const BleDevice& device);
+
+private:
+    // Fixed-size so a radio thread only ever copies bytes into the queue.
+    // Notifications travel raw and are decoded by the dispatcher; a
+    // full-MTU payload is clipped to kMaxPayload, which still holds every
+    // field plus kMaxRrIntervals intervals. Captures are written before
+    // the queue, so they keep the whole payload and what the queue drops.
+    struct Event {
+        static constexpr size_t kMaxPayload = 5 + 2 * kMaxRrIntervals;
+        static constexpr size_t kMaxName = 64;
+
+        enum class Kind : uint8_t { Notification, Measurement, Device, Link };
+        Kind kind = Kind::Notification;
+        uint32_t stream_id = 0;
+        uint32_t session = 0;                // the stream's session when it was published
+        uint64_t notify_timestamp_ns = 0;
+        uint64_t receive_timestamp_ns = 0;   // also the enqueue time
+        // Notification
+        uint16_t payload_size = 0;
+        uint8_t payload[kMaxPayload] = {};
+        // Measurement
+        HeartRateMeasurement measurement;
+        // Device
+        uint64_t address = 0;
+        char name[kMaxName] = {};
+        // Link
+        bool connected = false;
+    };
+
+    // One seqlock per stream. Writers (the dispatcher for samples, backends
+    // for link changes) serialise on snapshot_mutex_; readers retry while
+    // version is odd or moved. Fields are atomics so a torn copy is only
+    // ever discarded, never a data race. session is the slot's generation:
+    // events carry the one they were published under, and the dispatcher
+    // drops those from a session that has since ended.
+    struct alignas(64) SnapshotSlot {
+        std::atomic<uint32_t> version{0};
+        std::atomic<uint32_t> session{0};
+        std::atomic<bool> link_up{false};
+        std::atomic<bool> passive{false};
+        std::atomic<uint16_t> bpm{0};
+        std::atomic<uint64_t> seq{0};
+        std::atomic<uint64_t> receive_timestamp_ns{0};
+    };
+
+    void PublishMeasurement(uint32_t stream_id, const HeartRateMeasurement& measurement,
+                            uint64_t receive_timestamp_ns, uint64_t notify_timestamp_ns, QueueFull full);
+    template <typename F>
+    void WriteSnapshot(uint32_t stream_id, F&& write);
+    // A session starts or ends: a new generation, down, no sample yet
+    void ResetSnapshot(uint32_t stream_id, IngestMode mode);
+    // CloseSession between two resets, so neither what was queued before
+    // nor what the backend reports while closing reaches the next session
+    void EndSession(uint32_t stream_id);
+    uint32_t CurrentSession(uint32_t stream_id) const {
+        return snapshots_[stream_id].session.load(std::memory_order_acquire);
+    }
+    bool Enqueue(const Event& event, QueueFull full = QueueFull::Drop);
+    // After a failed push: blocks until the dispatcher pops something.
+    // False, without blocking, once the event can never be delivered.
+    bool WaitForRoom(const Event& event);
+    // Lets waiting producers look again: after a pop, a reset, a stop
+    void WakeRoomWaiters();
+    void DispatchLoop();
+
+    mutable std::mutex callback_mutex_;
+    std::shared_ptr<const HeartRateCallback> hr_callback_;
+    std::shared_ptr<const ScanCallback> scan_callback_;
+    std::shared_ptr<const LinkCallback> link_callback_;
+    std::atomic<std::shared_ptr<CaptureWriter>> capture_;  // read on radio threads
+
+    EventQueue<Event, 1024> events_;
+    std::atomic<uint32_t> dispatch_wake_{0};
+    std::atomic<bool> dispatch_stop_{false};
+    std::atomic<uint32_t> room_{0};          // bumped when waiting producers should retry
+    std::atomic<uint32_t> room_waiters_{0};
+    std::once_flag dispatch_stop_once_;
+    uint64_t next_seq_ = 1;  // dispatcher thread only
+    std::atomic<uint64_t> delivered_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> stale_{0};
+    std::atomic<uint32_t> max_depth_{0};
+    std::atomic<uint64_t> total_latency_ns_{0};
+    std::atomic<uint64_t> max_latency_ns_{0};
+    std::atomic<uint64_t> max_callback_ns_{0};
+
+    // Stream table; sessions_mutex_ is held across OpenSession/CloseSession
+    // but never on the sample path
+    mutable std::mutex sessions_mutex_;
+    std::string stream_devices_[kMaxStreams];  // empty = free
+    IngestMode stream_modes_[kMaxStreams] = {};
+    std::atomic<uint64_t> streams_version_{0};  // bumped under sessions_mutex_
+    std::atomic<uint64_t> last_advertisement_ns_[kMaxStreams] = {};
+
+    std::mutex snapshot_mutex_;
+    SnapshotSlot snapshots_[kMaxStreams];
+
+    // Last member: started once everything it touches exists
+    std::thread dispatch_thread_;
 };
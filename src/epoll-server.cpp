@@ -0,0 +1,407 @@
+#include "epoll-server.hpp"
+#include <obs-module.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+// A client sending more than this without completing a request is dropped
+static const size_t MAX_HEAD_SIZE = 16 * 1024;
+// Bodies are buffered whole, so httplib's payload limit (unbounded by
+// default) is capped; larger ones are answered with 413
+static const size_t MAX_BODY_SIZE = 1024 * 1024;
+// A stream whose client stops reading is dropped past this much unsent output
+static const size_t MAX_PENDING_OUTPUT = 256 * 1024;
+static const auto TICK = std::chrono::seconds(1);
+
+static void set_nonblocking(int fd, bool nonblocking) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, nonblocking ? flags | O_NONBLOCK : flags & ~O_NONBLOCK);
+}
+
+// Case-insensitive lookup of one header in a raw request head
+static bool find_header(std::string_view head, std::string_view name, std::string_view& value) {
+    for (size_t pos = head.find("\r\n"); pos != std::string_view::npos && pos + 2 < head.size();) {
+        size_t start = pos + 2;
+        size_t end = head.find("\r\n", start);
+        if (end == std::string_view::npos) end = head.size();
+        std::string_view line = head.substr(start, end - start);
+        if (line.size() > name.size() && line[name.size()] == ':' &&
+            strncasecmp(line.data(), name.data(), name.size()) == 0) {
+            value = line.substr(name.size() + 1);
+            while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+            while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.remove_suffix(1);
+            return true;
+        }
+        pos = end;
+    }
+    return false;
+}
+
+EpollServer::EpollServer() {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+EpollServer::~EpollServer() {
+    for (auto& [ptr, c] : connections_) close(c->fd);
+    ReapUpgrades(true);
+    if (wake_fd_ >= 0) close(wake_fd_);
+    if (epoll_fd_ >= 0) close(epoll_fd_);
+}
+
+void EpollServer::Wake() {
+    uint64_t one = 1;
+    if (write(wake_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        blog(LOG_WARNING, "Failed to wake the HTTP event loop");
+    }
+}
+
+void EpollServer::Stop() {
+    stopping_ = true;
+    Wake();
+}
+
+bool EpollServer::Listen() {
+    int listen_fd = svr_sock_;
+    if (epoll_fd_ < 0 || wake_fd_ < 0 || listen_fd == INVALID_SOCKET) return false;
+    set_nonblocking(listen_fd, true);
+    // httplib's backlog of 5 suits a thread pool; a burst of subscribers
+    // would overflow it here and wait out SYN retransmits
+    ::listen(listen_fd, SOMAXCONN);
+
+    // data.ptr tells the fds apart: null is the listener, &wake_fd_ the
+    // wake-up counter, anything else a Connection
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd, &ev);
+    ev.data.ptr = &wake_fd_;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+
+    auto next_tick = std::chrono::steady_clock::now() + TICK;
+    epoll_event events[256];
+    while (!stopping_) {
+        auto now = std::chrono::steady_clock::now();
+        int timeout_ms = (int)std::chrono::ceil<std::chrono::milliseconds>(next_tick - now).count();
+        int n = epoll_wait(epoll_fd_, events, 256, std::max(timeout_ms, 0));
+        if (n < 0 && errno != EINTR) {
+            blog(LOG_ERROR, "epoll_wait failed: %s", strerror(errno));
+            break;
+        }
+
+        bool woken = false;
+        for (int i = 0; i < n; ++i) {
+            void* ptr = events[i].data.ptr;
+            if (ptr == nullptr) {
+                Accept(listen_fd);
+                continue;
+            }
+            if (ptr == &wake_fd_) {
+                uint64_t count;
+                while (read(wake_fd_, &count, sizeof(count)) > 0) {}
+                woken = true;
+                continue;
+            }
+            auto& c = *static_cast<Connection*>(ptr);
+            if (c.fd < 0) continue;  // closed earlier in this batch
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR | EPOLLRDHUP)) OnReadable(c);
+            if (c.fd >= 0 && (events[i].events & EPOLLOUT)) OnWritable(c);
+        }
+
+        // Every open stream gets polled after a wake and once per tick, so
+        // heartbeats and long-poll deadlines need no timers of their own
+        now = std::chrono::steady_clock::now();
+        bool tick = now >= next_tick;
+        if (woken || tick) PollStreams();
+        if (tick) {
+            ExpireIdle(now);
+            ReapUpgrades(false);
+            next_tick = now + TICK;
+        }
+        closed_.clear();
+    }
+
+    // Streams first get a last poll, which ends them now that the plugin is closing
+    PollStreams();
+    while (!connections_.empty()) Close(*connections_.begin()->second);
+    closed_.clear();
+
+    socket_t sock = svr_sock_.exchange(INVALID_SOCKET);
+    if (sock != INVALID_SOCKET) {
+        httplib::detail::shutdown_socket(sock);
+        httplib::detail::close_socket(sock);
+    }
+    ReapUpgrades(true);
+    return true;
+}
+
+void EpollServer::Accept(int listen_fd) {
+    for (;;) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EMFILE || errno == ENFILE) {
+                blog(LOG_WARNING, "HTTP event loop is out of file descriptors (%zu connections)",
+                     connections_.size());
+            }
+            return;
+        }
+        // Events are small and latency matters more than segment count
+        int nodelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        auto c = std::make_unique<Connection>();
+        c->fd = fd;
+        c->last_active = std::chrono::steady_clock::now();
+        epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = c.get();
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            continue;
+        }
+        connections_.emplace(c.get(), std::move(c));
+        ++connection_count_;
+    }
+}
+
+size_t EpollServer::MaxBodySize() const {
+    return std::min(payload_max_length_, MAX_BODY_SIZE);
+}
+
+void EpollServer::OnReadable(Connection& c) {
+    char buf[16 * 1024];
+    size_t max_input = MAX_HEAD_SIZE + MaxBodySize();
+    for (;;) {
+        ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+        if (n > 0) {
+            // Whatever follows a final response (411, 413) is discarded
+            if (!c.close_after_write) c.in.append(buf, (size_t)n);
+            c.last_active = std::chrono::steady_clock::now();
+            // Answer what is buffered before reading on; an oversized body gets its 413
+            if (c.in.size() > max_input || (size_t)n < sizeof(buf)) break;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        // Peer closed or reset; nothing more can be answered
+        Close(c);
+        return;
+    }
+    ServeRequests(c);
+    // Still over the limit: pipelined behind an open stream, or a head that never ends
+    if (c.fd >= 0 && c.in.size() > max_input) Close(c);
+}
+
+void EpollServer::OnWritable(Connection& c) {
+    Flush(c);
+    // A stream isn't polled while output is pending; catch up now
+    if (c.fd >= 0 && c.poll && c.out_pos == c.out.size()) PollStream(c);
+}
+
+// Answers the complete requests at the front of c.in, in order. Stops at
+// an open stream: what the client pipelined behind it waits until it ends.
+void EpollServer::ServeRequests(Connection& c) {
+    while (c.fd >= 0 && !c.poll && !c.close_after_write) {
+        size_t head_end = c.in.find("\r\n\r\n");
+        if (head_end == std::string::npos) {
+            if (c.in.size() > MAX_HEAD_SIZE) Close(c);
+            break;
+        }
+        size_t head_length = head_end + 4;
+        std::string_view head(c.in.data(), head_length);
+
+        bool need_more;
+        if (const Handler* handler = FindUpgrade(head, need_more)) {
+            HandOffUpgrade(c, *handler, head_length);
+            return;
+        }
+
+        std::string_view value;
+        size_t body_length = 0;
+        if (find_header(head, "Transfer-Encoding", value)) {
+            // Nothing here takes chunked uploads
+            c.out += "HTTP/1.1 411 Length Required\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+            c.close_after_write = true;
+            c.in.clear();
+            break;
+        }
+        if (find_header(head, "Content-Length", value)) {
+            body_length = strtoull(std::string(value).c_str(), nullptr, 10);
+            if (body_length > MaxBodySize()) {
+                c.out += "HTTP/1.1 413 Payload Too Large\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+                c.close_after_write = true;
+                c.in.clear();
+                break;
+            }
+        }
+        if (c.in.size() < head_length + body_length) break;
+
+        size_t head_start = c.out.size();
+        bool close_connection = ++c.requests >= keep_alive_max_count_;
+        bool connection_closed = false;
+        StreamPoll poll;
+        bool ok = ServeBuffered(c.fd, std::string_view(c.in.data(), head_length + body_length), c.out,
+                                close_connection, connection_closed, poll);
+        c.in.erase(0, head_length + body_length);
+
+        // httplib says so in the response when it won't keep the connection
+        std::string_view response(c.out.data() + head_start, c.out.size() - head_start);
+        std::string_view response_head = response.substr(0, response.find("\r\n\r\n"));
+        if (!ok || connection_closed || close_connection ||
+            response_head.find("\r\nConnection: close") != std::string_view::npos) {
+            c.close_after_write = true;
+        }
+        if (poll) {
+            c.poll = std::move(poll);
+            PollStream(c);
+            return;
+        }
+    }
+    if (c.fd >= 0) Flush(c);
+}
+
+// WebSocket handlers block, so the connection leaves the loop for a thread
+void EpollServer::HandOffUpgrade(Connection& c, const Handler& handler, size_t head_length) {
+    int fd = c.fd;
+    std::string head = c.in.substr(0, head_length);
+    // A client may not send frames before our 101
+    bool early_data = c.in.size() > head_length;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    c.fd = -1;
+    Close(c);
+    if (early_data) {
+        close(fd);
+        return;
+    }
+    set_nonblocking(fd, false);
+
+    auto done = std::make_shared<std::atomic<bool>>(false);
+    std::thread thread([this, fd, &handler, head = std::move(head), done]() {
+        httplib::Request req;
+        if (AcceptUpgrade(fd, head, req)) RunUpgrade(fd, handler, req);
+        httplib::detail::shutdown_socket(fd);
+        httplib::detail::close_socket(fd);
+        *done = true;
+    });
+    upgrade_threads_.push_back({ std::move(thread), std::move(done) });
+}
+
+void EpollServer::PollStream(Connection& c) {
+    chunk_.clear();
+    bool more = c.poll(chunk_);
+    if (!chunk_.empty()) {
+        char size[20];
+        int length = snprintf(size, sizeof(size), "%zx\r\n", chunk_.size());
+        c.out.append(size, (size_t)length);
+        c.out += chunk_;
+        c.out += "\r\n";
+    }
+    if (!more) {
+        c.out += "0\r\n\r\n";
+        c.poll = nullptr;
+    }
+    if (c.out.size() - c.out_pos > MAX_PENDING_OUTPUT) {
+        Close(c);
+        return;
+    }
+    Flush(c);
+    // Requests pipelined behind a finished stream
+    if (c.fd >= 0 && !more && !c.in.empty()) ServeRequests(c);
+}
+
+void EpollServer::PollStreams() {
+    // Polling may close connections, so not while walking the map; closed
+    // ones stay allocated in closed_ until the batch is done
+    streams_.clear();
+    for (auto& [ptr, c] : connections_) {
+        if (c->poll && c->out_pos == c->out.size()) streams_.push_back(ptr);
+    }
+    for (Connection* c : streams_) {
+        if (c->fd >= 0 && c->poll) PollStream(*c);
+    }
+}
+
+void EpollServer::Flush(Connection& c) {
+    while (c.out_pos < c.out.size()) {
+        ssize_t n = send(c.fd, c.out.data() + c.out_pos, c.out.size() - c.out_pos, MSG_NOSIGNAL);
+        if (n > 0) {
+            c.out_pos += (size_t)n;
+            c.last_active = std::chrono::steady_clock::now();
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!c.want_write) {
+                epoll_event ev = {};
+                ev.events = EPOLLIN | EPOLLRDHUP | EPOLLOUT;
+                ev.data.ptr = &c;
+                epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, c.fd, &ev);
+                c.want_write = true;
+            }
+            return;
+        }
+        Close(c);
+        return;
+    }
+    c.out.clear();
+    c.out_pos = 0;
+    if (c.want_write) {
+        epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = &c;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, c.fd, &ev);
+        c.want_write = false;
+    }
+    if (c.close_after_write && !c.poll) Close(c);
+}
+
+void EpollServer::Close(Connection& c) {
+    if (c.fd >= 0) {
+        // Closing the fd also takes it out of the epoll set
+        shutdown(c.fd, SHUT_RDWR);
+        close(c.fd);
+        c.fd = -1;
+    }
+    c.poll = nullptr;
+    auto it = connections_.find(&c);
+    if (it == connections_.end()) return;
+    // Events later in the current batch may still point at it
+    closed_.push_back(std::move(it->second));
+    connections_.erase(it);
+    --connection_count_;
+}
+
+void EpollServer::ExpireIdle(std::chrono::steady_clock::time_point now) {
+    auto keep_alive = std::chrono::seconds(keep_alive_timeout_sec_);
+    auto read_timeout = std::chrono::seconds(read_timeout_sec_);
+    auto write_timeout = std::chrono::seconds(write_timeout_sec_);
+    std::vector<Connection*> expired;
+    for (auto& [ptr, c] : connections_) {
+        auto idle = now - c->last_active;
+        bool sending = c->out_pos < c->out.size();
+        if (sending ? idle > write_timeout
+                    : !c->poll && (c->in.empty() ? idle > keep_alive : idle > read_timeout)) {
+            expired.push_back(ptr);
+        }
+    }
+    for (Connection* c : expired) Close(*c);
+}
+
+void EpollServer::ReapUpgrades(bool wait) {
+    for (auto it = upgrade_threads_.begin(); it != upgrade_threads_.end();) {
+        if (wait || *it->done) {
+            it->thread.join();
+            it = upgrade_threads_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
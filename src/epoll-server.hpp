@@ -0,0 +1,72 @@
+#pragma once
+#include "websocket.hpp"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// WebSocketServer on one epoll loop with non-blocking sockets (Linux).
+// An open connection costs its buffers rather than a worker thread, so
+// thousands of SSE subscribers and long-polls can wait at once. Requests
+// are routed by httplib as usual, but on the loop thread: handlers must
+// not block. WebSocket upgrades still get a thread each.
+class EpollServer : public WebSocketServer {
+public:
+    EpollServer();
+    ~EpollServer() override;
+
+    void Wake() override;
+    bool Listen() override;
+    void Stop() override;
+
+    // Open HTTP connections, WebSockets excluded
+    size_t ConnectionCount() const { return connection_count_; }
+
+protected:
+    bool IsStopping() const override { return stopping_; }
+
+private:
+    struct Connection {
+        int fd = -1;
+        std::string in;    // received, not yet served
+        std::string out;   // not yet sent, from out_pos
+        size_t out_pos = 0;
+        StreamPoll poll;   // set while a Stream() response is open
+        size_t requests = 0;
+        bool close_after_write = false;
+        bool want_write = false;  // EPOLLOUT is registered
+        std::chrono::steady_clock::time_point last_active;
+    };
+
+    void Accept(int listen_fd);
+    // payload_max_length_, capped to what is worth buffering
+    size_t MaxBodySize() const;
+    void OnReadable(Connection& c);
+    void OnWritable(Connection& c);
+    void ServeRequests(Connection& c);
+    void HandOffUpgrade(Connection& c, const Handler& handler, size_t head_length);
+    void PollStream(Connection& c);
+    void PollStreams();
+    void Flush(Connection& c);
+    void Close(Connection& c);
+    void ExpireIdle(std::chrono::steady_clock::time_point now);
+    void ReapUpgrades(bool wait);
+
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1;
+    std::atomic<bool> stopping_{false};
+    std::atomic<size_t> connection_count_{0};
+    std::unordered_map<Connection*, std::unique_ptr<Connection>> connections_;
+    std::vector<std::unique_ptr<Connection>> closed_;  // freed once the event batch is done
+    std::string chunk_;  // poll output, reused
+    std::vector<Connection*> streams_;  // PollStreams() scratch
+
+    struct UpgradeThread {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+    std::vector<UpgradeThread> upgrade_threads_;
+};
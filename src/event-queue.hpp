@@ -0,0 +1,72 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Bounded lock-free multi-producer / single-consumer queue (Vyukov's
+// bounded MPMC queue with the consumer side simplified). Each cell carries
+// a sequence number that says whose turn it is, so producers claim a cell
+// with one CAS and never wait on each other or on the consumer. A full
+// queue rejects the push instead of blocking; the caller decides what a
+// drop means.
+template <typename T, size_t Capacity>
+class EventQueue {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    static_assert(std::is_trivially_copyable_v<T>, "Events are copied without locks");
+
+    struct alignas(64) Cell {
+        std::atomic<size_t> seq{0};
+        T value{};
+    };
+
+    Cell cells_[Capacity];
+    alignas(64) std::atomic<size_t> enqueue_pos_{0};
+    alignas(64) std::atomic<size_t> dequeue_pos_{0};
+
+public:
+    EventQueue() {
+        for (size_t i = 0; i < Capacity; ++i) cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    static constexpr size_t capacity() { return Capacity; }
+
+    // Any thread. Returns false if the queue is full.
+    bool TryPush(const T& value) {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells_[pos & (Capacity - 1)];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = value;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Must only ever be called from one thread at a time.
+    bool TryPop(T& out) {
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        Cell& cell = cells_[pos & (Capacity - 1)];
+        if (cell.seq.load(std::memory_order_acquire) != pos + 1) return false;
+        out = cell.value;
+        cell.seq.store(pos + Capacity, std::memory_order_release);
+        dequeue_pos_.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Approximate number of queued events, for metrics
+    size_t Depth() const {
+        size_t head = enqueue_pos_.load(std::memory_order_relaxed);
+        size_t tail = dequeue_pos_.load(std::memory_order_relaxed);
+        return head > tail ? head - tail : 0;
+    }
+};
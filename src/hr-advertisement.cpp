@@ -0,0 +1,68 @@
+#include "hr-advertisement.hpp"
+#include <cstring>
+
+static const uint16_t HR_SERVICE_UUID16 = 0x180D;
+static const size_t HUAMI_BPM_OFFSET = 3;
+
+static bool DecodeHuami(std::span<const uint8_t> data, HeartRateMeasurement& out) {
+    if (data.size() <= HUAMI_BPM_OFFSET) return false;
+    uint8_t bpm = data[HUAMI_BPM_OFFSET];
+    if (bpm == 0x00 || bpm == 0xFF) return false;
+    out = HeartRateMeasurement{};
+    out.bpm = bpm;
+    return true;
+}
+
+bool DecodeAdvertisementHeartRate(std::span<const uint8_t> ad, HeartRateMeasurement& out) {
+    size_t pos = 0;
+    while (pos < ad.size()) {
+        uint8_t len = ad[pos];
+        if (len == 0) break;  // Early terminator / zero padding
+        if (pos + 1 + len > ad.size()) return false;
+
+        uint8_t type = ad[pos + 1];
+        std::span<const uint8_t> data = ad.subspan(pos + 2, len - 1);
+        pos += 1 + len;
+
+        if (type == AD_TYPE_SERVICE_DATA_16 && data.size() >= 2) {
+            uint16_t uuid = (uint16_t)(data[0] | (data[1] << 8));
+            if (uuid == HR_SERVICE_UUID16 && DecodeHeartRateMeasurement(data.subspan(2), out) && out.bpm > 0) {
+                return true;
+            }
+        } else if (type == AD_TYPE_MANUFACTURER_DATA && data.size() >= 2) {
+            uint16_t company = (uint16_t)(data[0] | (data[1] << 8));
+            if (company == COMPANY_ID_HUAMI && DecodeHuami(data.subspan(2), out)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool AdvertisementBuilder::Append(uint8_t type, std::span<const uint8_t> data) {
+    if (data.size() > 254 || size_ + 2 + data.size() > kCapacity) return false;
+    buffer_[size_++] = (uint8_t)(data.size() + 1);
+    buffer_[size_++] = type;
+    if (!data.empty()) memcpy(buffer_ + size_, data.data(), data.size());
+    size_ += data.size();
+    return true;
+}
+
+bool AdvertisementBuilder::AppendPrefixed(uint8_t type, uint16_t prefix, std::span<const uint8_t> data) {
+    if (data.size() > 252 || size_ + 4 + data.size() > kCapacity) return false;
+    buffer_[size_++] = (uint8_t)(data.size() + 3);
+    buffer_[size_++] = type;
+    buffer_[size_++] = (uint8_t)(prefix & 0xFF);
+    buffer_[size_++] = (uint8_t)(prefix >> 8);
+    if (!data.empty()) memcpy(buffer_ + size_, data.data(), data.size());
+    size_ += data.size();
+    return true;
+}
+
+bool AdvertisementBuilder::AppendManufacturer(uint16_t company_id, std::span<const uint8_t> data) {
+    return AppendPrefixed(AD_TYPE_MANUFACTURER_DATA, company_id, data);
+}
+
+bool AdvertisementBuilder::AppendServiceData16(uint16_t uuid, std::span<const uint8_t> data) {
+    return AppendPrefixed(AD_TYPE_SERVICE_DATA_16, uuid, data);
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "hr-measurement.hpp"
+#include <cstdint>
+#include <cstddef>
+#include <span>
+
+// Connectionless heart rate: some wearables put the current BPM straight
+// into their advertisements. The decoder works on the raw AD structure
+// stream (length, type, data)* as it appears on air, so every backend can
+// feed it and recorded payloads can be replayed through it.
+//
+// Recognised layouts:
+//   Service Data (0x16) for UUID 0x180D  the body is a 0x2A37 measurement
+//   Manufacturer Data (0xFF), Huami      Mi Band "heart rate broadcast";
+//     company 0x0157, BPM at offset 3   0x00/0xFF mean "no reading"
+
+enum : uint8_t {
+    AD_TYPE_SHORT_NAME = 0x08,
+    AD_TYPE_COMPLETE_NAME = 0x09,
+    AD_TYPE_SERVICE_DATA_16 = 0x16,
+    AD_TYPE_MANUFACTURER_DATA = 0xFF,
+};
+
+constexpr uint16_t COMPANY_ID_HUAMI = 0x0157;
+
+// Returns true and fills `out` if the advertisement carries a heart rate
+bool DecodeAdvertisementHeartRate(std::span<const uint8_t> ad_structures, HeartRateMeasurement& out);
+
+// Rebuilds the AD structure stream for stacks that hand out parsed
+// sections (WinRT DataSections, BlueZ ManufacturerData / ServiceData).
+class AdvertisementBuilder {
+public:
+    // Legacy + scan response is 62 bytes; leave room for extended adverts
+    static constexpr size_t kCapacity = 256;
+
+    bool Append(uint8_t type, std::span<const uint8_t> data);
+    bool AppendManufacturer(uint16_t company_id, std::span<const uint8_t> data);
+    bool AppendServiceData16(uint16_t uuid, std::span<const uint8_t> data);
+
+    std::span<const uint8_t> data() const { return { buffer_, size_ }; }
+
+private:
+    bool AppendPrefixed(uint8_t type, uint16_t prefix, std::span<const uint8_t> data);
+
+    uint8_t buffer_[kCapacity];
+    size_t size_ = 0;
+};
@@ -0,0 +1,135 @@
+#include "hr-broadcast.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+static uint64_t now_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static void store_max(std::atomic<uint64_t>& target, uint64_t value) {
+    uint64_t current = target.load(std::memory_order_relaxed);
+    while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+}
+
+HrBroadcaster::Subscription::Subscription(HrBroadcaster& broadcaster, const char* kind, size_t limit)
+    : broadcaster_(broadcaster), kind_(kind), limit_(std::clamp<size_t>(limit, 1, kCapacity)),
+      cursor_(broadcaster.Published()) {
+    std::lock_guard<std::mutex> lock(broadcaster_.subscribers_mutex_);
+    broadcaster_.subscribers_.push_back(this);
+    ++broadcaster_.subscriber_count_;
+}
+
+HrBroadcaster::Subscription::~Subscription() {
+    std::lock_guard<std::mutex> lock(broadcaster_.subscribers_mutex_);
+    auto& subscribers = broadcaster_.subscribers_;
+    subscribers.erase(std::find(subscribers.begin(), subscribers.end(), this));
+    --broadcaster_.subscriber_count_;
+}
+
+void HrBroadcaster::Subscription::SkipToHead() {
+    cursor_.store(broadcaster_.Published(), std::memory_order_relaxed);
+}
+
+uint64_t HrBroadcaster::Subscription::Take(std::vector<HrEventPtr>& out) {
+    uint64_t cursor = cursor_.load(std::memory_order_relaxed);
+    uint64_t dropped = 0;
+    size_t first = out.size();
+    {
+        std::lock_guard<std::mutex> lock(broadcaster_.mutex_);
+        uint64_t head = broadcaster_.head_.load(std::memory_order_relaxed);
+        uint64_t queued = head - cursor;
+        store_max(max_queued_, queued);
+        if (queued > limit_) {
+            // Drop the oldest: a late reader wants the newest values
+            dropped = queued - limit_;
+            cursor += dropped;
+        }
+        for (; cursor < head; ++cursor) out.push_back(broadcaster_.log_[cursor % kCapacity]);
+    }
+    cursor_.store(cursor, std::memory_order_relaxed);
+
+    if (dropped) dropped_.fetch_add(dropped, std::memory_order_relaxed);
+    if (out.size() > first) {
+        delivered_.fetch_add(out.size() - first, std::memory_order_relaxed);
+        // The oldest event taken waited longest
+        uint64_t lag = now_ns() - out[first]->publish_ns;
+        last_lag_ns_.store(lag, std::memory_order_relaxed);
+        store_max(max_lag_ns_, lag);
+    }
+    return dropped;
+}
+
+HrSubscriberStats HrBroadcaster::Subscription::Stats() const {
+    HrSubscriberStats stats;
+    stats.kind = kind_;
+    stats.delivered = delivered_.load(std::memory_order_relaxed);
+    stats.dropped = dropped_.load(std::memory_order_relaxed);
+    uint64_t head = broadcaster_.Published();
+    uint64_t cursor = cursor_.load(std::memory_order_relaxed);
+    stats.queued = head > cursor ? std::min<uint64_t>(head - cursor, limit_) : 0;
+    stats.max_queued = max_queued_.load(std::memory_order_relaxed);
+    stats.last_lag_ns = last_lag_ns_.load(std::memory_order_relaxed);
+    stats.max_lag_ns = max_lag_ns_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void HrBroadcaster::Publish(std::shared_ptr<HrEvent> event) {
+    event->publish_ns = now_ns();
+    HrEventPtr evicted;  // released outside the lock
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    evicted = std::move(log_[head % kCapacity]);
+    log_[head % kCapacity] = std::move(event);
+    head_.store(head + 1, std::memory_order_release);
+}
+
+std::vector<HrSubscriberStats> HrBroadcaster::Stats() const {
+    std::lock_guard<std::mutex> lock(subscribers_mutex_);
+    std::vector<HrSubscriberStats> stats;
+    stats.reserve(subscribers_.size());
+    for (const Subscription* subscriber : subscribers_) stats.push_back(subscriber->Stats());
+    return stats;
+}
+
+void HrPolicy::LimitRate(double per_second) {
+    if (!(per_second > 0)) return;
+    double interval = std::ceil(1000.0 / per_second);
+    if (interval > UINT32_MAX) interval = UINT32_MAX;
+    min_interval_ms = std::max(min_interval_ms, (uint32_t)interval);
+}
+
+void HrThrottle::Reset() {
+    pending_ = nullptr;
+    latest_ = nullptr;
+    sent_any_ = false;
+    last_seq_ = 0;
+}
+
+void HrThrottle::Offer(HrEventPtr event) {
+    latest_ = event;
+    if (policy_.on_change && sent_any_ && event->hr == last_hr_) return;
+    pending_ = std::move(event);  // the newest wins
+}
+
+HrEventPtr HrThrottle::Due(uint64_t now_ns) {
+    uint64_t since_sent_ms = (now_ns - last_sent_ns_) / 1000000;
+    if (!pending_ && policy_.keepalive_ms && latest_ && latest_->seq > last_seq_ &&
+        since_sent_ms >= policy_.keepalive_ms) {
+        pending_ = latest_;
+    }
+    if (!pending_ || (sent_any_ && since_sent_ms < policy_.min_interval_ms)) return nullptr;
+    HrEventPtr event = std::move(pending_);
+    pending_ = nullptr;
+    Sent(event->seq, event->hr, now_ns);
+    return event;
+}
+
+void HrThrottle::Sent(uint64_t seq, int hr, uint64_t now_ns) {
+    sent_any_ = true;
+    last_seq_ = seq;
+    last_hr_ = hr;
+    last_sent_ns_ = now_ns;
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// One heart rate sample, encoded once for every wire format. Immutable
+// once published; every subscriber that delivers it shares the buffers.
+struct HrEvent {
+    uint32_t stream_id = 0;
+    uint64_t seq = 0;          // the stream's ring position
+    int hr = -1;               // as sample_hr() saw it when published
+    uint64_t publish_ns = 0;   // steady clock; set by Publish
+    std::string sse;           // "id: <seq>\ndata: <json>\n\n"
+    size_t json_offset = 0;    // the sample's JSON object inside sse
+    size_t json_size = 0;
+    std::string ws_frame;      // complete binary WebSocket frame
+
+    std::string_view Json() const { return std::string_view(sse).substr(json_offset, json_size); }
+};
+using HrEventPtr = std::shared_ptr<const HrEvent>;
+
+// Lag counters of one subscriber. Lag runs from Publish to the Take that
+// handed the event over.
+struct HrSubscriberStats {
+    const char* kind = "";
+    uint64_t delivered = 0;
+    uint64_t dropped = 0;      // fell out of the subscriber's window unread
+    uint64_t queued = 0;       // published, not yet taken
+    uint64_t max_queued = 0;
+    uint64_t last_lag_ns = 0;
+    uint64_t max_lag_ns = 0;
+};
+
+// What a subscriber wants delivered of one stream. A throttled subscriber
+// gets the newest sample when one is due; the ones in between are skipped,
+// RR intervals included.
+struct HrPolicy {
+    bool on_change = false;        // skip samples whose hr equals the last one sent
+    uint32_t min_interval_ms = 0;  // at most one sample per interval
+    uint32_t keepalive_ms = 0;     // with on_change: send the newest sample anyway after this long
+
+    bool Active() const { return on_change || min_interval_ms || keepalive_ms; }
+    // A rate in samples per second, as the equivalent minimum interval
+    void LimitRate(double per_second);
+};
+
+// Applies an HrPolicy to the events of one stream, before anything is
+// written for them. A held sample goes out on a later Due() once its
+// interval has passed, so Due() must also run on idle wake-ups.
+class HrThrottle {
+public:
+    void SetPolicy(const HrPolicy& policy) { policy_ = policy; }
+    const HrPolicy& Policy() const { return policy_; }
+    // Another band answers now; nothing carries over
+    void Reset();
+
+    void Offer(HrEventPtr event);
+    // The event to send now, if any
+    HrEventPtr Due(uint64_t now_ns);
+    // A sample went out some other way (a replay from the ring)
+    void Sent(uint64_t seq, int hr, uint64_t now_ns);
+
+private:
+    HrPolicy policy_;
+    HrEventPtr pending_;  // next to send once the interval allows
+    HrEventPtr latest_;   // newest offered; what a keepalive sends
+    bool sent_any_ = false;
+    int last_hr_ = 0;
+    uint64_t last_seq_ = 0;
+    uint64_t last_sent_ns_ = 0;
+};
+
+// Fans published events out to any number of subscribers. Events sit in one
+// shared log; a subscriber is a cursor into it, so publishing costs the same
+// for one subscriber or a thousand. Each subscriber sees at most its own
+// limit of pending events: a slow reader skips the oldest, which are counted
+// as dropped, and resumes with the newest.
+class HrBroadcaster {
+public:
+    static constexpr size_t kCapacity = 1024;
+
+    class Subscription {
+    public:
+        // kind names the subscriber in stats ("sse", "ws", ...)
+        Subscription(HrBroadcaster& broadcaster, const char* kind, size_t limit);
+        ~Subscription();
+
+        Subscription(const Subscription&) = delete;
+        Subscription& operator=(const Subscription&) = delete;
+
+        // Forgets everything published so far; for a reader that has just
+        // replayed history from elsewhere
+        void SkipToHead();
+        // Appends the events published since the last call, oldest first.
+        // Returns how many were dropped for falling out of the window.
+        uint64_t Take(std::vector<HrEventPtr>& out);
+        HrSubscriberStats Stats() const;
+
+    private:
+        HrBroadcaster& broadcaster_;
+        const char* kind_;
+        size_t limit_;
+        // Written by the reader only; atomic so Stats() can read it
+        std::atomic<uint64_t> cursor_;
+        std::atomic<uint64_t> delivered_{0};
+        std::atomic<uint64_t> dropped_{0};
+        std::atomic<uint64_t> max_queued_{0};
+        std::atomic<uint64_t> last_lag_ns_{0};
+        std::atomic<uint64_t> max_lag_ns_{0};
+    };
+
+    // Thread-safe
+    void Publish(std::shared_ptr<HrEvent> event);
+    // Publishers skip encoding while nobody listens
+    bool HasSubscribers() const { return subscriber_count_.load(std::memory_order_relaxed) > 0; }
+    uint64_t Published() const { return head_.load(std::memory_order_acquire); }
+    std::vector<HrSubscriberStats> Stats() const;
+
+private:
+    mutable std::mutex mutex_;
+    HrEventPtr log_[kCapacity];  // event n lives in log_[n % kCapacity]; under mutex_
+    std::atomic<uint64_t> head_{0};
+
+    mutable std::mutex subscribers_mutex_;
+    std::vector<Subscription*> subscribers_;
+    std::atomic<size_t> subscriber_count_{0};
+};
@@ -0,0 +1,135 @@
+#include "hr-capture.hpp"
+#include <obs-module.h>
+#include <util/platform.h>
+#include <chrono>
+#include <cstring>
+#include <memory>
+
+static const char HRCAP_MAGIC[5] = { 'H', 'R', 'C', 'A', 'P' };
+static const size_t HRCAP_HEADER_SIZE = 16;
+static const uint64_t FLUSH_INTERVAL_NS = 1000000000ull;
+
+std::shared_ptr<CaptureWriter> CaptureWriter::Open(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        blog(LOG_WARNING, "Failed to create capture file %s", path.c_str());
+        return nullptr;
+    }
+
+    uint8_t header[HRCAP_HEADER_SIZE] = {};
+    memcpy(header, HRCAP_MAGIC, sizeof(HRCAP_MAGIC));
+    header[5] = HRCAP_VERSION;
+    uint64_t wall_ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    for (int i = 0; i < 8; ++i) {
+        header[8 + i] = (uint8_t)(wall_ns >> (8 * i));
+    }
+    fwrite(header, 1, sizeof(header), file);
+
+    blog(LOG_INFO, "Capturing raw notifications to %s", path.c_str());
+    return std::shared_ptr<CaptureWriter>(new CaptureWriter(file));
+}
+
+CaptureWriter::~CaptureWriter() {
+    if (file_) fclose(file_);
+}
+
+void CaptureWriter::Write(uint32_t stream_id, uint64_t timestamp_ns, std::span<const uint8_t> payload) {
+    uint8_t record[10 + 2 + 255];
+    size_t len = 0;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t delta_us = 0;
+    if (last_timestamp_ns_ != 0 && timestamp_ns > last_timestamp_ns_) {
+        delta_us = (timestamp_ns - last_timestamp_ns_) / 1000;
+    }
+    // Keep the sub-microsecond remainder so deltas don't drift
+    last_timestamp_ns_ = last_timestamp_ns_ == 0 ? timestamp_ns : last_timestamp_ns_ + delta_us * 1000;
+
+    do {
+        uint8_t byte = delta_us & 0x7F;
+        delta_us >>= 7;
+        record[len++] = byte | (delta_us ? 0x80 : 0);
+    } while (delta_us);
+
+    record[len++] = (uint8_t)stream_id;
+    size_t size = payload.size() > 255 ? 255 : payload.size();
+    record[len++] = (uint8_t)size;
+    memcpy(record + len, payload.data(), size);
+    len += size;
+    fwrite(record, 1, len, file_);
+
+    // Field captures matter most right before a crash; don't sit on them
+    uint64_t now = os_gettime_ns();
+    if (now - last_flush_ns_ >= FLUSH_INTERVAL_NS) {
+        fflush(file_);
+        last_flush_ns_ = now;
+    }
+}
+
+bool CaptureReader::Load(const std::string& path) {
+    data_ = nullptr;
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        blog(LOG_WARNING, "Failed to open capture file %s", path.c_str());
+        return false;
+    }
+    auto data = std::make_shared<std::vector<uint8_t>>();
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data->insert(data->end(), chunk, chunk + n);
+    }
+    fclose(file);
+
+    if (data->size() < HRCAP_HEADER_SIZE || memcmp(data->data(), HRCAP_MAGIC, sizeof(HRCAP_MAGIC)) != 0) {
+        blog(LOG_WARNING, "%s is not a heart rate capture", path.c_str());
+        return false;
+    }
+    uint8_t version = (*data)[5];
+    if (version < 1 || version > HRCAP_VERSION) {
+        blog(LOG_WARNING, "Unsupported capture version %d in %s", version, path.c_str());
+        return false;
+    }
+
+    data_ = std::move(data);
+    version_ = version;
+    Rewind();
+    return true;
+}
+
+void CaptureReader::Rewind() {
+    pos_ = HRCAP_HEADER_SIZE;
+    offset_us_ = 0;
+    first_ = true;
+}
+
+bool CaptureReader::Next(CaptureRecord& record) {
+    if (!data_) return false;
+    const std::vector<uint8_t>& data = *data_;
+    uint64_t delta_us = 0;
+    int shift = 0;
+    for (;;) {
+        if (pos_ >= data.size() || shift > 63) return false;
+        uint8_t byte = data[pos_++];
+        delta_us |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) break;
+        shift += 7;
+    }
+    uint32_t stream_id = 0;
+    if (version_ >= 2) {
+        if (pos_ >= data.size()) return false;
+        stream_id = data[pos_++];
+    }
+    if (pos_ >= data.size()) return false;
+    size_t size = data[pos_++];
+    if (data.size() - pos_ < size) return false;
+
+    offset_us_ = first_ ? 0 : offset_us_ + delta_us;
+    first_ = false;
+    record.offset_us = offset_us_;
+    record.stream_id = stream_id;
+    record.payload = { data.data() + pos_, size };
+    pos_ += size;
+    return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+// Capture file of raw GATT notification payloads (.hrcap).
+//
+// Layout, all integers little endian:
+//   header   "HRCAP" | u8 version (2) | u16 reserved
+//            u64 wall-clock start, ns since the Unix epoch (informational)
+//   record   varint delta_us   time since the previous record (LEB128)
+//            u8     stream     stream the band was connected on
+//            u8     length     payload size in bytes
+//            u8[length]        payload exactly as the BLE stack delivered it
+//
+// Version 1 records have no stream byte; they read as stream 0.
+// A 1 Hz band costs 4-5 bytes of overhead per notification.
+
+constexpr uint8_t HRCAP_VERSION = 2;
+
+class CaptureWriter {
+public:
+    ~CaptureWriter();
+
+    // Returns nullptr (and logs) if the file cannot be created
+    static std::shared_ptr<CaptureWriter> Open(const std::string& path);
+
+    void Write(uint32_t stream_id, uint64_t timestamp_ns, std::span<const uint8_t> payload);
+
+private:
+    CaptureWriter(FILE* file) : file_(file) {}
+
+    std::mutex mutex_;
+    FILE* file_;
+    uint64_t last_timestamp_ns_ = 0;
+    uint64_t last_flush_ns_ = 0;
+};
+
+struct CaptureRecord {
+    uint64_t offset_us;               // since the first record
+    uint32_t stream_id;
+    std::span<const uint8_t> payload; // points into the reader's buffer
+};
+
+// Copies share the loaded file and keep their own position
+class CaptureReader {
+public:
+    bool Load(const std::string& path);
+
+    // Iterates records in order; returns false at the end or on a torn tail
+    bool Next(CaptureRecord& record);
+    void Rewind();
+
+private:
+    std::shared_ptr<const std::vector<uint8_t>> data_;
+    uint8_t version_ = 0;
+    size_t pos_ = 0;
+    uint64_t offset_us_ = 0;
+    bool first_ = true;
+};
@@ -0,0 +1,47 @@
+#include "hr-measurement.hpp"
+
+static inline uint16_t ReadU16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+bool DecodeHeartRateMeasurement(std::span<const uint8_t> payload, HeartRateMeasurement& out) {
+    out = HeartRateMeasurement{};
+    if (payload.empty()) return false;
+
+    const uint8_t* p = payload.data();
+    const uint8_t* end = p + payload.size();
+    uint8_t flags = *p++;
+
+    if (flags & HR_FLAG_VALUE_U16) {
+        if (end - p < 2) return false;
+        out.bpm = ReadU16(p);
+        p += 2;
+    } else {
+        if (end - p < 1) return false;
+        out.bpm = *p++;
+    }
+
+    out.contact_supported = (flags & HR_FLAG_CONTACT_SUPPORTED) != 0;
+    out.contact_detected = out.contact_supported && (flags & HR_FLAG_CONTACT_DETECTED) != 0;
+
+    if (flags & HR_FLAG_ENERGY_PRESENT) {
+        if (end - p < 2) return false;
+        out.has_energy = true;
+        out.energy_expended = ReadU16(p);
+        p += 2;
+    }
+
+    if (flags & HR_FLAG_RR_PRESENT) {
+        // A trailing odd byte is not a valid interval; ignore it
+        while (end - p >= 2) {
+            if (out.rr_count == kMaxRrIntervals) {
+                out.rr_truncated = true;
+                break;
+            }
+            out.rr_intervals[out.rr_count++] = ReadU16(p);
+            p += 2;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <span>
+
+// Heart Rate Measurement characteristic (0x2A37) flag bits
+enum : uint8_t {
+    HR_FLAG_VALUE_U16 = 0x01,
+    HR_FLAG_CONTACT_DETECTED = 0x02,
+    HR_FLAG_CONTACT_SUPPORTED = 0x04,
+    HR_FLAG_ENERGY_PRESENT = 0x08,
+    HR_FLAG_RR_PRESENT = 0x10,
+};
+
+// A default ATT MTU leaves 18 bytes for RR intervals after flags and an
+// 8-bit BPM; bigger MTUs can carry more, so keep some headroom.
+constexpr size_t kMaxRrIntervals = 32;
+
+struct HeartRateMeasurement {
+    uint16_t bpm = 0;
+    bool contact_supported = false;
+    bool contact_detected = false;
+    bool has_energy = false;
+    uint16_t energy_expended = 0;    // kJ, cumulative
+    uint8_t rr_count = 0;
+    bool rr_truncated = false;       // more intervals than kMaxRrIntervals
+    uint16_t rr_intervals[kMaxRrIntervals] = {};  // 1/1024 s units
+};
+
+// Decodes a raw 0x2A37 notification payload. Returns false when the payload
+// is too short for the fields its flags announce; never allocates.
+bool DecodeHeartRateMeasurement(std::span<const uint8_t> payload, HeartRateMeasurement& out);
@@ -0,0 +1,220 @@
+#include "hr-shm.hpp"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#endif
+#include "miband-hr-shm.h"
+#include <obs-module.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+#ifndef _WIN32
+#include <signal.h>
+#endif
+
+// Readers compile the C header on their own; these pin the offsets it documents
+static_assert(sizeof(miband_hr_shm_header) == 64, "header is one cache line");
+static_assert(offsetof(miband_hr_shm_stream, rr_total) == 32 && offsetof(miband_hr_shm_stream, device) == 40 &&
+                  offsetof(miband_hr_shm_stream, rr) == 64,
+              "stream block offsets are part of the layout");
+static_assert(sizeof(miband_hr_shm_stream) == 192, "stream blocks stay 64-byte aligned");
+static_assert(MIBAND_HR_SHM_STREAMS == kMaxStreams, "one block per stream");
+static_assert((MIBAND_HR_SHM_RR_CAPACITY & (MIBAND_HR_SHM_RR_CAPACITY - 1)) == 0, "rr_total wraps cleanly");
+
+static const size_t SEGMENT_SIZE = sizeof(miband_hr_shm_header) + MIBAND_HR_SHM_STREAMS * sizeof(miband_hr_shm_stream);
+
+static miband_hr_shm_stream* stream_block(miband_hr_shm_header* header, uint32_t stream_id) {
+    auto* streams = reinterpret_cast<miband_hr_shm_stream*>(reinterpret_cast<char*>(header) + sizeof(*header));
+    return streams + stream_id;
+}
+
+#ifndef _WIN32
+// The pid of a live process other than this one still writing the segment
+// at path, or 0. A run that crashed leaves running set behind it.
+static pid_t live_writer(const std::string& path) {
+    int fd = shm_open(path.c_str(), O_RDONLY, 0);
+    if (fd < 0) return 0;
+    pid_t pid = 0;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(miband_hr_shm_header)) {
+        void* view = mmap(nullptr, sizeof(miband_hr_shm_header), PROT_READ, MAP_SHARED, fd, 0);
+        if (view != MAP_FAILED) {
+            const auto* header = static_cast<const miband_hr_shm_header*>(view);
+            if (header->magic == MIBAND_HR_SHM_MAGIC && miband_hr_shm_load_(&header->running) == 1) {
+                pid = (pid_t)header->writer_pid;
+            }
+            munmap(view, sizeof(miband_hr_shm_header));
+        }
+    }
+    close(fd);
+    if (pid <= 0 || pid == getpid()) return 0;
+    // EPERM: alive, only owned by another user
+    return kill(pid, 0) == 0 || errno == EPERM ? pid : 0;
+}
+#endif
+
+HrSharedMemory::~HrSharedMemory() {
+    Close();
+}
+
+bool HrSharedMemory::Open(const char* name) {
+    Close();
+    std::string segment = name && *name ? name : MIBAND_HR_SHM_DEFAULT_NAME;
+    void* view = nullptr;
+
+#ifdef _WIN32
+    std::wstring path = L"Local\\";
+    int length = MultiByteToWideChar(CP_UTF8, 0, segment.c_str(), -1, nullptr, 0);
+    if (length > 1) {
+        std::wstring wide(length, L'\0');
+        MultiByteToWideChar(CP_UTF8, 0, segment.c_str(), -1, wide.data(), length);
+        path.append(wide.c_str());
+    }
+    HANDLE mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, (DWORD)SEGMENT_SIZE,
+                                        path.c_str());
+    if (!mapping) {
+        blog(LOG_WARNING, "Shared memory: cannot create '%s' (error %lu)", segment.c_str(), GetLastError());
+        return false;
+    }
+    if (GetLastError() == ERROR_ALREADY_EXISTS) {
+        // Another OBS publishes under this name; two writers would tear every block
+        blog(LOG_WARNING, "Shared memory: '%s' is already in use; set MIBAND_HR_SHM to another name",
+             segment.c_str());
+        CloseHandle(mapping);
+        return false;
+    }
+    view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, SEGMENT_SIZE);
+    if (!view) {
+        blog(LOG_WARNING, "Shared memory: cannot map '%s' (error %lu)", segment.c_str(), GetLastError());
+        CloseHandle(mapping);
+        return false;
+    }
+#else
+    std::string path = "/" + segment;
+    if (pid_t writer = live_writer(path)) {
+        // Another OBS publishes under this name; two writers would tear every block
+        blog(LOG_WARNING, "Shared memory: '%s' is already in use by process %d; set MIBAND_HR_SHM to another name",
+             segment.c_str(), (int)writer);
+        return false;
+    }
+    // A crashed run leaves its segment behind; readers of it see it frozen
+    // with running still set, so start over under the same name
+    shm_unlink(path.c_str());
+    int fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        blog(LOG_WARNING, "Shared memory: cannot create '%s': %s", segment.c_str(), strerror(errno));
+        return false;
+    }
+    if (ftruncate(fd, (off_t)SEGMENT_SIZE) == 0) {
+        view = mmap(nullptr, SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (view == MAP_FAILED) view = nullptr;
+    }
+    int error = errno;
+    close(fd);
+    if (!view) {
+        blog(LOG_WARNING, "Shared memory: cannot map '%s': %s", segment.c_str(), strerror(error));
+        shm_unlink(path.c_str());
+        return false;
+    }
+#endif
+
+    // The segment is new, so it reads as zeros until running is set
+    auto* header = static_cast<miband_hr_shm_header*>(view);
+    header->magic = MIBAND_HR_SHM_MAGIC;
+    header->layout_version = MIBAND_HR_SHM_LAYOUT_VERSION;
+    header->header_size = sizeof(miband_hr_shm_header);
+    header->stream_size = sizeof(miband_hr_shm_stream);
+    header->stream_count = MIBAND_HR_SHM_STREAMS;
+    header->rr_capacity = MIBAND_HR_SHM_RR_CAPACITY;
+#ifdef _WIN32
+    header->writer_pid = GetCurrentProcessId();
+#else
+    header->writer_pid = (uint64_t)getpid();
+#endif
+    std::atomic_ref<uint32_t>(header->running).store(1, std::memory_order_release);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    header_ = header;
+    name_ = segment;
+#ifdef _WIN32
+    mapping_ = mapping;
+#endif
+    blog(LOG_INFO, "Publishing heart rate to shared memory '%s'", segment.c_str());
+    return true;
+}
+
+void HrSharedMemory::Close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!header_) return;
+    std::atomic_ref<uint32_t>(header_->running).store(0, std::memory_order_release);
+#ifdef _WIN32
+    UnmapViewOfFile(header_);
+    CloseHandle(mapping_);
+    mapping_ = nullptr;
+#else
+    munmap(header_, SEGMENT_SIZE);
+    // Mapped readers keep the memory; new ones find nothing
+    shm_unlink(("/" + name_).c_str());
+#endif
+    header_ = nullptr;
+}
+
+template <typename F>
+void HrSharedMemory::Write(uint32_t stream_id, F&& update) {
+    if (stream_id >= MIBAND_HR_SHM_STREAMS) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!header_) return;
+    miband_hr_shm_stream* block = stream_block(header_, stream_id);
+    std::atomic_ref<uint32_t> version(block->version);
+    uint32_t current = version.load(std::memory_order_relaxed);
+    version.store(current + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    update(*block);
+    version.store(current + 2, std::memory_order_release);
+}
+
+void HrSharedMemory::SetDevice(uint32_t stream_id, const std::string& device_id, bool connected) {
+    Write(stream_id, [&](miband_hr_shm_stream& block) {
+        size_t size = std::min(device_id.size(), sizeof(block.device) - 1);
+        if (std::string_view(device_id).substr(0, size) != std::string_view(block.device)) {
+            // Another band: none of its samples yet. rr_total keeps counting
+            // so readers' cursors stay valid across the change.
+            block.seq = 0;
+            block.timestamp_ns = 0;
+            block.bpm = 0;
+        }
+        memset(block.device, 0, sizeof(block.device));
+        memcpy(block.device, device_id.data(), size);
+        block.flags = 0;
+        if (!device_id.empty()) block.flags = MIBAND_HR_SHM_ACTIVE | (connected ? MIBAND_HR_SHM_CONNECTED : 0);
+    });
+}
+
+void HrSharedMemory::SetConnected(uint32_t stream_id, bool connected) {
+    Write(stream_id, [connected](miband_hr_shm_stream& block) {
+        if (!(block.flags & MIBAND_HR_SHM_ACTIVE)) return;
+        block.flags = connected ? block.flags | MIBAND_HR_SHM_CONNECTED : block.flags & ~MIBAND_HR_SHM_CONNECTED;
+    });
+}
+
+void HrSharedMemory::Publish(uint32_t stream_id, uint64_t seq, const HeartRateSample& sample, bool connected) {
+    Write(stream_id, [&](miband_hr_shm_stream& block) {
+        // A straggler from a band that was just disconnected
+        if (!(block.flags & MIBAND_HR_SHM_ACTIVE)) return;
+        const HeartRateMeasurement& m = sample.measurement;
+        uint32_t flags = MIBAND_HR_SHM_ACTIVE;
+        if (connected) flags |= MIBAND_HR_SHM_CONNECTED;
+        if (m.contact_supported) flags |= MIBAND_HR_SHM_CONTACT_SUPPORTED;
+        if (m.contact_detected) flags |= MIBAND_HR_SHM_CONTACT_DETECTED;
+        block.flags = flags;
+        block.seq = seq;
+        block.timestamp_ns = sample.receive_timestamp_ns;
+        block.bpm = m.bpm;
+        for (uint8_t i = 0; i < m.rr_count; ++i) {
+            block.rr[block.rr_total++ % MIBAND_HR_SHM_RR_CAPACITY] = m.rr_intervals[i];
+        }
+    });
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "ble-manager.hpp"
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+struct miband_hr_shm_header;
+
+// Writer side of the shared-memory segment laid out in miband-hr-shm.h:
+// the newest sample of every stream for local processes that would
+// rather not poll HTTP. Samples come from the BLE dispatcher and device
+// changes from API threads, so writers serialise on a mutex; readers in
+// other processes only ever retry a torn copy.
+class HrSharedMemory {
+public:
+    HrSharedMemory() = default;
+    ~HrSharedMemory();
+
+    HrSharedMemory(const HrSharedMemory&) = delete;
+    HrSharedMemory& operator=(const HrSharedMemory&) = delete;
+
+    // Creates the segment, replacing one left by a run that has ended.
+    // Fails while another live process writes it. A null name means
+    // MIBAND_HR_SHM_DEFAULT_NAME.
+    bool Open(const char* name);
+    // Tells readers the plugin stopped, then removes the segment's name
+    void Close();
+
+    // The band now on a stream; an empty id frees the stream
+    void SetDevice(uint32_t stream_id, const std::string& device_id, bool connected);
+    void SetConnected(uint32_t stream_id, bool connected);
+    void Publish(uint32_t stream_id, uint64_t seq, const HeartRateSample& sample, bool connected);
+
+private:
+    template <typename F>
+    void Write(uint32_t stream_id, F&& update);
+
+    std::mutex mutex_;
+    miband_hr_shm_header* header_ = nullptr;  // null while closed; under mutex_
+    std::string name_;
+#ifdef _WIN32
+    void* mapping_ = nullptr;
+#endif
+};
@@ -0,0 +1,369 @@
+#include "json.hpp"
+#include <charconv>
+
+namespace {
+
+const char kHex[] = "0123456789abcdef";
+
+// Length of the UTF-8 sequence starting at s[i], or 0 if it's malformed
+// (overlong forms, surrogates and code points past U+10FFFF included)
+size_t utf8_length(std::string_view s, size_t i) {
+    unsigned char c = (unsigned char)s[i];
+    size_t length;
+    uint32_t cp;
+    if (c >= 0xC2 && c <= 0xDF) {
+        length = 2;
+        cp = c & 0x1F;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        length = 3;
+        cp = c & 0x0F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        length = 4;
+        cp = c & 0x07;
+    } else {
+        return 0;
+    }
+    if (i + length > s.size()) return 0;
+    for (size_t k = 1; k < length; ++k) {
+        unsigned char cc = (unsigned char)s[i + k];
+        if ((cc & 0xC0) != 0x80) return 0;
+        cp = (cp << 6) | (cc & 0x3F);
+    }
+    if ((length == 3 && cp < 0x800) || (length == 4 && (cp < 0x10000 || cp > 0x10FFFF))) return 0;
+    if (cp >= 0xD800 && cp <= 0xDFFF) return 0;
+    return length;
+}
+
+void append_utf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out.push_back((char)cp);
+    } else if (cp < 0x800) {
+        out.push_back((char)(0xC0 | (cp >> 6)));
+        out.push_back((char)(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        out.push_back((char)(0xE0 | (cp >> 12)));
+        out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back((char)(0x80 | (cp & 0x3F)));
+    } else {
+        out.push_back((char)(0xF0 | (cp >> 18)));
+        out.push_back((char)(0x80 | ((cp >> 12) & 0x3F)));
+        out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back((char)(0x80 | (cp & 0x3F)));
+    }
+}
+
+bool parse_hex4(std::string_view s, size_t i, uint32_t& out) {
+    if (i + 4 > s.size()) return false;
+    out = 0;
+    for (size_t k = 0; k < 4; ++k) {
+        char c = s[i + k];
+        out <<= 4;
+        if (c >= '0' && c <= '9') out |= c - '0';
+        else if (c >= 'a' && c <= 'f') out |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') out |= c - 'A' + 10;
+        else return false;
+    }
+    return true;
+}
+
+} // namespace
+
+void JsonWriter::Separate() {
+    if (after_key_) {
+        after_key_ = false;
+        return;
+    }
+    if (depth_ == 0 || depth_ > 64) return;
+    uint64_t bit = 1ull << (depth_ - 1);
+    if (has_items_ & bit) out_.push_back(',');
+    has_items_ |= bit;
+}
+
+JsonWriter& JsonWriter::Open(char c) {
+    Separate();
+    out_.push_back(c);
+    ++depth_;
+    if (depth_ <= 64) has_items_ &= ~(1ull << (depth_ - 1));
+    return *this;
+}
+
+JsonWriter& JsonWriter::Close(char c) {
+    out_.push_back(c);
+    if (depth_ > 0) --depth_;
+    return *this;
+}
+
+JsonWriter& JsonWriter::Key(std::string_view key) {
+    Separate();
+    Escape(key);
+    out_.push_back(':');
+    after_key_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::String(std::string_view value) {
+    Separate();
+    Escape(value);
+    return *this;
+}
+
+void JsonWriter::Escape(std::string_view value) {
+    out_.push_back('"');
+    size_t run = 0;  // start of the pending unescaped run
+    for (size_t i = 0; i < value.size();) {
+        unsigned char c = (unsigned char)value[i];
+        if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') {
+            ++i;
+            continue;
+        }
+        if (c >= 0x80) {
+            size_t length = utf8_length(value, i);
+            if (length > 0) {
+                i += length;
+                continue;
+            }
+        }
+        out_.append(value.data() + run, i - run);
+        switch (c) {
+        case '"': out_.append("\\\""); break;
+        case '\\': out_.append("\\\\"); break;
+        case '\n': out_.append("\\n"); break;
+        case '\r': out_.append("\\r"); break;
+        case '\t': out_.append("\\t"); break;
+        default:
+            if (c < 0x20) {
+                char escaped[6] = { '\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0xF] };
+                out_.append(escaped, sizeof(escaped));
+            } else {
+                out_.append("\xEF\xBF\xBD");  // U+FFFD
+            }
+        }
+        run = ++i;
+    }
+    out_.append(value.data() + run, value.size() - run);
+    out_.push_back('"');
+}
+
+JsonWriter& JsonWriter::Int(int64_t value) {
+    Separate();
+    char buf[24];
+    auto result = std::to_chars(buf, buf + sizeof(buf), value);
+    out_.append(buf, result.ptr - buf);
+    return *this;
+}
+
+JsonWriter& JsonWriter::Uint(uint64_t value) {
+    Separate();
+    char buf[24];
+    auto result = std::to_chars(buf, buf + sizeof(buf), value);
+    out_.append(buf, result.ptr - buf);
+    return *this;
+}
+
+JsonWriter& JsonWriter::Bool(bool value) {
+    Separate();
+    out_.append(value ? "true" : "false");
+    return *this;
+}
+
+JsonWriter& JsonWriter::Null() {
+    Separate();
+    out_.append("null");
+    return *this;
+}
+
+JsonWriter& JsonWriter::Raw(std::string_view json) {
+    Separate();
+    out_.append(json);
+    return *this;
+}
+
+void JsonReader::SkipSpace() {
+    while (pos_ < text_.size()) {
+        char c = text_[pos_];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') break;
+        ++pos_;
+    }
+}
+
+JsonReader::Token JsonReader::AfterValue(Token token) {
+    expect_ = depth_ == 0 ? Expect::Done : Expect::CommaOrEnd;
+    return token;
+}
+
+// pos_ is on the opening quote. Sets value_ to the text, decoded into
+// scratch only when it contains escapes.
+bool JsonReader::ReadString(std::string& scratch) {
+    size_t start = ++pos_;
+    bool escaped = false;
+    while (pos_ < text_.size()) {
+        unsigned char c = (unsigned char)text_[pos_];
+        if (c == '"') break;
+        if (c < 0x20) return false;
+        if (c == '\\') {
+            escaped = true;
+            pos_ += 2;
+        } else if (c >= 0x80) {
+            size_t length = utf8_length(text_, pos_);
+            if (length == 0) return false;
+            pos_ += length;
+        } else {
+            ++pos_;
+        }
+    }
+    if (pos_ >= text_.size()) return false;
+    size_t end = pos_++;
+    if (!escaped) {
+        value_ = text_.substr(start, end - start);
+        return true;
+    }
+
+    scratch.clear();
+    for (size_t i = start; i < end; ++i) {
+        char c = text_[i];
+        if (c != '\\') {
+            scratch.push_back(c);
+            continue;
+        }
+        char e = text_[++i];
+        switch (e) {
+        case '"': scratch.push_back('"'); break;
+        case '\\': scratch.push_back('\\'); break;
+        case '/': scratch.push_back('/'); break;
+        case 'b': scratch.push_back('\b'); break;
+        case 'f': scratch.push_back('\f'); break;
+        case 'n': scratch.push_back('\n'); break;
+        case 'r': scratch.push_back('\r'); break;
+        case 't': scratch.push_back('\t'); break;
+        case 'u': {
+            uint32_t cp;
+            if (!parse_hex4(text_, i + 1, cp)) return false;
+            i += 4;
+            if (cp >= 0xD800 && cp <= 0xDBFF) {
+                // Surrogate pair: the low half must follow
+                uint32_t low;
+                if (i + 2 >= end || text_[i + 1] != '\\' || text_[i + 2] != 'u' || !parse_hex4(text_, i + 3, low) ||
+                    low < 0xDC00 || low > 0xDFFF) {
+                    return false;
+                }
+                i += 6;
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+            } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                return false;
+            }
+            append_utf8(scratch, cp);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    value_ = scratch;
+    return true;
+}
+
+JsonReader::Token JsonReader::Next() {
+    if (failed_) return Token::Error;
+    SkipSpace();
+    if (expect_ == Expect::Done) {
+        if (pos_ < text_.size()) return Fail();
+        return Token::End;
+    }
+    if (pos_ >= text_.size()) return Fail();
+    char c = text_[pos_];
+
+    bool in_object = depth_ > 0 && (in_object_ >> (depth_ - 1)) & 1;
+    if (expect_ == Expect::CommaOrEnd) {
+        if (c == ',') {
+            ++pos_;
+            SkipSpace();
+            if (pos_ >= text_.size()) return Fail();
+            c = text_[pos_];
+            expect_ = in_object ? Expect::Key : Expect::Value;
+        } else if (c != (in_object ? '}' : ']')) {
+            return Fail();
+        }
+    }
+
+    if ((c == '}' && in_object && (expect_ == Expect::KeyOrEnd || expect_ == Expect::CommaOrEnd)) ||
+        (c == ']' && !in_object && depth_ > 0 && (expect_ == Expect::ValueOrEnd || expect_ == Expect::CommaOrEnd))) {
+        ++pos_;
+        --depth_;
+        return AfterValue(c == '}' ? Token::ObjectEnd : Token::ArrayEnd);
+    }
+
+    if (expect_ == Expect::KeyOrEnd || expect_ == Expect::Key) {
+        if (c != '"' || !ReadString(key_scratch_)) return Fail();
+        SkipSpace();
+        if (pos_ >= text_.size() || text_[pos_] != ':') return Fail();
+        ++pos_;
+        expect_ = Expect::Value;
+        return Token::Key;
+    }
+
+    // A value
+    switch (c) {
+    case '{':
+    case '[':
+        if (depth_ >= 64) return Fail();
+        ++pos_;
+        if (c == '{') {
+            in_object_ |= 1ull << depth_;
+        } else {
+            in_object_ &= ~(1ull << depth_);
+        }
+        ++depth_;
+        expect_ = c == '{' ? Expect::KeyOrEnd : Expect::ValueOrEnd;
+        return c == '{' ? Token::ObjectStart : Token::ArrayStart;
+    case '"':
+        if (!ReadString(string_scratch_)) return Fail();
+        return AfterValue(Token::String);
+    case 't':
+        if (text_.substr(pos_, 4) != "true") return Fail();
+        pos_ += 4;
+        return AfterValue(Token::True);
+    case 'f':
+        if (text_.substr(pos_, 5) != "false") return Fail();
+        pos_ += 5;
+        return AfterValue(Token::False);
+    case 'n':
+        if (text_.substr(pos_, 4) != "null") return Fail();
+        pos_ += 4;
+        return AfterValue(Token::Null);
+    default:
+        break;
+    }
+
+    // Number: -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+    size_t start = pos_;
+    auto digits = [this]() {
+        size_t from = pos_;
+        while (pos_ < text_.size() && text_[pos_] >= '0' && text_[pos_] <= '9') ++pos_;
+        return pos_ - from;
+    };
+    if (pos_ < text_.size() && text_[pos_] == '-') ++pos_;
+    if (pos_ < text_.size() && text_[pos_] == '0') {
+        ++pos_;
+    } else if (digits() == 0) {
+        return Fail();
+    }
+    if (pos_ < text_.size() && text_[pos_] == '.') {
+        ++pos_;
+        if (digits() == 0) return Fail();
+    }
+    if (pos_ < text_.size() && (text_[pos_] == 'e' || text_[pos_] == 'E')) {
+        ++pos_;
+        if (pos_ < text_.size() && (text_[pos_] == '+' || text_[pos_] == '-')) ++pos_;
+        if (digits() == 0) return Fail();
+    }
+    value_ = text_.substr(start, pos_ - start);
+    return AfterValue(Token::Number);
+}
+
+void JsonReader::Skip() {
+    int depth = depth_;
+    while (depth_ >= depth) {
+        Token token = Next();
+        if (token == Token::Error || token == Token::End) return;
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Streaming JSON writer. Appends to a caller-owned string, so a buffer
+// kept per thread is reused from one response to the next. Commas are
+// placed automatically from a fixed bit stack (64 levels), so the writer
+// itself never allocates.
+class JsonWriter {
+public:
+    explicit JsonWriter(std::string& out) : out_(out) {}
+
+    JsonWriter& BeginObject() { return Open('{'); }
+    JsonWriter& EndObject() { return Close('}'); }
+    JsonWriter& BeginArray() { return Open('['); }
+    JsonWriter& EndArray() { return Close(']'); }
+
+    JsonWriter& Key(std::string_view key);
+    // Escaped as needed; bytes that aren't valid UTF-8 become U+FFFD
+    JsonWriter& String(std::string_view value);
+    JsonWriter& Int(int64_t value);
+    JsonWriter& Uint(uint64_t value);
+    JsonWriter& Bool(bool value);
+    JsonWriter& Null();
+    // A value that is already JSON
+    JsonWriter& Raw(std::string_view json);
+
+    template <typename T>
+    JsonWriter& Field(std::string_view key, const T& value) {
+        Key(key);
+        if constexpr (std::is_same_v<T, bool>) {
+            return Bool(value);
+        } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            return Int(value);
+        } else if constexpr (std::is_integral_v<T>) {
+            return Uint(value);
+        } else {
+            return String(value);
+        }
+    }
+
+private:
+    void Separate();
+    JsonWriter& Open(char c);
+    JsonWriter& Close(char c);
+    void Escape(std::string_view value);
+
+    std::string& out_;
+    uint64_t has_items_ = 0;  // bit n: level n already holds a value
+    int depth_ = 0;
+    bool after_key_ = false;
+};
+
+// Pull parser over a complete document. Strings without escapes are
+// returned as views into the input; escaped ones are decoded into a
+// scratch buffer owned by the reader. Nesting is limited to 64 levels.
+class JsonReader {
+public:
+    enum class Token { ObjectStart, ObjectEnd, ArrayStart, ArrayEnd, Key, String, Number, True, False, Null, End, Error };
+
+    explicit JsonReader(std::string_view text) : text_(text) {}
+
+    Token Next();
+    // Key / String: the decoded text, valid until the next token of the
+    // same kind. Number: the literal as written.
+    std::string_view Value() const { return value_; }
+    int Depth() const { return depth_; }
+    // Called on ObjectStart / ArrayStart: moves past the matching end
+    void Skip();
+
+    // Calls on_member(key, reader, token) for each member of a top-level
+    // object, with the reader on the member's value token. Nested values the
+    // callback doesn't read are skipped. False unless text is one
+    // well-formed object.
+    template <typename F>
+    static bool ForEachMember(std::string_view text, F&& on_member) {
+        JsonReader reader(text);
+        if (reader.Next() != Token::ObjectStart) return false;
+        for (;;) {
+            Token token = reader.Next();
+            if (token == Token::ObjectEnd) break;
+            if (token != Token::Key) return false;
+            std::string_view key = reader.Value();
+            token = reader.Next();
+            if (token == Token::Error || token == Token::End) return false;
+            on_member(key, reader, token);
+            if (token == Token::ObjectStart || token == Token::ArrayStart) {
+                while (reader.Depth() > 1) {
+                    if (reader.Next() == Token::Error) return false;
+                }
+            }
+        }
+        return reader.Next() == Token::End;
+    }
+
+private:
+    enum class Expect { Value, KeyOrEnd, Key, ValueOrEnd, CommaOrEnd, Done };
+
+    Token Fail() {
+        expect_ = Expect::Done;
+        failed_ = true;
+        return Token::Error;
+    }
+    Token AfterValue(Token token);
+    bool ReadString(std::string& scratch);
+    void SkipSpace();
+
+    std::string_view text_;
+    size_t pos_ = 0;
+    std::string_view value_;
+    std::string key_scratch_;
+    std::string string_scratch_;
+    uint64_t in_object_ = 0;  // bit n: level n is an object
+    int depth_ = 0;
+    Expect expect_ = Expect::Value;
+    bool failed_ = false;
+};
@@ -0,0 +1,270 @@
+/*
+ * Live heart rate from the OBS plugin through shared memory.
+ *
+ * While OBS runs with the plugin loaded, the newest sample of every stream
+ * sits in a small named segment that any local process can map read-only
+ * and poll as often as it likes: no sockets, no locks, no system calls
+ * after miband_hr_shm_open(). This header is the layout and a header-only
+ * reader; copy it into your project as is (C99 or C++).
+ *
+ *   miband_hr_shm_reader reader;
+ *   if (miband_hr_shm_open(&reader, NULL) == 0) {
+ *       miband_hr_shm_stream s;
+ *       if (miband_hr_shm_read(&reader, 0, &s) == 0 && (s.flags & MIBAND_HR_SHM_CONNECTED))
+ *           printf("%u bpm, %.1f s old\n", s.bpm, (miband_hr_shm_now_ns() - s.timestamp_ns) / 1e9);
+ *       miband_hr_shm_close(&reader);
+ *   }
+ *
+ * The segment is "/miband-hr" under POSIX shared memory (/dev/shm on
+ * Linux) and "Local\miband-hr" on Windows, readable by the user running
+ * OBS. MIBAND_HR_SHM renames it for the plugin; pass the same name here.
+ *
+ * Layout, native byte order, every block on a 64-byte boundary:
+ *
+ *   offset 0     miband_hr_shm_header
+ *   offset 64    miband_hr_shm_stream streams[stream_count]
+ *
+ * Each stream block is a seqlock: the plugin makes `version` odd, writes,
+ * then makes it even again. miband_hr_shm_read() copies a block and
+ * retries until it got one with the same even version on both sides.
+ * Fields are only ever added into reserved space; layout_version changes
+ * when an existing field moves or changes meaning.
+ */
+#ifndef MIBAND_HR_SHM_H
+#define MIBAND_HR_SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MIBAND_HR_SHM_DEFAULT_NAME "miband-hr"
+#define MIBAND_HR_SHM_MAGIC 0x314D48535248424Dull /* "MBHRSHM1" */
+#define MIBAND_HR_SHM_LAYOUT_VERSION 1
+#define MIBAND_HR_SHM_STREAMS 8
+#define MIBAND_HR_SHM_RR_CAPACITY 64
+#define MIBAND_HR_SHM_DEVICE_SIZE 24
+
+/* miband_hr_shm_stream.flags */
+enum {
+    MIBAND_HR_SHM_ACTIVE = 1,            /* a band is assigned to the stream */
+    MIBAND_HR_SHM_CONNECTED = 2,         /* its link is up */
+    MIBAND_HR_SHM_CONTACT_SUPPORTED = 4, /* of the newest sample */
+    MIBAND_HR_SHM_CONTACT_DETECTED = 8,
+};
+
+typedef struct miband_hr_shm_header {
+    uint64_t magic;          /*  0: MIBAND_HR_SHM_MAGIC */
+    uint32_t layout_version; /*  8: MIBAND_HR_SHM_LAYOUT_VERSION */
+    uint32_t header_size;    /* 12: offset of the first stream block */
+    uint32_t stream_size;    /* 16: size of one stream block */
+    uint32_t stream_count;   /* 20 */
+    uint32_t rr_capacity;    /* 24: entries in each stream's rr ring */
+    uint32_t running;        /* 28: 1 while the plugin writes, 0 once it unloaded */
+    uint64_t writer_pid;     /* 32: process id of OBS */
+    uint8_t reserved[24];    /* 40 */
+} miband_hr_shm_header;
+
+typedef struct miband_hr_shm_stream {
+    uint32_t version;        /*  0: seqlock; odd while the plugin writes */
+    uint32_t flags;          /*  4: MIBAND_HR_SHM_* */
+    uint64_t seq;            /*  8: sample number on this stream, 0 = none yet */
+    uint64_t timestamp_ns;   /* 16: when the sample arrived, on miband_hr_shm_now_ns()'s clock */
+    uint16_t bpm;            /* 24 */
+    uint16_t reserved0;      /* 26 */
+    uint32_t reserved1;      /* 28 */
+    uint64_t rr_total;       /* 32: RR intervals written so far; number n is in rr[n % rr_capacity] */
+    char device[MIBAND_HR_SHM_DEVICE_SIZE]; /* 40: device id, NUL-terminated, empty when inactive */
+    uint16_t rr[MIBAND_HR_SHM_RR_CAPACITY]; /* 64: RR intervals in 1/1024 s, oldest overwritten */
+} miband_hr_shm_stream;
+
+typedef struct miband_hr_shm_reader {
+    const miband_hr_shm_header* header;
+    const miband_hr_shm_stream* streams;
+    size_t size;
+#ifdef _WIN32
+    HANDLE mapping;
+#endif
+} miband_hr_shm_reader;
+
+/* Acquire loads without C11 atomics, so the header also builds as C++ */
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#if defined(_M_ARM64) || defined(_M_ARM)
+#define MIBAND_HR_SHM_FENCE_() __dmb(_ARM64_BARRIER_ISH)
+#else
+#define MIBAND_HR_SHM_FENCE_() _ReadWriteBarrier() /* x86 keeps loads in order */
+#endif
+static inline uint32_t miband_hr_shm_load_(const uint32_t* p) {
+    uint32_t value = *(const volatile uint32_t*)p;
+    MIBAND_HR_SHM_FENCE_();
+    return value;
+}
+#else
+#define MIBAND_HR_SHM_FENCE_() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+static inline uint32_t miband_hr_shm_load_(const uint32_t* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+#endif
+
+/* The plugin's timestamp clock: CLOCK_MONOTONIC on Linux, the
+ * performance counter on Windows, CLOCK_UPTIME_RAW on macOS */
+static inline uint64_t miband_hr_shm_now_ns(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000000ull +
+           (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000000ull / (uint64_t)freq.QuadPart;
+#elif defined(__APPLE__)
+    return clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/* Unmaps the segment; the reader may be opened again */
+static inline void miband_hr_shm_close(miband_hr_shm_reader* reader) {
+    if (reader->header) {
+#ifdef _WIN32
+        UnmapViewOfFile(reader->header);
+#else
+        munmap((void*)reader->header, reader->size);
+#endif
+    }
+#ifdef _WIN32
+    if (reader->mapping) CloseHandle(reader->mapping);
+#endif
+    memset(reader, 0, sizeof(*reader));
+}
+
+/* Maps the segment read-only; name NULL means the default. Returns 0 on
+ * success, -1 if there is no segment (OBS or the plugin isn't running) and
+ * -2 if it has a layout this header doesn't know. */
+static inline int miband_hr_shm_open(miband_hr_shm_reader* reader, const char* name) {
+    char path[256];
+    const void* view;
+    size_t size = sizeof(miband_hr_shm_header) + MIBAND_HR_SHM_STREAMS * sizeof(miband_hr_shm_stream);
+    const miband_hr_shm_header* header;
+
+    memset(reader, 0, sizeof(*reader));
+    if (!name) name = MIBAND_HR_SHM_DEFAULT_NAME;
+#ifdef _WIN32
+    {
+        wchar_t wide[256];
+        int length = MultiByteToWideChar(CP_UTF8, 0, "Local\\", -1, wide, 256) - 1;
+        if (length < 0 || !MultiByteToWideChar(CP_UTF8, 0, name, -1, wide + length, 256 - length)) return -1;
+        reader->mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, wide);
+        if (!reader->mapping) return -1;
+        view = MapViewOfFile(reader->mapping, FILE_MAP_READ, 0, 0, size);
+        if (!view) {
+            CloseHandle(reader->mapping);
+            reader->mapping = NULL;
+            return -1;
+        }
+    }
+    (void)path;
+#else
+    {
+        int fd;
+        struct stat st;
+        size_t length = strlen(name);
+        if (length + 2 > sizeof(path)) return -1;
+        path[0] = '/';
+        memcpy(path + 1, name, length + 1);
+        fd = shm_open(path, O_RDONLY, 0);
+        if (fd < 0) return -1;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < size) {
+            close(fd);
+            return -1;
+        }
+        view = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (view == MAP_FAILED) return -1;
+    }
+#endif
+    reader->size = size;
+    reader->header = header = (const miband_hr_shm_header*)view;
+    reader->streams = (const miband_hr_shm_stream*)((const char*)view + sizeof(miband_hr_shm_header));
+    if (header->magic != MIBAND_HR_SHM_MAGIC || header->layout_version != MIBAND_HR_SHM_LAYOUT_VERSION ||
+        header->header_size != sizeof(miband_hr_shm_header) || header->stream_size != sizeof(miband_hr_shm_stream) ||
+        header->stream_count > MIBAND_HR_SHM_STREAMS || header->rr_capacity != MIBAND_HR_SHM_RR_CAPACITY) {
+        miband_hr_shm_close(reader);
+        return -2;
+    }
+    return 0;
+}
+
+/* Whether the plugin still writes. Once it unloads, the mapping stays
+ * valid but frozen; close it and open again to follow the next run. */
+static inline int miband_hr_shm_running(const miband_hr_shm_reader* reader) {
+    return miband_hr_shm_load_(&reader->header->running) == 1;
+}
+
+/* Copies one stream block as a consistent whole. Returns 0 on success, -1
+ * for a stream past stream_count, and 1 if the block stayed mid-write for
+ * 100 ms (the plugin died while writing it). */
+static inline int miband_hr_shm_read(const miband_hr_shm_reader* reader, uint32_t stream, miband_hr_shm_stream* out) {
+    const miband_hr_shm_stream* block;
+    uint64_t deadline = 0;
+    uint32_t attempt;
+    if (stream >= reader->header->stream_count) return -1;
+    block = &reader->streams[stream];
+    for (attempt = 1;; ++attempt) {
+        uint32_t version = miband_hr_shm_load_(&block->version);
+        if (!(version & 1)) {
+            memcpy(out, (const void*)block, sizeof(*out));
+            MIBAND_HR_SHM_FENCE_();
+            if (miband_hr_shm_load_(&block->version) == version) return 0;
+        }
+        /* A write takes well under a microsecond unless the writer was
+         * preempted; only look at the clock once retries pile up */
+        if ((attempt & 1023) == 0) {
+            uint64_t now = miband_hr_shm_now_ns();
+            if (!deadline) deadline = now + 100000000ull;
+            else if (now > deadline) return 1;
+        }
+    }
+}
+
+/* Copies up to max RR intervals newer than *cursor out of a block read
+ * with miband_hr_shm_read(), oldest first, and moves *cursor past them.
+ * Intervals the ring no longer holds are skipped and counted in *lost
+ * when lost is not NULL. Start with *cursor = block.rr_total to receive
+ * only intervals that arrive from then on. */
+static inline uint32_t miband_hr_shm_rr_since(const miband_hr_shm_stream* block, uint64_t* cursor, uint16_t* out,
+                                              uint32_t max, uint64_t* lost) {
+    uint64_t next = *cursor;
+    uint64_t skipped = 0;
+    uint32_t count = 0;
+    if (next > block->rr_total) next = block->rr_total; /* from an earlier run */
+    if (block->rr_total - next > MIBAND_HR_SHM_RR_CAPACITY) {
+        skipped = block->rr_total - MIBAND_HR_SHM_RR_CAPACITY - next;
+        next += skipped;
+    }
+    for (; next < block->rr_total && count < max; ++next) out[count++] = block->rr[next % MIBAND_HR_SHM_RR_CAPACITY];
+    *cursor = next;
+    if (lost) *lost = skipped;
+    return count;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MIBAND_HR_SHM_H */
@@ -1,42 +1,873 @@
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <winsock2.h>
+#endif
 #include <obs-module.h>
 #include <obs-frontend-api.h>
 #include <util/platform.h>
 #include <util/dstr.h>
 #include "ble-manager.hpp"
+#include "sample-ring.hpp"
+#ifdef _WIN32
 #include <windows.h>
 #include <shellapi.h>
+#endif
 #include <thread>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
+#include <future>
+#include <stop_token>
 #include <vector>
+#include <unordered_map>
+#include <algorithm>
 #include <string>
+#include <cstring>
 #include <sstream>
-#include <fstream>
 #include "httplib.h"
+#include "websocket.hpp"
+#include "asset-cache.hpp"
+#include "web-assets.hpp"
+#include "json.hpp"
+#include "hr-broadcast.hpp"
+#include "hr-shm.hpp"
+#if defined(__linux__)
+#include "epoll-server.hpp"
+#endif
 
 OBS_DECLARE_MODULE()
 OBS_MODULE_USE_DEFAULT_LOCALE("miband-heart-rate", "en-US")
 
 // Globals
 static std::shared_ptr<BleManager> g_ble;
-static std::unique_ptr<httplib::Server> g_server;
+static std::unique_ptr<WebSocketServer> g_server;
 static std::thread g_server_thread;
-static std::atomic<int> g_latest_hr{-1};
+static std::future<void> g_server_done;  // ready once listen() has returned
 static std::string g_web_dir;
+static std::shared_ptr<AssetCache> g_assets;  // overrides under g_web_dir; the routes hold references too
 static std::string g_theme = "default";
-static std::string g_last_device_id = "";
+// Bands to reconnect at startup, in the order they were connected
+struct SavedDevice {
+    std::string id;
+    std::string mode;  // "gatt" or "advertisement"
+};
+static std::vector<SavedDevice> g_saved_devices;
+static std::string g_ingest_mode = "gatt";  // last mode picked in the settings page
 static std::string g_config_path;
+static std::mutex g_config_mutex;
+
+// /api/state change counters, one per part. The ETag is built from them, so
+// an unchanged part costs a compare instead of a rebuild.
+static std::string g_theme_json;  // {"theme", "ingest_mode"} as served; under g_config_mutex
+static std::atomic<uint64_t> g_theme_version{0};
+static std::atomic<uint64_t> g_devices_version{0};  // bands connected / disconnected
 
 static std::mutex g_scan_mutex;
-static std::vector<BleDevice> g_found_devices;
+static std::vector<BleDevice> g_found_devices;  // in discovery order
+static std::unordered_map<std::string, size_t> g_found_index;  // id -> g_found_devices slot
 static bool g_scanning = false;
+// Ends a scan after SCAN_DURATION; cancelled through its stop_token on unload
+static std::jthread g_scan_timer;
+static std::condition_variable_any g_scan_cv;
+static std::chrono::steady_clock::time_point g_scan_deadline;
+static const auto SCAN_DURATION = std::chrono::seconds(10);
+
+// Everything in obs_module_unload shares this budget
+static const auto UNLOAD_DEADLINE = std::chrono::seconds(3);
+
+static std::atomic<int> g_server_port{0};
+
+// Heart rate history, one ring per stream id. The BLE callback is the only
+// producer (BleManager serialises it); HTTP handlers read by sequence
+// number and never block it. Samples from earlier sessions stay in the
+// ring; their session tells them apart.
+static SampleRing<HeartRateSample, 1024> g_samples[kMaxStreams];
+// Every sample again, encoded once for all push subscribers. A subscriber
+// replays what it needs from g_samples on joining and follows this after.
+static HrBroadcaster g_hr_events;
+// Events an SSE or WebSocket client may fall behind before the oldest go
+static const size_t HR_STREAM_QUEUE = 256;
+// The newest sample per stream for local processes, outside HTTP
+static HrSharedMemory g_hr_shm;
 
-static int g_server_port = 0;
+// Wakes HR writers: bumped for every sample and every connection change,
+// so streams sleep instead of polling the rings. The server's Stream()
+// routes are woken through g_hr_waker, which unload clears (under the
+// mutex) before the server goes away.
+static std::mutex g_hr_notify_mutex;
+static std::condition_variable g_hr_notify_cv;
+static uint64_t g_hr_notify_version = 0;
+static bool g_hr_streams_closing = false;
+static WebSocketServer* g_hr_waker = nullptr;
+static const auto HR_STREAM_HEARTBEAT = std::chrono::seconds(15);
+
+static void notify_hr() {
+    {
+        std::lock_guard<std::mutex> lock(g_hr_notify_mutex);
+        ++g_hr_notify_version;
+        if (g_hr_waker) g_hr_waker->Wake();
+    }
+    g_hr_notify_cv.notify_all();
+}
+
+static bool hr_streams_closing() {
+    std::lock_guard<std::mutex> lock(g_hr_notify_mutex);
+    return g_hr_streams_closing;
+}
+
+// Called for every connect / disconnect, so it also moves the device list version
+static void invalidate_hr(uint32_t stream_id) {
+    if (stream_id < kMaxStreams) {
+        std::string device;
+        if (g_ble) {
+            for (const auto& stream : g_ble->GetStreams()) {
+                if (stream.stream_id == stream_id) device = stream.device_id;
+            }
+        }
+        g_hr_shm.SetDevice(stream_id, device, g_ble && g_ble->IsConnected(stream_id));
+    }
+    ++g_devices_version;
+    notify_hr();
+}
 
 static void save_config();
 
+// hr is -1 unless the sample is from the stream's current session and its
+// band is connected; both come from one snapshot
+static int sample_hr(uint32_t stream_id, const HeartRateSample& sample) {
+    if (stream_id >= kMaxStreams || !g_ble) return -1;
+    StreamSnapshot snapshot = g_ble->GetSnapshot(stream_id);
+    return snapshot.connected && sample.session == snapshot.session ? sample.measurement.bpm : -1;
+}
+
+static const std::string kJsonMime = "application/json";
+
+// Response bodies are built in a per-thread buffer, so a server thread
+// reuses one allocation from request to request. One per handler.
+static std::string& json_buffer() {
+    thread_local std::string buffer;
+    buffer.clear();
+    return buffer;
+}
+
+// {"status": "<status>"}, the answer of the action endpoints
+static void set_status_json(httplib::Response& res, std::string_view status) {
+    std::string& json = json_buffer();
+    JsonWriter(json).BeginObject().Field("status", status).EndObject();
+    res.set_content(json.data(), json.size(), kJsonMime);
+}
+
+// One reading. seq is the stream's ring position (stable across
+// reconnects); ble_seq and the timestamps come straight from the BLE layer.
+static void write_sample_fields(JsonWriter& w, uint32_t stream_id, const std::string& device, uint64_t seq,
+                                const HeartRateSample& sample, int hr) {
+    w.Field("device", device)
+        .Field("stream", stream_id < kMaxStreams ? (int)stream_id : -1)
+        .Field("hr", hr)
+        .Field("seq", seq)
+        .Field("ble_seq", sample.seq)
+        .Field("notify_ts_ns", sample.notify_timestamp_ns)
+        .Field("receive_ts_ns", sample.receive_timestamp_ns);
+    w.Key("rr").BeginArray();
+    for (uint8_t i = 0; i < sample.measurement.rr_count; ++i) w.Uint(sample.measurement.rr_intervals[i]);
+    w.EndArray();
+}
+
+static void write_sample_json(JsonWriter& w, uint32_t stream_id, const std::string& device, uint64_t seq,
+                              const HeartRateSample& sample, int hr) {
+    w.BeginObject();
+    write_sample_fields(w, stream_id, device, seq, sample, hr);
+    w.EndObject();
+}
+
+// A stream's latest reading as one consistent whole
+struct HrReading {
+    uint64_t seq = 0;          // ring position
+    HeartRateSample sample;    // as in the snapshot; rr only if the ring still agreed
+    int hr = -1;
+};
+
+// The snapshot decides hr and the connection. The ring's newest sample is
+// taken whole when it is the snapshot's; the dispatcher writes the snapshot
+// first, so a sample landing between the two reads shows as a mismatch and
+// is read again. If they keep moving, or the session has no sample yet,
+// only the snapshot's fields are reported.
+static HrReading read_hr(uint32_t stream_id) {
+    HrReading reading;
+    if (stream_id >= kMaxStreams || !g_ble) return reading;
+    const auto& ring = g_samples[stream_id];
+    StreamSnapshot snapshot;
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        reading.seq = ring.ReadLatest(reading.sample);
+        snapshot = g_ble->GetSnapshot(stream_id);
+        if (snapshot.seq == 0) break;
+        if (reading.sample.seq == snapshot.seq && reading.sample.session == snapshot.session) {
+            reading.hr = snapshot.connected ? snapshot.bpm : -1;
+            return reading;
+        }
+    }
+    reading.sample = {};
+    reading.sample.stream_id = stream_id;
+    reading.sample.session = snapshot.session;
+    reading.sample.seq = snapshot.seq;
+    reading.sample.receive_timestamp_ns = snapshot.receive_timestamp_ns;
+    reading.sample.measurement.bpm = snapshot.bpm;
+    reading.hr = snapshot.connected && snapshot.seq != 0 ? snapshot.bpm : -1;
+    return reading;
+}
+
+// Latest reading for one stream, as the members of an object the caller
+// opened
+static void write_hr_fields(JsonWriter& w, uint32_t stream_id, const std::string& device,
+                            const HrReading& reading) {
+    write_sample_fields(w, stream_id, device, reading.seq, reading.sample, reading.hr);
+}
+
+static void write_hr_fields(JsonWriter& w, uint32_t stream_id, const std::string& device) {
+    write_hr_fields(w, stream_id, device, read_hr(stream_id));
+}
+
+static void write_hr_json(JsonWriter& w, uint32_t stream_id, const std::string& device,
+                          const HrReading& reading) {
+    w.BeginObject();
+    write_hr_fields(w, stream_id, device, reading);
+    w.EndObject();
+}
+
+static void write_hr_json(JsonWriter& w, uint32_t stream_id, const std::string& device) {
+    write_hr_json(w, stream_id, device, read_hr(stream_id));
+}
+
+// This thread's copy of the stream table, read under the sessions lock only
+// when the manager's table has changed since. The reference is good until
+// the next call on the same thread.
+static const std::vector<StreamInfo>& cached_streams() {
+    thread_local std::vector<StreamInfo> streams;
+    thread_local const BleManager* owner = nullptr;
+    thread_local uint64_t version = 0;
+    uint64_t current = g_ble->StreamsVersion();
+    if (owner != g_ble.get() || version != current) {
+        owner = g_ble.get();
+        version = current;
+        streams = g_ble->GetStreams();
+    }
+    return streams;
+}
+
+// The stream an HR endpoint follows: the band named by ?device=, or the
+// first connected one, which is what single-band overlays expect
+static uint32_t find_hr_stream(const std::string& wanted, std::string& device) {
+    device.clear();
+    if (!g_ble) return kInvalidStream;
+    for (const auto& stream : cached_streams()) {
+        if (wanted.empty() || stream.device_id == wanted) {
+            device = stream.device_id;
+            return stream.stream_id;
+        }
+    }
+    return kInvalidStream;
+}
+
+// Long-poll bounds for /api/hr?since=
+static const int HR_LONG_POLL_DEFAULT_MS = 20000;
+static const int HR_LONG_POLL_MAX_MS = 30000;
+
+// Connected with a sample from the current session, from one snapshot
+static bool hr_valid_now(uint32_t stream_id) {
+    if (stream_id >= kMaxStreams || !g_ble) return false;
+    StreamSnapshot snapshot = g_ble->GetSnapshot(stream_id);
+    return snapshot.connected && snapshot.seq != 0;
+}
+
+// One waiting /api/hr?since= request. It is answered once the followed
+// stream has a sample newer than since, its band connects or drops, the
+// deadline passes (checked at least once a second) or the server is
+// closing. The stream is resolved again on every poll; a band may connect
+// meanwhile.
+struct HrLongPoll {
+    std::string wanted;
+    uint64_t since = 0;
+    std::chrono::steady_clock::time_point deadline;
+    uint32_t stream_id = kInvalidStream;
+    std::string device;
+    bool valid = false;
+    // Samples arriving while it waits, already encoded; only set once it does
+    std::unique_ptr<HrBroadcaster::Subscription> feed;
+};
+
+static bool hr_long_poll_ready(HrLongPoll& lp) {
+    if (hr_streams_closing() || std::chrono::steady_clock::now() >= lp.deadline) return true;
+    std::string device;
+    uint32_t current = find_hr_stream(lp.wanted, device);
+    if (current != lp.stream_id) {
+        lp.stream_id = current;
+        lp.device = device;
+        return true;
+    }
+    // A since past the head is from another session; answer right away
+    if (lp.stream_id < kMaxStreams && g_samples[lp.stream_id].Head() != lp.since) return true;
+    return hr_valid_now(lp.stream_id) != lp.valid;
+}
+
+// Latest reading first, so plain /api/hr clients can read it unchanged.
+// The ring decides which samples are listed; those broadcast while the
+// request waited are copied in as encoded.
+static void write_hr_long_poll(const HrLongPoll& lp, std::string& json) {
+    std::vector<HrEventPtr> events;
+    if (lp.feed) lp.feed->Take(events);
+    auto event = events.begin();
+
+    JsonWriter w(json);
+    w.BeginObject();
+    write_hr_fields(w, lp.stream_id, lp.device);
+    w.Key("samples").BeginArray();
+    uint64_t dropped = 0;
+    if (lp.stream_id < kMaxStreams) {
+        const auto& ring = g_samples[lp.stream_id];
+        ring.ReadSince(lp.since < ring.Head() ? lp.since : ring.Head(), [&](uint64_t seq, const HeartRateSample& sample) {
+            while (event != events.end() && ((*event)->stream_id != lp.stream_id || (*event)->seq < seq)) ++event;
+            if (event != events.end() && (*event)->seq == seq) {
+                w.Raw((*event)->Json());
+            } else {
+                write_sample_json(w, lp.stream_id, lp.device, seq, sample, sample_hr(lp.stream_id, sample));
+            }
+        }, &dropped);
+    }
+    w.EndArray().Field("dropped", dropped).EndObject();
+}
+
+// The theme as served, with the version it belongs to
+static uint64_t read_theme(std::string& json) {
+    std::lock_guard<std::mutex> lock(g_config_mutex);
+    json = g_theme_json;
+    return g_theme_version;
+}
+
+// ?on_change=1&min_interval_ms=<ms>&max_rate=<per second>&keepalive_ms=<ms>
+static HrPolicy parse_hr_policy(const httplib::Request& req) {
+    HrPolicy policy;
+    std::string on_change = req.get_param_value("on_change");
+    policy.on_change = on_change == "1" || on_change == "true";
+    policy.min_interval_ms = (uint32_t)strtoul(req.get_param_value("min_interval_ms").c_str(), nullptr, 10);
+    policy.keepalive_ms = (uint32_t)strtoul(req.get_param_value("keepalive_ms").c_str(), nullptr, 10);
+    if (req.has_param("max_rate")) policy.LimitRate(strtod(req.get_param_value("max_rate").c_str(), nullptr));
+    return policy;
+}
+
+// One /api/hr/stream subscriber. Events carry the ring sequence as their
+// id, so a reconnecting EventSource resumes from Last-Event-ID with
+// whatever the ring still holds. A throttled subscriber (see HrPolicy)
+// skips the backlog and gets samples as its policy lets them through.
+
+struct HrStream {
+    std::string wanted;
+    uint32_t stream_id = kInvalidStream;
+    std::string device;
+    uint64_t last_seq = 0;
+    bool resume = false;
+    int last_hr = -2;  // last hr sent; -2 forces the first event
+    uint64_t theme_version = 0;  // last theme sent; 0 = none yet
+    std::chrono::steady_clock::time_point last_write;
+    std::string theme;
+    uint64_t devices_version = UINT64_MAX;  // g_devices_version stream_id was resolved at
+    bool caught_up = false;  // replayed the ring; follows g_hr_events from here
+    HrBroadcaster::Subscription feed{ g_hr_events, "sse", HR_STREAM_QUEUE };
+    std::vector<HrEventPtr> batch;
+    HrThrottle throttle;
+};
+
+static void write_hr_event(HrStream& hs, std::string& out, uint64_t seq, const HeartRateSample& sample, int hr) {
+    // Status-only events carry no id so they don't move the resume point
+    if (seq > hs.last_seq) {
+        out += "id: ";
+        JsonWriter(out).Uint(seq);
+        out += "\n";
+    }
+    out += "data: ";
+    JsonWriter w(out);
+    write_sample_json(w, hs.stream_id, hs.device, seq, sample, hr);
+    out += "\n\n";
+    if (seq > hs.last_seq) hs.last_seq = seq;
+    hs.last_hr = hr;
+}
+
+// Appends whatever is new for the subscriber. Returning false ends the
+// stream.
+static bool poll_hr_stream(HrStream& hs, std::string& out) {
+    if (hr_streams_closing()) return false;
+
+    // Which band answers only changes with the device list
+    uint64_t devices_version = g_devices_version;
+    if (devices_version != hs.devices_version) {
+        hs.devices_version = devices_version;
+        std::string device;
+        uint32_t stream_id = find_hr_stream(hs.wanted, device);
+        if (stream_id != hs.stream_id || device != hs.device) {
+            // Another band now answers; its ring has its own sequence
+            hs.stream_id = stream_id;
+            hs.device = device;
+            if (!hs.resume) hs.last_seq = 0;
+            hs.last_hr = -2;
+            hs.caught_up = false;
+            hs.throttle.Reset();
+        }
+    }
+    hs.resume = false;
+    bool throttled = hs.throttle.Policy().Active();
+
+    // Joining: whatever the ring holds after last_seq, encoded for this
+    // subscriber alone. The cursor moves first, so a sample published
+    // meanwhile comes from both and is skipped by its seq.
+    if (!hs.caught_up) {
+        hs.feed.SkipToHead();
+        if (hs.stream_id < kMaxStreams) {
+            const auto& ring = g_samples[hs.stream_id];
+            uint64_t head = ring.Head();
+            // A fresh subscriber (or an id from an earlier session) starts at the newest
+            // sample; so does a throttled one, which wants no backlog
+            if (hs.last_seq == 0 || hs.last_seq > head || (throttled && head > 0 && hs.last_seq < head - 1)) {
+                hs.last_seq = head > 0 ? head - 1 : 0;
+            }
+            ring.ReadSince(hs.last_seq, [&](uint64_t seq, const HeartRateSample& sample) {
+                int hr = sample_hr(hs.stream_id, sample);
+                write_hr_event(hs, out, seq, sample, hr);
+                hs.throttle.Sent(seq, hr, os_gettime_ns());
+            });
+        }
+        hs.caught_up = true;
+    }
+    hs.batch.clear();
+    hs.feed.Take(hs.batch);
+    for (const HrEventPtr& event : hs.batch) {
+        if (event->stream_id != hs.stream_id || event->seq <= hs.last_seq) continue;
+        if (throttled) {
+            hs.throttle.Offer(event);
+            continue;
+        }
+        out += event->sse;
+        hs.last_seq = event->seq;
+        hs.last_hr = event->hr;
+    }
+    hs.batch.clear();  // don't pin the buffers until the next poll
+    if (throttled) {
+        // A sample held back for its interval goes out on a later poll
+        HrEventPtr event = hs.throttle.Due(os_gettime_ns());
+        if (event && event->seq > hs.last_seq) {
+            out += event->sse;
+            hs.last_seq = event->seq;
+            hs.last_hr = event->hr;
+        }
+    }
+    if (out.empty()) {
+        // Nothing new, but tell the overlay when the band goes away or comes back
+        HrReading reading = read_hr(hs.stream_id);
+        if (hs.last_hr == -2 || (reading.hr < 0) != (hs.last_hr < 0)) {
+            write_hr_event(hs, out, reading.seq, reading.sample, reading.hr);
+        }
+    }
+
+    // Named event, so plain onmessage consumers never see it
+    if (g_theme_version != hs.theme_version) {
+        hs.theme_version = read_theme(hs.theme);
+        out += "event: theme\ndata: ";
+        JsonWriter(out).BeginObject().Field("version", hs.theme_version).Key("theme").Raw(hs.theme).EndObject();
+        out += "\n\n";
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (out.empty() && now - hs.last_write >= HR_STREAM_HEARTBEAT) out = ": ping\n\n";
+    if (!out.empty()) hs.last_write = now;
+    return true;
+}
+
+// /api/ws pushes one binary frame per event, little-endian:
+//   sample: u8 type=1, u8 stream, u8 flags, u8 rr_count, u64 seq,
+//           u64 timestamp_ns, u16 bpm, u16 rr[rr_count] (1/1024 s)
+//   status: u8 type=2, u8 stream, u8 connected, u8 reserved
+// Sample flags: bit0 bpm valid (band connected), bit1 contact supported,
+// bit2 contact detected, bit3 RR list truncated. Text frames carry the
+// JSON control messages and theme changes.
+enum : uint8_t { HR_FRAME_SAMPLE = 1, HR_FRAME_STATUS = 2 };
+enum : uint32_t { HR_EVENT_SAMPLE = 1, HR_EVENT_STATUS = 2, HR_EVENT_THEME = 4, HR_EVENT_ALL = 7 };
+
+// Subscription state of one /api/ws client. The reader thread edits the
+// subscription; the sender thread owns the rest.
+struct HrSocket {
+    std::mutex mutex;
+    bool all_devices = false;
+    std::vector<std::string> devices;
+    uint32_t events = 0;
+    HrPolicy policy;
+
+    bool subscribed[kMaxStreams] = {};
+    std::string stream_devices[kMaxStreams];
+    uint64_t last_seq[kMaxStreams] = {};
+    int last_connected[kMaxStreams] = {};
+    uint64_t theme_version = 0;
+    HrBroadcaster::Subscription feed{ g_hr_events, "ws", HR_STREAM_QUEUE };
+    std::vector<HrEventPtr> batch;
+    HrThrottle throttle[kMaxStreams];
+};
+
+static void put_le(std::string& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) out.push_back((char)(value >> (i * 8)));
+}
+
+static void encode_hr_sample_frame(std::string& frame, uint32_t stream_id, uint64_t seq,
+                                   const HeartRateSample& sample, int hr) {
+    const HeartRateMeasurement& m = sample.measurement;
+    frame.reserve(frame.size() + 22 + 2 * m.rr_count);
+    frame.push_back((char)HR_FRAME_SAMPLE);
+    frame.push_back((char)stream_id);
+    frame.push_back((char)((hr >= 0 ? 0x01 : 0) | (m.contact_supported ? 0x02 : 0) |
+                           (m.contact_detected ? 0x04 : 0) | (m.rr_truncated ? 0x08 : 0)));
+    frame.push_back((char)m.rr_count);
+    put_le(frame, seq, 8);
+    put_le(frame, sample.notify_timestamp_ns ? sample.notify_timestamp_ns : sample.receive_timestamp_ns, 8);
+    put_le(frame, hr >= 0 ? (uint64_t)hr : 0, 2);
+    for (uint8_t i = 0; i < m.rr_count; ++i) put_le(frame, m.rr_intervals[i], 2);
+}
+
+// Encodes a new sample for every push format and hands it to the
+// subscribers; nothing to do while there are none. Runs on the BLE
+// dispatcher, once per sample.
+static void broadcast_hr_sample(uint64_t seq, const HeartRateSample& sample) {
+    if (!g_hr_events.HasSubscribers()) return;
+    uint32_t stream_id = sample.stream_id;
+
+    // Device ids by stream, looked up again only when the device list changes
+    thread_local std::string devices[kMaxStreams];
+    thread_local uint64_t devices_version = UINT64_MAX;
+    uint64_t version = g_devices_version;
+    if (version != devices_version) {
+        devices_version = version;
+        for (auto& device : devices) device.clear();
+        for (const auto& stream : g_ble->GetStreams()) {
+            if (stream.stream_id < kMaxStreams) devices[stream.stream_id] = stream.device_id;
+        }
+    }
+    const std::string& device = devices[stream_id];
+    int hr = sample_hr(stream_id, sample);
+
+    auto event = std::make_shared<HrEvent>();
+    event->stream_id = stream_id;
+    event->seq = seq;
+    event->hr = hr;
+    std::string& sse = event->sse;
+    sse += "id: ";
+    JsonWriter(sse).Uint(seq);
+    sse += "\ndata: ";
+    event->json_offset = sse.size();
+    JsonWriter w(sse);
+    write_sample_json(w, stream_id, device, seq, sample, hr);
+    event->json_size = sse.size() - event->json_offset;
+    sse += "\n\n";
+
+    thread_local std::string payload;
+    payload.clear();
+    encode_hr_sample_frame(payload, stream_id, seq, sample, hr);
+    WebSocket::EncodeFrame(event->ws_frame, WebSocket::Opcode::Binary, payload.data(), payload.size());
+    g_hr_events.Publish(std::move(event));
+}
+
+// Sender half of an /api/ws connection: wakes on every sample like the SSE
+// stream and writes what the subscription asks for. A newly followed
+// stream starts with its newest sample from the ring; after that, samples
+// are the broadcast frames.
+static void run_hr_socket_sender(HrSocket& hs, WebSocket& ws) {
+    std::string text, theme, frame;  // reused for every frame built here
+    while (ws.IsOpen()) {
+        uint64_t version;
+        {
+            std::lock_guard<std::mutex> lock(g_hr_notify_mutex);
+            if (g_hr_streams_closing) return;
+            version = g_hr_notify_version;
+        }
+
+        std::vector<StreamInfo> streams;
+        if (g_ble) streams = g_ble->GetStreams();
+        std::string table[kMaxStreams];
+        for (const auto& stream : streams) table[stream.stream_id] = stream.device_id;
+
+        bool wanted[kMaxStreams] = {};
+        uint32_t events;
+        HrPolicy policy;
+        {
+            std::lock_guard<std::mutex> lock(hs.mutex);
+            events = hs.events;
+            policy = hs.policy;
+            for (uint32_t i = 0; i < kMaxStreams; ++i) {
+                if (table[i].empty()) continue;
+                wanted[i] = hs.all_devices ||
+                            std::find(hs.devices.begin(), hs.devices.end(), table[i]) != hs.devices.end();
+            }
+        }
+
+        bool table_changed = false;
+        for (uint32_t i = 0; i < kMaxStreams; ++i) {
+            if (table[i] != hs.stream_devices[i]) {
+                hs.stream_devices[i] = table[i];
+                table_changed = true;
+                hs.subscribed[i] = false;
+            }
+            if (wanted[i] && !hs.subscribed[i]) {
+                // Newly followed: start from the newest sample
+                hs.last_seq[i] = 0;
+                hs.last_connected[i] = -1;
+                hs.throttle[i].Reset();
+            }
+            hs.subscribed[i] = wanted[i];
+            hs.throttle[i].SetPolicy(policy);
+        }
+        if (table_changed) {
+            text.clear();
+            JsonWriter w(text);
+            w.BeginObject().Field("op", "streams").Key("streams").BeginArray();
+            for (const auto& stream : streams) {
+                w.BeginObject().Field("stream", stream.stream_id).Field("device", stream.device_id).EndObject();
+            }
+            w.EndArray().EndObject();
+            ws.SendText(text);
+        }
+
+        // Sent on subscribing and after every POST /api/theme
+        if (!(events & HR_EVENT_THEME)) {
+            hs.theme_version = 0;
+        } else if (g_theme_version != hs.theme_version) {
+            hs.theme_version = read_theme(theme);
+            text.clear();
+            JsonWriter(text)
+                .BeginObject()
+                .Field("op", "theme")
+                .Field("version", hs.theme_version)
+                .Key("theme")
+                .Raw(theme)
+                .EndObject();
+            ws.SendText(text);
+        }
+
+        // Taken before the ring is read, so a sample can't slip between the two
+        hs.batch.clear();
+        hs.feed.Take(hs.batch);
+        for (uint32_t i = 0; i < kMaxStreams; ++i) {
+            if (!hs.subscribed[i]) continue;
+            bool connected = g_ble && g_ble->IsConnected(i);
+            if ((events & HR_EVENT_STATUS) && (int)connected != hs.last_connected[i]) {
+                uint8_t status[4] = { HR_FRAME_STATUS, (uint8_t)i, (uint8_t)connected, 0 };
+                ws.SendBinary(status, sizeof(status));
+            }
+            hs.last_connected[i] = connected;
+
+            if (!(events & HR_EVENT_SAMPLE)) continue;
+            const auto& ring = g_samples[i];
+            uint64_t head = ring.Head();
+            if (hs.last_seq[i] == 0 || hs.last_seq[i] > head) {
+                hs.last_seq[i] = head > 0 ? head - 1 : 0;
+                hs.last_seq[i] = ring.ReadSince(hs.last_seq[i], [&](uint64_t seq, const HeartRateSample& sample) {
+                    int hr = sample_hr(i, sample);
+                    frame.clear();
+                    encode_hr_sample_frame(frame, i, seq, sample, hr);
+                    ws.SendBinary(frame.data(), frame.size());
+                    hs.throttle[i].Sent(seq, hr, os_gettime_ns());
+                });
+            }
+        }
+        if (events & HR_EVENT_SAMPLE) {
+            bool throttled = policy.Active();
+            for (const HrEventPtr& event : hs.batch) {
+                uint32_t i = event->stream_id;
+                if (i >= kMaxStreams || !hs.subscribed[i] || event->seq <= hs.last_seq[i]) continue;
+                if (throttled) {
+                    hs.throttle[i].Offer(event);
+                    continue;
+                }
+                ws.SendEncoded(event->ws_frame);
+                hs.last_seq[i] = event->seq;
+            }
+            for (uint32_t i = 0; throttled && i < kMaxStreams; ++i) {
+                if (!hs.subscribed[i]) continue;
+                HrEventPtr event = hs.throttle[i].Due(os_gettime_ns());
+                if (!event || event->seq <= hs.last_seq[i]) continue;
+                ws.SendEncoded(event->ws_frame);
+                hs.last_seq[i] = event->seq;
+            }
+        }
+        hs.batch.clear();
+
+        std::unique_lock<std::mutex> lock(g_hr_notify_mutex);
+        g_hr_notify_cv.wait_for(lock, std::chrono::seconds(1),
+                                [version]() { return g_hr_notify_version != version || g_hr_streams_closing; });
+    }
+}
+
+static uint32_t parse_hr_events(const std::string& list) {
+    if (list.empty()) return HR_EVENT_ALL;
+    uint32_t events = 0;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item == "hr") events |= HR_EVENT_SAMPLE;
+        if (item == "status") events |= HR_EVENT_STATUS;
+        if (item == "theme") events |= HR_EVENT_THEME;
+    }
+    return events;
+}
+
+static void send_socket_error(WebSocket& ws, std::string_view message) {
+    std::string& json = json_buffer();
+    JsonWriter(json).BeginObject().Field("op", "error").Field("message", message).EndObject();
+    ws.SendText(json);
+}
+
+// Client messages: {"op": "subscribe" | "unsubscribe", "device": "<id>",
+// "events": "hr,status,theme"}. A missing device or events field means all.
+// A subscribe may also set the socket's sample policy with "on_change",
+// "min_interval_ms", "max_rate" and "keepalive_ms", as on /api/hr/stream.
+static void handle_hr_socket_message(HrSocket& hs, WebSocket& ws, const std::string& message) {
+    std::string op, device, events_list;
+    HrPolicy policy;
+    bool has_policy = false;
+    bool parsed = JsonReader::ForEachMember(message, [&](std::string_view key, JsonReader& reader,
+                                                         JsonReader::Token token) {
+        if (token == JsonReader::Token::True || token == JsonReader::Token::False) {
+            if (key == "on_change") {
+                policy.on_change = token == JsonReader::Token::True;
+                has_policy = true;
+            }
+            return;
+        }
+        if (token == JsonReader::Token::Number) {
+            double value = strtod(std::string(reader.Value()).c_str(), nullptr);
+            uint32_t ms = value > 0 ? (uint32_t)std::min(value, (double)UINT32_MAX) : 0;
+            if (key == "min_interval_ms") policy.min_interval_ms = ms;
+            else if (key == "keepalive_ms") policy.keepalive_ms = ms;
+            else if (key == "max_rate") policy.LimitRate(value);
+            else return;
+            has_policy = true;
+            return;
+        }
+        if (token != JsonReader::Token::String) return;
+        if (key == "op") op = reader.Value();
+        if (key == "device") device = reader.Value();
+        if (key == "events") events_list = reader.Value();
+    });
+    if (!parsed) {
+        send_socket_error(ws, "invalid JSON");
+        return;
+    }
+    // Device ids are decimal addresses; anything else can't match and isn't echoed
+    if (device.find_first_not_of("0123456789") != std::string::npos) {
+        send_socket_error(ws, "bad device id");
+        return;
+    }
+    uint32_t events = parse_hr_events(events_list);
+
+    std::string& reply = json_buffer();
+    {
+        std::lock_guard<std::mutex> lock(hs.mutex);
+        if (op == "subscribe") {
+            if (device.empty()) {
+                hs.all_devices = true;
+            } else if (std::find(hs.devices.begin(), hs.devices.end(), device) == hs.devices.end()) {
+                hs.devices.push_back(device);
+            }
+            hs.events |= events;
+            if (has_policy) hs.policy = policy;
+        } else if (op == "unsubscribe") {
+            if (device.empty()) {
+                hs.all_devices = false;
+                hs.devices.clear();
+                if (!events_list.empty()) hs.events &= ~events;
+            } else {
+                hs.devices.erase(std::remove(hs.devices.begin(), hs.devices.end(), device), hs.devices.end());
+            }
+        } else {
+            send_socket_error(ws, "unknown op");
+            return;
+        }
+        JsonWriter w(reply);
+        w.BeginObject().Field("op", "subscribed").Field("all", hs.all_devices).Key("devices").BeginArray();
+        for (const auto& id : hs.devices) w.String(id);
+        w.EndArray();
+        std::string names;
+        if (hs.events & HR_EVENT_SAMPLE) names += ",hr";
+        if (hs.events & HR_EVENT_STATUS) names += ",status";
+        if (hs.events & HR_EVENT_THEME) names += ",theme";
+        w.Field("events", names.empty() ? names : names.substr(1));
+        if (hs.policy.Active()) {
+            w.Key("policy")
+                .BeginObject()
+                .Field("on_change", hs.policy.on_change)
+                .Field("min_interval_ms", hs.policy.min_interval_ms)
+                .Field("keepalive_ms", hs.policy.keepalive_ms)
+                .EndObject();
+        }
+        w.EndObject();
+    }
+    ws.SendText(reply);
+    notify_hr();
+}
+
+static void write_reconnect_json(JsonWriter& w, const ReconnectStats& rs) {
+    w.BeginObject()
+        .Field("disconnects", rs.disconnects)
+        .Field("attempts", rs.attempts)
+        .Field("reconnects", rs.reconnects)
+        .Field("last_ms", rs.last_reconnect_ms)
+        .Field("max_ms", rs.max_reconnect_ms)
+        .Field("avg_ms", rs.reconnects ? rs.total_reconnect_ms / rs.reconnects : 0)
+        .EndObject();
+}
+
+static IngestMode parse_ingest_mode(const std::string& mode) {
+    return mode == "advertisement" ? IngestMode::Advertisement : IngestMode::Gatt;
+}
+
+// Re-serialises the theme once per change instead of once per request.
+// Caller holds g_config_mutex (taken before g_hr_notify_mutex, never after).
+static void theme_changed() {
+    g_theme_json.clear();
+    JsonWriter(g_theme_json).BeginObject().Field("theme", g_theme).Field("ingest_mode", g_ingest_mode).EndObject();
+    ++g_theme_version;
+    // Live streams push it on their next wake
+    notify_hr();
+}
+
+// True if an Accept-Encoding header allows coding (q=0 means refused)
+static bool accepts_encoding(const std::string& header, const char* coding) {
+    std::stringstream ss(header);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        size_t start = item.find_first_not_of(" \t");
+        if (start == std::string::npos) continue;
+        size_t end = item.find_first_of(" \t;", start);
+        if (item.compare(start, end == std::string::npos ? std::string::npos : end - start, coding) != 0) continue;
+        size_t q = item.find("q=", end == std::string::npos ? item.size() : end);
+        return q == std::string::npos || strtod(item.c_str() + q + 2, nullptr) > 0;
+    }
+    return false;
+}
+
+// True if If-None-Match lists etag or is "*". The comparison is weak (a
+// W/ prefix on either side is ignored) and each entry must match whole.
+static bool etag_matches(const httplib::Request& req, std::string_view etag) {
+    auto opaque = [](std::string_view tag) { return tag.starts_with("W/") ? tag.substr(2) : tag; };
+    etag = opaque(etag);
+    size_t count = req.get_header_value_count("If-None-Match");
+    for (size_t i = 0; i < count; ++i) {
+        std::stringstream ss(req.get_header_value("If-None-Match", "", i));
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            size_t start = item.find_first_not_of(" \t");
+            if (start == std::string::npos) continue;
+            size_t end = item.find_last_not_of(" \t");
+            std::string_view tag = std::string_view(item).substr(start, end - start + 1);
+            if (tag == "*" || opaque(tag) == etag) return true;
+        }
+    }
+    return false;
+}
+
 static void load_config() {
     char* path = obs_module_config_path("config.json");
     if (path) {
@@ -48,12 +879,29 @@ static void load_config() {
         obs_data_t *data = obs_data_create_from_json_file(g_config_path.c_str());
         if (data) {
             const char* theme = obs_data_get_string(data, "theme");
-            const char* device_id = obs_data_get_string(data, "last_device_id");
+            const char* mode = obs_data_get_string(data, "ingest_mode");
             
             if (theme && *theme) g_theme = theme;
-            if (device_id && *device_id) g_last_device_id = device_id;
+            if (mode && *mode) g_ingest_mode = mode;
+
+            obs_data_array_t *devices = obs_data_get_array(data, "devices");
+            if (devices) {
+                for (size_t i = 0; i < obs_data_array_count(devices); ++i) {
+                    obs_data_t *item = obs_data_array_item(devices, i);
+                    const char* id = obs_data_get_string(item, "id");
+                    const char* device_mode = obs_data_get_string(item, "mode");
+                    if (id && *id) g_saved_devices.push_back({ id, device_mode && *device_mode ? device_mode : "gatt" });
+                    obs_data_release(item);
+                }
+                obs_data_array_release(devices);
+            } else {
+                // Configs from before multi-device support
+                const char* device_id = obs_data_get_string(data, "last_device_id");
+                if (device_id && *device_id) g_saved_devices.push_back({ device_id, g_ingest_mode });
+            }
             
-            blog(LOG_INFO, "Config loaded - Theme: %s, Last Device: %s", g_theme.c_str(), g_last_device_id.c_str());
+            blog(LOG_INFO, "Config loaded - Theme: %s, Devices: %zu, Mode: %s", g_theme.c_str(),
+                 g_saved_devices.size(), g_ingest_mode.c_str());
             obs_data_release(data);
         } else {
             blog(LOG_INFO, "Config file not found or invalid, creating new one.");
@@ -62,9 +910,10 @@ static void load_config() {
     } else {
         blog(LOG_ERROR, "Failed to get module config path");
     }
-}
 
-static std::mutex g_config_mutex;
+    std::lock_guard<std::mutex> lock(g_config_mutex);
+    theme_changed();
+}
 
 static void save_config() {
     std::lock_guard<std::mutex> lock(g_config_mutex);
@@ -80,7 +929,17 @@ static void save_config() {
 
     obs_data_t *data = obs_data_create();
     obs_data_set_string(data, "theme", g_theme.c_str());
-    obs_data_set_string(data, "last_device_id", g_last_device_id.c_str());
+    obs_data_set_string(data, "ingest_mode", g_ingest_mode.c_str());
+    obs_data_array_t *devices = obs_data_array_create();
+    for (const auto& device : g_saved_devices) {
+        obs_data_t *item = obs_data_create();
+        obs_data_set_string(item, "id", device.id.c_str());
+        obs_data_set_string(item, "mode", device.mode.c_str());
+        obs_data_array_push_back(devices, item);
+        obs_data_release(item);
+    }
+    obs_data_set_array(data, "devices", devices);
+    obs_data_array_release(devices);
     
     if (!obs_data_save_json_safe(data, g_config_path.c_str(), "tmp", "bak")) {
         blog(LOG_WARNING, "Failed to save config to %s", g_config_path.c_str());
@@ -91,22 +950,34 @@ static void save_config() {
     obs_data_release(data);
 }
 
-// Helper to find web directory
+// The pages are compiled in. Theme authors can drop replacements for any
+// of them into MIBAND_HR_WEB_DIR, or web/ in the plugin config directory;
+// only a directory that exists at load time is consulted.
 static void setup_web_dir() {
-    char* path = obs_module_file("web");
-    if (path) {
+    if (const char* dir = getenv("MIBAND_HR_WEB_DIR")) {
+        g_web_dir = dir;
+    } else if (char* path = obs_module_config_path("web")) {
         g_web_dir = path;
         bfree(path);
-        blog(LOG_INFO, "Web directory found: %s", g_web_dir.c_str());
-    } else {
-        blog(LOG_WARNING, "Could not find 'web' directory in plugin data path.");
+    }
+    if (!g_web_dir.empty() && os_file_exists(g_web_dir.c_str())) {
+        blog(LOG_INFO, "Web files in %s override the built-in ones", g_web_dir.c_str());
+        g_assets = std::make_shared<AssetCache>(g_web_dir);
     }
     
     load_config();
 }
 
 static void open_url(const char* url) {
+#ifdef _WIN32
     ShellExecuteA(NULL, "open", url, NULL, NULL, SW_SHOWNORMAL);
+#elif defined(__APPLE__)
+    std::string cmd = std::string("open '") + url + "' &";
+    if (system(cmd.c_str()) != 0) blog(LOG_WARNING, "Failed to open %s", url);
+#else
+    std::string cmd = std::string("xdg-open '") + url + "' >/dev/null 2>&1 &";
+    if (system(cmd.c_str()) != 0) blog(LOG_WARNING, "Failed to open %s", url);
+#endif
 }
 
 static std::string get_base_url() {
@@ -174,9 +1045,15 @@ static void on_frontend_event(enum obs_frontend_event event, void* data) {
         check_and_create_source();
         
         // Auto connect
-        if (!g_last_device_id.empty() && g_ble) {
-            blog(LOG_INFO, "Auto connecting to last device: %s", g_last_device_id.c_str());
-            g_ble->Connect(g_last_device_id);
+        std::vector<SavedDevice> devices;
+        {
+            std::lock_guard<std::mutex> lock(g_config_mutex);
+            devices = g_saved_devices;
+        }
+        for (const auto& device : devices) {
+            if (!g_ble) break;
+            blog(LOG_INFO, "Auto connecting to saved device: %s", device.id.c_str());
+            invalidate_hr(g_ble->Connect(device.id, parse_ingest_mode(device.mode)));
         }
     }
 }
@@ -187,49 +1064,368 @@ static void on_tool_config(void* data) {
     }
 }
 
+static void scan_timer(std::stop_token stop) {
+    std::unique_lock<std::mutex> lock(g_scan_mutex);
+    while (!stop.stop_requested()) {
+        if (!g_scanning) {
+            g_scan_cv.wait(lock, stop, []() { return g_scanning; });
+            continue;
+        }
+        auto deadline = g_scan_deadline;
+        // Wakes early if the scan was stopped, restarted or cancelled
+        if (g_scan_cv.wait_until(lock, stop, deadline,
+                                 [deadline]() { return !g_scanning || g_scan_deadline != deadline; })) {
+            continue;
+        }
+        if (stop.stop_requested()) break;
+        if (g_ble) g_ble->StopScan();
+        g_scanning = false;
+    }
+}
+
 static void start_http_server() {
-    g_server = std::make_unique<httplib::Server>();
-    
-    // Serve static files
-    auto serve_file = [](const std::string& filename, const std::string& mime) {
-        return [filename, mime](const httplib::Request&, httplib::Response& res) {
-            std::string path = g_web_dir + "/" + filename;
-            std::ifstream file(path);
-            if (file) {
-                std::stringstream buffer;
-                buffer << file.rdbuf();
-                res.set_content(buffer.str(), mime);
-            } else {
-                res.status = 404;
-                res.set_content("File not found", "text/plain");
+    // Static files, from memory. Browsers revalidate on every load and get
+    // a 304 until the file changes.
+    auto serve_file = [](const EmbeddedAsset& embedded) {
+        return [assets = g_assets, &embedded](const httplib::Request& req, httplib::Response& res) {
+            res.set_header("Cache-Control", "no-cache");
+            res.set_header("Vary", "Accept-Encoding");
+
+            // An override on disk wins and is served as is
+            if (auto asset = assets ? assets->Get(std::string(embedded.name)) : nullptr) {
+                res.set_header("ETag", asset->etag);
+                res.set_header("Last-Modified", asset->last_modified);
+                bool not_modified = req.has_header("If-None-Match")
+                                        ? etag_matches(req, asset->etag)
+                                        : req.get_header_value("If-Modified-Since") == asset->last_modified;
+                if (not_modified) {
+                    res.status = 304;
+                    return;
+                }
+                res.set_content_provider(asset->body.size(), embedded.mime,
+                                         [asset](size_t offset, size_t length, httplib::DataSink& sink) {
+                                             return sink.write(asset->body.data() + offset, length);
+                                         });
+                return;
+            }
+
+            // A bundled page would hide an overridden stylesheet or script;
+            // the page as written links them instead
+            bool unbundled = false;
+            if (assets && embedded.source) {
+                std::stringstream inlined{ std::string(embedded.inlined) };
+                std::string part;
+                while (!unbundled && std::getline(inlined, part, ',')) unbundled = assets->Get(part) != nullptr;
+            }
+
+            // Built in: the smallest variant the client accepts, precompressed at build time
+            std::string accept = req.get_header_value("Accept-Encoding");
+            const unsigned char* data = embedded.data;
+            size_t size = embedded.size;
+            const char* etag = embedded.etag;
+            if (unbundled) {
+                data = embedded.source;
+                size = embedded.source_size;
+                etag = embedded.source_etag;
+            } else if (embedded.brotli && accepts_encoding(accept, "br")) {
+                data = embedded.brotli;
+                size = embedded.brotli_size;
+                etag = embedded.brotli_etag;
+                res.set_header("Content-Encoding", "br");
+            } else if (embedded.gzip && accepts_encoding(accept, "gzip")) {
+                data = embedded.gzip;
+                size = embedded.gzip_size;
+                etag = embedded.gzip_etag;
+                res.set_header("Content-Encoding", "gzip");
+            }
+            res.set_header("ETag", etag);
+            if (etag_matches(req, etag)) {
+                res.status = 304;
+                return;
             }
+            res.set_content_provider(size, embedded.mime,
+                                     [data](size_t offset, size_t length, httplib::DataSink& sink) {
+                                         return sink.write(reinterpret_cast<const char*>(data) + offset, length);
+                                     });
         };
     };
 
-    g_server->Get("/", serve_file("index.html", "text/html"));
-    g_server->Get("/index.html", serve_file("index.html", "text/html"));
-    g_server->Get("/settings.html", serve_file("settings.html", "text/html"));
-    g_server->Get("/style.css", serve_file("style.css", "text/css"));
-    g_server->Get("/script.js", serve_file("script.js", "application/javascript"));
-
-    // API: Heart Rate
-    g_server->Get("/api/hr", [](const httplib::Request&, httplib::Response& res) {
-        std::stringstream ss;
-        int hr = -1;
-        if (g_ble && g_ble->IsConnected()) {
-            hr = g_latest_hr;
-        }
-        ss << "{\"hr\": " << hr << "}";
-        res.set_content(ss.str(), "application/json");
+    for (const auto& asset : EmbeddedAssets()) {
+        g_server->Get("/" + std::string(asset.name), serve_file(asset));
+    }
+    if (const EmbeddedAsset* index = FindEmbeddedAsset("index.html")) g_server->Get("/", serve_file(*index));
+
+    // API: Heart Rate. ?device=<id> picks a band; without it the first
+    // connected stream answers, which is what single-band overlays expect.
+    // ?since=<seq>[&timeout=<ms>] long-polls: the reply waits for a newer
+    // sample (or a connect / disconnect) and lists every sample after since.
+    g_server->Stream("/api/hr", [](const httplib::Request& req, httplib::Response& res) -> WebSocketServer::StreamPoll {
+        res.set_header("Access-Control-Allow-Origin", "*");
+        std::string wanted = req.get_param_value("device");
+        if (!req.has_param("since")) {
+            std::string device;
+            uint32_t stream_id = find_hr_stream(wanted, device);
+            std::string& json = json_buffer();
+            JsonWriter w(json);
+            write_hr_json(w, stream_id, device);
+            res.set_content(json.data(), json.size(), kJsonMime);
+            return nullptr;
+        }
+
+        auto lp = std::make_shared<HrLongPoll>();
+        lp->wanted = wanted;
+        lp->since = strtoull(req.get_param_value("since").c_str(), nullptr, 10);
+        int timeout_ms = HR_LONG_POLL_DEFAULT_MS;
+        if (req.has_param("timeout")) timeout_ms = atoi(req.get_param_value("timeout").c_str());
+        timeout_ms = std::clamp(timeout_ms, 0, HR_LONG_POLL_MAX_MS);
+        lp->deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        lp->stream_id = find_hr_stream(wanted, lp->device);
+        lp->valid = hr_valid_now(lp->stream_id);
+        res.set_header("Cache-Control", "no-store");
+        if (hr_long_poll_ready(*lp)) {
+            std::string& json = json_buffer();
+            write_hr_long_poll(*lp, json);
+            res.set_content(json.data(), json.size(), kJsonMime);
+            return nullptr;
+        }
+        lp->feed = std::make_unique<HrBroadcaster::Subscription>(g_hr_events, "long-poll", HrBroadcaster::kCapacity);
+        res.set_header("Content-Type", kJsonMime);
+        return [lp](std::string& out) {
+            if (!hr_long_poll_ready(*lp)) return true;
+            write_hr_long_poll(*lp, out);
+            return false;
+        };
+    });
+
+    // API: Heart Rate as Server-Sent Events, pushed as samples arrive.
+    // Same ?device= rule as /api/hr.
+    g_server->Stream("/api/hr/stream", [](const httplib::Request& req, httplib::Response& res) {
+        auto hs = std::make_shared<HrStream>();
+        hs->wanted = req.get_param_value("device");
+        hs->throttle.SetPolicy(parse_hr_policy(req));
+        hs->last_write = std::chrono::steady_clock::now();
+        std::string last_id = req.get_header_value("Last-Event-ID");
+        if (!last_id.empty()) {
+            hs->last_seq = strtoull(last_id.c_str(), nullptr, 10);
+            hs->resume = hs->last_seq > 0;
+        }
+        res.set_header("Content-Type", "text/event-stream");
+        res.set_header("Cache-Control", "no-cache");
+        res.set_header("Access-Control-Allow-Origin", "*");
+        return [hs](std::string& out) { return poll_hr_stream(*hs, out); };
+    });
+
+    // API: Heart Rate over WebSocket with binary frames; see HR_FRAME_*.
+    // Nothing is sent until the client subscribes.
+    g_server->Upgrade("/api/ws", [](const httplib::Request&, WebSocket& ws) {
+        HrSocket hs;
+        std::thread sender([&hs, &ws]() { run_hr_socket_sender(hs, ws); });
+        std::string message;
+        WebSocket::Opcode opcode;
+        for (;;) {
+            auto status = ws.Read(message, opcode, 250);
+            if (status == WebSocket::ReadStatus::Closed) break;
+            if (status == WebSocket::ReadStatus::Timeout) {
+                if (hr_streams_closing()) {
+                    ws.Close(WebSocket::CLOSE_GOING_AWAY);
+                    break;
+                }
+                continue;
+            }
+            if (opcode != WebSocket::Opcode::Text) {
+                ws.Close(WebSocket::CLOSE_UNSUPPORTED, "control messages are JSON text");
+                break;
+            }
+            handle_hr_socket_message(hs, ws, message);
+        }
+        // The sender exits once the socket is closed; wake it to notice
+        notify_hr();
+        sender.join();
+    });
+
+    // API: Heart Rate for every connected band
+    g_server->Get("/api/hr/all", [](const httplib::Request&, httplib::Response& res) {
+        std::string& json = json_buffer();
+        JsonWriter w(json);
+        w.BeginObject().Key("devices").BeginArray();
+        if (g_ble) {
+            for (const auto& stream : cached_streams()) write_hr_json(w, stream.stream_id, stream.device_id);
+        }
+        w.EndArray().EndObject();
+        res.set_content(json.data(), json.size(), kJsonMime);
+        res.set_header("Access-Control-Allow-Origin", "*");
+    });
+
+    // API: Combined state for pollers: the followed band's reading and
+    // connection, the theme and the device list. ?parts=hr,theme,devices
+    // narrows it (default: all); ?device= as for /api/hr. The ETag is made
+    // of version counters only, so a matching If-None-Match gets a bodiless
+    // 304 without reading the ring, the streams or the config.
+    g_server->Get("/api/state", [](const httplib::Request& req, httplib::Response& res) {
+        std::string parts = req.has_param("parts") ? req.get_param_value("parts") : "hr,theme,devices";
+        auto wants = [&parts](const char* part) {
+            for (size_t pos = 0; pos <= parts.size();) {
+                size_t end = parts.find(',', pos);
+                if (end == std::string::npos) end = parts.size();
+                if (parts.compare(pos, end - pos, part) == 0) return true;
+                pos = end + 1;
+            }
+            return false;
+        };
+        bool want_hr = wants("hr"), want_theme = wants("theme"), want_devices = wants("devices");
+
+        // Versions are read before the content they describe; a change in
+        // between makes the next poll fetch again rather than miss it
+        std::string device;
+        uint32_t stream_id = kInvalidStream;
+        HrReading reading;
+        if (want_hr) {
+            stream_id = find_hr_stream(req.get_param_value("device"), device);
+            reading = read_hr(stream_id);
+        }
+        uint64_t hr_version = reading.seq;
+        bool connected = reading.hr >= 0;
+        uint64_t devices_version = g_devices_version;
+        uint64_t theme_version = want_theme ? g_theme_version.load() : 0;
+
+        // e.g. "h0.1234.1-t3-d2": stream, ring head, connected; theme; devices
+        std::string etag;
+        if (want_hr) {
+            etag += "h" + (stream_id < kMaxStreams ? std::to_string(stream_id) : std::string("x")) + "." +
+                    std::to_string(hr_version) + (connected ? ".1" : ".0");
+        }
+        if (want_theme) etag += (etag.empty() ? "t" : "-t") + std::to_string(theme_version);
+        if (want_devices) etag += (etag.empty() ? "d" : "-d") + std::to_string(devices_version);
+        etag = "\"" + etag + "\"";
+        res.set_header("ETag", etag);
+        res.set_header("Cache-Control", "no-cache");
         res.set_header("Access-Control-Allow-Origin", "*");
+        if (etag_matches(req, etag)) {
+            res.status = 304;
+            return;
+        }
+
+        std::string& json = json_buffer();
+        JsonWriter w(json);
+        w.BeginObject().Key("versions").BeginObject();
+        if (want_hr) w.Field("hr", hr_version);
+        if (want_theme) w.Field("theme", theme_version);
+        if (want_devices) w.Field("devices", devices_version);
+        w.EndObject();
+        if (want_hr) {
+            w.Field("connected", connected).Key("hr");
+            write_hr_json(w, stream_id, device, reading);
+        }
+        if (want_theme) {
+            std::lock_guard<std::mutex> lock(g_config_mutex);
+            w.Key("theme").Raw(g_theme_json);
+        }
+        if (want_devices) {
+            w.Key("devices").BeginArray();
+            if (g_ble) {
+                for (const auto& stream : g_ble->GetStreams()) {
+                    w.BeginObject()
+                        .Field("device", stream.device_id)
+                        .Field("stream", stream.stream_id)
+                        .Field("mode", stream.mode == IngestMode::Advertisement ? "advertisement" : "gatt")
+                        .EndObject();
+                }
+            }
+            w.EndArray();
+        }
+        w.EndObject();
+        res.set_content(json.data(), json.size(), kJsonMime);
     });
 
-    // API: Disconnect
-    g_server->Post("/api/disconnect", [](const httplib::Request&, httplib::Response& res) {
+    // API: Metrics
+    g_server->Get("/api/metrics", [](const httplib::Request&, httplib::Response& res) {
+        std::vector<StreamInfo> streams;
+        if (g_ble) streams = g_ble->GetStreams();
+        // Per-stream stats are gathered first; the total comes before them
+        ReconnectStats total;
+        ReconnectStats per_stream[kMaxStreams];
+        for (size_t i = 0; i < streams.size() && i < kMaxStreams; ++i) {
+            ReconnectStats& rs = per_stream[i] = g_ble->GetReconnectStats(streams[i].stream_id);
+            total.disconnects += rs.disconnects;
+            total.attempts += rs.attempts;
+            total.reconnects += rs.reconnects;
+            total.last_reconnect_ms = std::max(total.last_reconnect_ms, rs.last_reconnect_ms);
+            total.max_reconnect_ms = std::max(total.max_reconnect_ms, rs.max_reconnect_ms);
+            total.total_reconnect_ms += rs.total_reconnect_ms;
+        }
+        std::string& json = json_buffer();
+        JsonWriter w(json);
+        w.BeginObject().Key("reconnect");
+        write_reconnect_json(w, total);
+        w.Key("streams").BeginArray();
+        uint64_t now_ns = os_gettime_ns();
+        for (size_t i = 0; i < streams.size() && i < kMaxStreams; ++i) {
+            StreamSnapshot snapshot = g_ble->GetSnapshot(streams[i].stream_id);
+            w.BeginObject()
+                .Field("device", streams[i].device_id)
+                .Field("stream", streams[i].stream_id)
+                .Field("connected", snapshot.connected)
+                .Field("bpm", snapshot.bpm)
+                .Field("ble_seq", snapshot.seq);
+            if (snapshot.seq) w.Field("sample_age_ms", (now_ns - snapshot.receive_timestamp_ns) / 1000000);
+            w.Key("reconnect");
+            write_reconnect_json(w, per_stream[i]);
+            w.EndObject();
+        }
+        w.EndArray();
         if (g_ble) {
-            g_ble->Disconnect();
-            g_latest_hr = -1;
-            res.set_content("{\"status\": \"disconnected\"}", "application/json");
+            DispatchStats ds = g_ble->GetDispatchStats();
+            w.Key("dispatch")
+                .BeginObject()
+                .Field("delivered", ds.delivered)
+                .Field("dropped", ds.dropped)
+                .Field("stale", ds.stale)
+                .Field("depth", ds.depth)
+                .Field("max_depth", ds.max_depth)
+                .Field("capacity", ds.capacity)
+                .Field("avg_latency_us", ds.avg_latency_ns / 1000)
+                .Field("max_latency_us", ds.max_latency_ns / 1000)
+                .Field("max_callback_us", ds.max_callback_ns / 1000)
+                .EndObject();
+        }
+        w.Key("broadcast").BeginObject().Field("published", g_hr_events.Published()).Key("subscribers").BeginArray();
+        for (const HrSubscriberStats& ss : g_hr_events.Stats()) {
+            w.BeginObject()
+                .Field("kind", ss.kind)
+                .Field("delivered", ss.delivered)
+                .Field("dropped", ss.dropped)
+                .Field("queued", ss.queued)
+                .Field("max_queued", ss.max_queued)
+                .Field("lag_us", ss.last_lag_ns / 1000)
+                .Field("max_lag_us", ss.max_lag_ns / 1000)
+                .EndObject();
+        }
+        w.EndArray().EndObject();
+        w.EndObject();
+        res.set_content(json.data(), json.size(), kJsonMime);
+    });
+
+    // API: Disconnect. {"id": "..."} drops one band, an empty body drops all
+    g_server->Post("/api/disconnect", [](const httplib::Request& req, httplib::Response& res) {
+        if (g_ble) {
+            std::string id;
+            if (!req.body.empty() &&
+                !JsonReader::ForEachMember(req.body, [&](std::string_view key, JsonReader& reader,
+                                                         JsonReader::Token token) {
+                    if (key == "id" && token == JsonReader::Token::String) id = reader.Value();
+                })) {
+                res.status = 400;
+                return;
+            }
+            if (id.empty()) {
+                g_ble->DisconnectAll();
+                for (uint32_t i = 0; i < kMaxStreams; ++i) invalidate_hr(i);
+            } else {
+                uint32_t stream_id = g_ble->FindStream(id);
+                g_ble->Disconnect(id);
+                invalidate_hr(stream_id);
+            }
+            set_status_json(res, "disconnected");
         } else {
             res.status = 500;
         }
@@ -238,49 +1434,46 @@ static void start_http_server() {
     // API: Reset
     g_server->Post("/api/reset", [](const httplib::Request&, httplib::Response& res) {
         if (g_ble) {
-            g_ble->Disconnect();
+            g_ble->DisconnectAll();
         }
-        g_latest_hr = -1;
+        for (uint32_t i = 0; i < kMaxStreams; ++i) invalidate_hr(i);
         {
             std::lock_guard<std::mutex> lock(g_config_mutex);
-            g_last_device_id = "";
+            g_saved_devices.clear();
         }
         save_config();
-        res.set_content("{\"status\": \"reset\"}", "application/json");
+        set_status_json(res, "reset");
     });
 
     // API: Get Theme
-    g_server->Get("/api/theme", [](const httplib::Request&, httplib::Response& res) {
-        std::string theme;
+    g_server->Get("/api/theme", [](const httplib::Request& req, httplib::Response& res) {
+        std::string& json = json_buffer();
+        uint64_t version;
         {
             std::lock_guard<std::mutex> lock(g_config_mutex);
-            theme = g_theme;
+            json = g_theme_json;
+            version = g_theme_version;
         }
-        
-        obs_data_t *data = obs_data_create();
-        obs_data_set_string(data, "theme", theme.c_str());
-        const char* json = obs_data_get_json(data);
-        if (json) {
-             res.set_content(json, "application/json");
-        } else {
-             res.status = 500;
+        std::string etag = "\"t" + std::to_string(version) + "\"";
+        res.set_header("ETag", etag);
+        res.set_header("Cache-Control", "no-cache");
+        if (etag_matches(req, etag)) {
+            res.status = 304;
+            return;
         }
-        obs_data_release(data);
+        res.set_content(json.data(), json.size(), kJsonMime);
     });
 
     // API: Set Theme
     g_server->Post("/api/theme", [](const httplib::Request& req, httplib::Response& res) {
-        std::string body = req.body;
-        blog(LOG_INFO, "API Set Theme Request Body: %s", body.c_str());
-        
+        blog(LOG_INFO, "API Set Theme Request Body: %s", req.body.c_str());
+
         std::string new_theme;
-        obs_data_t *data = obs_data_create_from_json(body.c_str());
-        if (data) {
-            const char* val = obs_data_get_string(data, "theme");
-            if (val) {
-                 new_theme = val;
-            }
-            obs_data_release(data);
+        if (!JsonReader::ForEachMember(req.body, [&](std::string_view key, JsonReader& reader,
+                                                     JsonReader::Token token) {
+                if (key == "theme" && token == JsonReader::Token::String) new_theme = reader.Value();
+            })) {
+            new_theme.clear();
         }
 
         if (!new_theme.empty()) {
@@ -288,10 +1481,11 @@ static void start_http_server() {
             {
                 std::lock_guard<std::mutex> lock(g_config_mutex);
                 g_theme = new_theme;
+                theme_changed();
             }
             // save_config locks internally, so we release our lock first
             save_config();
-            res.set_content("{\"status\": \"ok\"}", "application/json");
+            set_status_json(res, "ok");
         } else {
             blog(LOG_WARNING, "Failed to parse theme");
             res.status = 400;
@@ -302,75 +1496,73 @@ static void start_http_server() {
     g_server->Post("/api/scan", [](const httplib::Request&, httplib::Response& res) {
         std::lock_guard<std::mutex> lock(g_scan_mutex);
         if (g_scanning) {
-             res.set_content("{\"status\": \"scanning\"}", "application/json");
+            set_status_json(res, "scanning");
              return;
         }
         g_scanning = true;
         g_found_devices.clear();
+        g_found_index.clear();
         
         if (g_ble) {
+            // Runs on the BLE dispatcher thread, once per advertisement
             g_ble->StartScan([](const BleDevice& dev) {
                 std::lock_guard<std::mutex> lock(g_scan_mutex);
-                bool exists = false;
-                for (auto& d : g_found_devices) {
-                    if (d.id == dev.id) { 
-                        // Update name if the new one is longer (likely more complete)
-                        if (dev.name.length() > d.name.length()) {
-                            d.name = dev.name;
-                        }
-                        exists = true; 
-                        break; 
-                    }
-                }
-                if (!exists) {
+                auto [it, inserted] = g_found_index.try_emplace(dev.id, g_found_devices.size());
+                if (inserted) {
                     g_found_devices.push_back(dev);
+                    return;
+                }
+                // Update name if the new one is longer (likely more complete)
+                BleDevice& known = g_found_devices[it->second];
+                if (dev.name.length() > known.name.length()) {
+                    known.name = dev.name;
                 }
             });
-            
+
             // Auto stop scan after 10s
-            std::thread([]() {
-                std::this_thread::sleep_for(std::chrono::seconds(10));
-                std::lock_guard<std::mutex> lock(g_scan_mutex);
-                if (g_scanning && g_ble) {
-                    g_ble->StopScan();
-                    g_scanning = false;
-                }
-            }).detach();
+            g_scan_deadline = std::chrono::steady_clock::now() + SCAN_DURATION;
+            g_scan_cv.notify_all();
         }
         
-        res.set_content("{\"status\": \"started\"}", "application/json");
+        set_status_json(res, "started");
     });
 
     // API: Get Devices
     g_server->Get("/api/devices", [](const httplib::Request&, httplib::Response& res) {
-        std::lock_guard<std::mutex> lock(g_scan_mutex);
-        std::stringstream ss;
-        ss << "[";
-        for (size_t i = 0; i < g_found_devices.size(); ++i) {
-            if (i > 0) ss << ",";
-            ss << "{\"name\": \"" << g_found_devices[i].name << "\", \"id\": \"" << g_found_devices[i].id << "\"}";
-        }
-        ss << "]";
-        res.set_content(ss.str(), "application/json");
+        std::string& json = json_buffer();
+        JsonWriter w(json);
+        w.BeginArray();
+        {
+            // Names come from advertisements as broadcast; the writer escapes them
+            std::lock_guard<std::mutex> lock(g_scan_mutex);
+            for (const auto& dev : g_found_devices) {
+                w.BeginObject().Field("name", dev.name).Field("id", dev.id).EndObject();
+            }
+        }
+        w.EndArray();
+        res.set_content(json.data(), json.size(), kJsonMime);
     });
 
     // API: Connect
     g_server->Post("/api/connect", [](const httplib::Request& req, httplib::Response& res) {
-        // Simple JSON parse: {"id": "..."}
-        std::string body = req.body;
-        size_t id_pos = body.find("\"id\"");
-        if (id_pos == std::string::npos) {
-             res.status = 400;
-             return;
+        // {"id": "...", "mode": "gatt" | "advertisement"}; mode defaults to the saved one
+        std::string id, mode;
+        bool parsed = JsonReader::ForEachMember(req.body, [&](std::string_view key, JsonReader& reader,
+                                                              JsonReader::Token token) {
+            if (token != JsonReader::Token::String) return;
+            if (key == "id") id = reader.Value();
+            if (key == "mode" && (reader.Value() == "gatt" || reader.Value() == "advertisement")) mode = reader.Value();
+        });
+        if (!parsed || id.empty()) {
+            res.status = 400;
+            return;
         }
-        size_t start = body.find("\"", id_pos + 4);
-        if (start == std::string::npos) { res.status = 400; return; }
-        start++;
-        size_t end = body.find("\"", start);
-        if (end == std::string::npos) { res.status = 400; return; }
-        
-        std::string id = body.substr(start, end - start);
-        
+        if (mode.empty()) {
+            std::lock_guard<std::mutex> lock(g_config_mutex);
+            mode = g_ingest_mode;
+        }
+
+
         {
             std::lock_guard<std::mutex> lock(g_scan_mutex);
             if (g_scanning && g_ble) {
@@ -380,14 +1572,31 @@ static void start_http_server() {
         }
         
         if (g_ble) {
-            g_ble->Connect(id);
-            g_latest_hr = -1;
+            // Adds the band next to any already connected ones
+            uint32_t stream_id = g_ble->Connect(id, parse_ingest_mode(mode));
+            if (stream_id == kInvalidStream) {
+                res.status = 409;
+                return;
+            }
+            invalidate_hr(stream_id);
             {
                 std::lock_guard<std::mutex> lock(g_config_mutex);
-                g_last_device_id = id;
+                if (g_ingest_mode != mode) {
+                    g_ingest_mode = mode;
+                    theme_changed();
+                }
+                auto it = std::find_if(g_saved_devices.begin(), g_saved_devices.end(),
+                                       [&](const SavedDevice& d) { return d.id == id; });
+                if (it != g_saved_devices.end()) {
+                    it->mode = mode;
+                } else {
+                    g_saved_devices.push_back({ id, mode });
+                }
             }
             save_config();
-            res.set_content("{\"status\": \"connecting\"}", "application/json");
+            std::string& json = json_buffer();
+            JsonWriter(json).BeginObject().Field("status", "connecting").Field("stream", stream_id).EndObject();
+            res.set_content(json.data(), json.size(), kJsonMime);
         } else {
             res.status = 500;
         }
@@ -397,8 +1606,8 @@ static void start_http_server() {
     while (port < 65535) {
         if (g_server->bind_to_port("0.0.0.0", port)) {
             g_server_port = port;
-            blog(LOG_INFO, "HTTP Server started on port %d", g_server_port);
-            g_server->listen_after_bind();
+            blog(LOG_INFO, "HTTP Server started on port %d", port);
+            g_server->Listen();
             return;
         }
         port++;
@@ -406,19 +1615,63 @@ static void start_http_server() {
     blog(LOG_ERROR, "Failed to bind to any port starting from 17878");
 }
 
+// MIBAND_HR_SERVER=epoll serves from one event loop instead of a thread
+// per connection, for setups with many streaming clients (Linux only)
+static std::unique_ptr<WebSocketServer> create_server() {
+    const char* mode = getenv("MIBAND_HR_SERVER");
+    if (mode && strcmp(mode, "epoll") == 0) {
+#if defined(__linux__)
+        blog(LOG_INFO, "Using epoll HTTP server");
+        return std::make_unique<EpollServer>();
+#else
+        blog(LOG_WARNING, "MIBAND_HR_SERVER=epoll needs Linux, using the thread pool");
+#endif
+    } else if (mode && *mode && strcmp(mode, "threads") != 0) {
+        blog(LOG_WARNING, "Unknown MIBAND_HR_SERVER '%s', using the thread pool", mode);
+    }
+    return std::make_unique<WebSocketServer>();
+}
+
+// MIBAND_HR_SHM names the shared-memory segment local programs read the
+// live heart rate from (layout in miband-hr-shm.h); "off" disables it
+static void open_hr_shm() {
+    const char* name = getenv("MIBAND_HR_SHM");
+    if (name && strcmp(name, "off") == 0) {
+        blog(LOG_INFO, "Shared memory publishing disabled");
+        return;
+    }
+    g_hr_shm.Open(name);
+}
+
 bool obs_module_load(void)
 {
     setup_web_dir();
+    open_hr_shm();
 
     // Init BLE
     g_ble = BleManager::Create();
-    g_ble->SetHeartRateCallback([](int hr) {
-        g_latest_hr = hr;
-    });
+    if (g_ble) {
+        g_ble->SetHeartRateCallback([](const HeartRateSample& sample) {
+            uint32_t stream_id = sample.stream_id;
+            uint64_t seq = g_samples[stream_id].Publish(sample);
+            g_hr_shm.Publish(stream_id, seq, sample, sample_hr(stream_id, sample) >= 0);
+            broadcast_hr_sample(seq, sample);
+            notify_hr();
+        });
+        g_ble->SetLinkCallback([](uint32_t stream_id, bool connected) { g_hr_shm.SetConnected(stream_id, connected); });
+    }
 
-    // Start Server
-    g_server_thread = std::thread(start_http_server);
-    g_server_thread.detach();
+    g_scan_timer = std::jthread(scan_timer);
+
+    // Start Server. The thread stays joinable so unload can wait for it.
+    g_server = create_server();
+    {
+        std::lock_guard<std::mutex> lock(g_hr_notify_mutex);
+        g_hr_waker = g_server.get();
+    }
+    std::packaged_task<void()> server_task(start_http_server);
+    g_server_done = server_task.get_future();
+    g_server_thread = std::thread(std::move(server_task));
 
     // Wait for server to bind port (max 2 seconds)
     int retries = 0;
@@ -437,12 +1690,65 @@ bool obs_module_load(void)
 
 void obs_module_unload(void)
 {
+    uint64_t start_ns = os_gettime_ns();
+    auto deadline = std::chrono::steady_clock::now() + UNLOAD_DEADLINE;
+
+    // Cancel background work first so nothing new starts during teardown
+    obs_frontend_remove_event_callback(on_frontend_event, nullptr);
+    g_scan_timer.request_stop();
+    {
+        std::lock_guard<std::mutex> lock(g_hr_notify_mutex);
+        g_hr_streams_closing = true;
+        g_hr_waker = nullptr;
+    }
+    g_hr_notify_cv.notify_all();
     if (g_server) {
-        g_server->stop();
+        g_server->Stop();
     }
-    if (g_ble) {
-        g_ble->Disconnect();
+    // The callbacks and the scan timer read g_ble, and the callbacks publish
+    // to g_hr_shm; after this neither is in flight, so both can go away
+    // below whatever the backend still does
+    if (g_ble) g_ble->StopCallbacks();
+    if (g_scan_timer.joinable()) g_scan_timer.join();
+
+    // BLE comes down in parallel with HTTP. The worker keeps its own
+    // reference and drops it once the HTTP handlers are gone, so the
+    // backend destructor also runs inside the deadline and off this thread.
+    std::shared_future<void> http_done = g_server_done.valid() ? g_server_done.share() : std::shared_future<void>();
+    std::packaged_task<void()> ble_task([ble = g_ble, http_done, deadline]() mutable {
+        if (!ble) return;
+        ble->DisconnectAll();
+        if (http_done.valid()) http_done.wait_until(deadline);
+        ble.reset();
+    });
+    std::future<void> ble_done = ble_task.get_future();
+    std::thread ble_thread(std::move(ble_task));
+
+    bool http_ok = !http_done.valid() || http_done.wait_until(deadline) == std::future_status::ready;
+    if (http_ok) {
+        if (g_server_thread.joinable()) g_server_thread.join();
+        g_server.reset();
         g_ble.reset();
+    } else {
+        // Handlers may still be running: leak the server and the manager
+        // rather than free them under their feet
+        blog(LOG_WARNING, "HTTP server did not stop in time, abandoning it");
+        g_server_thread.detach();
+        (void)g_server.release();
+        // A copy, not a move: handlers may still be reading g_ble
+        new std::shared_ptr<BleManager>(g_ble);  // intentionally leaked
     }
-    blog(LOG_INFO, "Heart Rate plugin unloaded");
+
+    if (ble_done.wait_until(deadline) == std::future_status::ready) {
+        ble_thread.join();
+    } else {
+        blog(LOG_WARNING, "BLE teardown did not finish in time, abandoning it");
+        ble_thread.detach();
+    }
+
+    g_assets.reset();
+    // An abandoned handler may still call in; that is a no-op once closed
+    g_hr_shm.Close();
+
+    blog(LOG_INFO, "Heart Rate plugin unloaded in %.1f ms", (os_gettime_ns() - start_ns) / 1e6);
 }
@@ -0,0 +1,161 @@
+#include "reconnector.hpp"
+#include <obs-module.h>
+#include <algorithm>
+#include <cmath>
+
+using clock_type = std::chrono::steady_clock;
+
+Reconnector::Reconnector(AttemptFn attempt, ReconnectOptions options)
+    : attempt_(std::move(attempt)), options_(options) {
+    thread_ = std::thread([this]() { Run(); });
+}
+
+Reconnector::~Reconnector() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        shutdown_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+}
+
+std::chrono::milliseconds Reconnector::BackoffDelay(const ReconnectOptions& options, uint32_t failures,
+                                                    double unit_random) {
+    if (failures == 0) return std::chrono::milliseconds(0);
+    double delay = options.initial_delay.count() * std::pow(options.multiplier, (double)(failures - 1));
+    delay = std::min(delay, (double)options.max_delay.count());
+    // Keep (1 - jitter) of the delay fixed and spread the rest, so many
+    // clients losing the same host don't retry in lockstep
+    delay = delay * (1.0 - options.jitter) + delay * options.jitter * unit_random;
+    return std::chrono::milliseconds((int64_t)delay);
+}
+
+clock_type::time_point Reconnector::Now() const {
+    return options_.now ? options_.now() : clock_type::now();
+}
+
+void Reconnector::Enable() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        failures_ = 0;
+        down_ = false;
+        first_connect_ = true;
+        down_since_ = Now();
+        state_ = State::Waiting;
+        deadline_ = down_since_;
+    }
+    cv_.notify_all();
+}
+
+void Reconnector::Disable() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    state_ = State::Disabled;
+    down_ = false;
+    first_connect_ = false;
+}
+
+void Reconnector::OnConnected() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ == State::Disabled) return;
+    state_ = State::Connected;
+    failures_ = 0;
+    if (first_connect_) {
+        first_connect_ = false;
+        down_ = false;
+        uint64_t ms = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(Now() - down_since_).count();
+        blog(LOG_INFO, "Connected after %llu ms", (unsigned long long)ms);
+    } else if (down_) {
+        down_ = false;
+        uint64_t ms = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(Now() - down_since_).count();
+        stats_.reconnects++;
+        stats_.last_reconnect_ms = ms;
+        stats_.max_reconnect_ms = std::max(stats_.max_reconnect_ms, ms);
+        stats_.total_reconnect_ms += ms;
+        blog(LOG_INFO, "Link up after %llu ms", (unsigned long long)ms);
+    }
+}
+
+void Reconnector::OnDisconnected() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (state_ == State::Disabled || state_ == State::Waiting) return;
+        stats_.disconnects++;
+        if (!down_) {
+            down_ = true;
+            down_since_ = Now();
+        }
+        if (state_ == State::Connecting) {
+            // The pending attempt will report its own outcome
+            return;
+        }
+        failures_ = 0;
+        state_ = State::Waiting;
+        deadline_ = Now();
+    }
+    blog(LOG_INFO, "Link lost, reconnecting");
+    cv_.notify_all();
+}
+
+void Reconnector::OnAttemptFailed() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (state_ != State::Connecting) return;
+        failures_++;
+        ScheduleLocked(Now());
+    }
+    cv_.notify_all();
+}
+
+void Reconnector::ScheduleLocked(clock_type::time_point now) {
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    auto delay = BackoffDelay(options_, failures_, options_.unit_random ? options_.unit_random() : unit(rng_));
+    state_ = State::Waiting;
+    deadline_ = now + delay;
+    blog(LOG_INFO, "Reconnect attempt %u failed, retrying in %lld ms", failures_, (long long)delay.count());
+}
+
+ReconnectStats Reconnector::Stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void Reconnector::Poll() {
+    {
+        // Run reads the clock under the lock, so this can't land between
+        // that read and its wait
+        std::lock_guard<std::mutex> lock(mutex_);
+    }
+    cv_.notify_all();
+}
+
+void Reconnector::Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!shutdown_) {
+        if (state_ == State::Disabled || state_ == State::Connected) {
+            cv_.wait(lock, [this]() { return shutdown_ || state_ == State::Waiting || state_ == State::Connecting; });
+            continue;
+        }
+
+        // Relative, so a substituted clock never turns this into a spin
+        auto now = Now();
+        if (now < deadline_) {
+            cv_.wait_for(lock, deadline_ - now);
+            continue;
+        }
+
+        if (state_ == State::Connecting) {
+            // The attempt never reported back
+            blog(LOG_WARNING, "Reconnect attempt timed out");
+            failures_++;
+            ScheduleLocked(deadline_);
+            continue;
+        }
+
+        state_ = State::Connecting;
+        stats_.attempts++;
+        deadline_ = Now() + options_.attempt_timeout;
+        lock.unlock();
+        attempt_();
+        lock.lock();
+    }
+}
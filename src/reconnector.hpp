@@ -0,0 +1,83 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <thread>
+
+struct ReconnectOptions {
+    std::chrono::milliseconds initial_delay{500};   // delay after the first failed retry
+    std::chrono::milliseconds max_delay{30000};
+    double multiplier = 2.0;
+    double jitter = 0.5;                             // fraction of each delay that is randomised
+    std::chrono::milliseconds attempt_timeout{20000}; // an attempt that never reports counts as failed
+
+    // Substitutes for tests; unset means steady_clock and a seeded mt19937
+    std::function<std::chrono::steady_clock::time_point()> now;
+    std::function<double()> unit_random;             // in [0, 1)
+};
+
+struct ReconnectStats {
+    uint64_t disconnects = 0;
+    uint64_t attempts = 0;
+    uint64_t reconnects = 0;
+    uint64_t last_reconnect_ms = 0;  // link lost -> link back
+    uint64_t max_reconnect_ms = 0;
+    uint64_t total_reconnect_ms = 0;
+};
+
+// Platform-neutral reconnect state machine. Backends feed it link events
+// (OnConnected / OnDisconnected / OnAttemptFailed) and it calls `attempt`
+// from its own thread: immediately after a drop, then with exponential
+// backoff plus jitter up to a cap. The thread sleeps on a condition
+// variable between deadlines, so nothing polls the radio stack.
+class Reconnector {
+public:
+    using AttemptFn = std::function<void()>;
+
+    explicit Reconnector(AttemptFn attempt, ReconnectOptions options = {});
+    ~Reconnector();
+
+    // A target was chosen: connect now and keep the link up from then on
+    void Enable();
+    // The user disconnected: stop retrying
+    void Disable();
+
+    void OnConnected();
+    void OnDisconnected();
+    void OnAttemptFailed();
+
+    ReconnectStats Stats() const;
+    // Looks at the clock again; for tests that moved a substituted one
+    void Poll();
+
+    // Delay before retry number `failures` (0 = first retry, immediate).
+    // `unit_random` is in [0, 1).
+    static std::chrono::milliseconds BackoffDelay(const ReconnectOptions& options, uint32_t failures,
+                                                  double unit_random);
+
+private:
+    enum class State { Disabled, Waiting, Connecting, Connected };
+
+    void Run();
+    void ScheduleLocked(std::chrono::steady_clock::time_point now);
+    std::chrono::steady_clock::time_point Now() const;
+
+    AttemptFn attempt_;
+    ReconnectOptions options_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    State state_ = State::Disabled;
+    bool shutdown_ = false;
+    uint32_t failures_ = 0;
+    std::chrono::steady_clock::time_point deadline_;
+    std::chrono::steady_clock::time_point down_since_;
+    bool down_ = false;
+    bool first_connect_ = false;  // the initial connect isn't a reconnect
+    ReconnectStats stats_;
+    std::mt19937 rng_{ std::random_device{}() };
+    std::thread thread_;
+};
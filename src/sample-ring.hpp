@@ -0,0 +1,103 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Lock-free single-producer / multi-consumer ring of sequence-numbered
+// samples. The producer never waits: once the ring is full it overwrites the
+// oldest slot. Each slot carries the sequence number it holds, so readers
+// validate a copy seqlock-style and can tell a missed sample from one that
+// has not been published yet.
+//
+// Sequence numbers start at 1; 0 means "nothing published".
+template <typename T, size_t Capacity>
+class SampleRing {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    static_assert(std::is_trivially_copyable_v<T>, "Samples are copied without locks");
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> seq{0};
+        T value{};
+    };
+
+    Slot slots_[Capacity];
+    alignas(64) std::atomic<uint64_t> head_{0};
+
+public:
+    enum class ReadStatus {
+        Ok,
+        NotYet,       // seq has not been published
+        Overwritten,  // reader fell behind by more than Capacity
+    };
+
+    static constexpr size_t capacity() { return Capacity; }
+
+    // Producer side. Must only ever be called from one thread at a time.
+    uint64_t Publish(const T& value) {
+        uint64_t seq = head_.load(std::memory_order_relaxed) + 1;
+        Slot& slot = slots_[seq & (Capacity - 1)];
+
+        // Mark the slot busy before touching the payload
+        slot.seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.value = value;
+        slot.seq.store(seq, std::memory_order_release);
+        head_.store(seq, std::memory_order_release);
+        return seq;
+    }
+
+    uint64_t Head() const { return head_.load(std::memory_order_acquire); }
+
+    // Oldest sequence number that may still be readable
+    uint64_t Oldest() const {
+        uint64_t head = Head();
+        return head > Capacity ? head - Capacity + 1 : 1;
+    }
+
+    ReadStatus Read(uint64_t seq, T& out) const {
+        if (seq == 0 || seq > Head()) return ReadStatus::NotYet;
+
+        const Slot& slot = slots_[seq & (Capacity - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != seq) return ReadStatus::Overwritten;
+        out = slot.value;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != seq) return ReadStatus::Overwritten;
+        return ReadStatus::Ok;
+    }
+
+    // Copies the newest sample. Returns its sequence number, or 0 if empty.
+    uint64_t ReadLatest(T& out) const {
+        for (;;) {
+            uint64_t head = Head();
+            if (head == 0) return 0;
+            if (Read(head, out) == ReadStatus::Ok) return head;
+        }
+    }
+
+    // Calls fn(seq, sample) for every readable sample newer than `since`, in
+    // order. Returns the last sequence number visited (or `since` if none);
+    // `dropped` receives how many samples the reader lost to overwrites.
+    template <typename Fn>
+    uint64_t ReadSince(uint64_t since, Fn&& fn, uint64_t* dropped = nullptr) const {
+        uint64_t head = Head();
+        uint64_t seq = since + 1;
+        uint64_t lost = 0;
+        if (seq < Oldest()) {
+            lost += Oldest() - seq;
+            seq = Oldest();
+        }
+        uint64_t last = since;
+        T value;
+        for (; seq <= head; ++seq) {
+            if (Read(seq, value) == ReadStatus::Ok) {
+                fn(seq, value);
+            } else {
+                ++lost;
+            }
+            last = seq;
+        }
+        if (dropped) *dropped = lost;
+        return last;
+    }
+};
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <span>
+#include <string_view>
+
+// data/web as compiled into the plugin by cmake/embed-web-assets.cmake.
+// Variants are nullptr when compression didn't make the file smaller (or,
+// for brotli, when no encoder was available at build time).
+struct EmbeddedAsset {
+    std::string_view name;  // path under data/web
+    const char* mime;
+    const char* etag;  // quoted, from the file's SHA-256; one per variant
+    const char* gzip_etag;
+    const char* brotli_etag;
+    const unsigned char* data;
+    size_t size;
+    const unsigned char* gzip;
+    size_t gzip_size;
+    const unsigned char* brotli;
+    size_t brotli_size;
+
+    // Pages bundled at build time: the files inlined into data (comma
+    // separated), and the page as written for when one of them is
+    // overridden on disk. Empty / nullptr for everything else.
+    std::string_view inlined;
+    const unsigned char* source;
+    size_t source_size;
+    const char* source_etag;
+};
+
+std::span<const EmbeddedAsset> EmbeddedAssets();
+const EmbeddedAsset* FindEmbeddedAsset(std::string_view name);
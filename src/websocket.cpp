@@ -0,0 +1,643 @@
+#include "websocket.hpp"
+#include <obs-module.h>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#endif
+
+using namespace httplib::detail;
+
+// A stalled peer gets this long to finish a frame or take our bytes
+static const int FRAME_TIMEOUT_S = 5;
+// How long a new connection may take to show its request line
+static const auto UPGRADE_SNIFF_TIMEOUT = std::chrono::seconds(5);
+static const size_t MAX_HANDSHAKE_SIZE = 8192;
+static const char* WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// SHA-1, only for Sec-WebSocket-Accept; httplib has none without OpenSSL
+std::array<uint8_t, 20> WebSocket::Sha1(std::string_view input) {
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    std::string msg(input);
+    uint64_t bit_length = (uint64_t)input.size() * 8;
+    msg.push_back((char)0x80);
+    while (msg.size() % 64 != 56) msg.push_back(0);
+    for (int i = 7; i >= 0; --i) msg.push_back((char)(bit_length >> (i * 8)));
+
+    auto rotl = [](uint32_t v, int n) { return (v << n) | (v >> (32 - n)); };
+    for (size_t chunk = 0; chunk < msg.size(); chunk += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i) {
+            const uint8_t* p = (const uint8_t*)msg.data() + chunk + i * 4;
+            w[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+        }
+        for (int i = 16; i < 80; ++i) w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t t = rotl(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotl(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+
+    std::array<uint8_t, 20> digest;
+    for (int i = 0; i < 20; ++i) digest[i] = (uint8_t)(h[i / 4] >> (24 - (i % 4) * 8));
+    return digest;
+}
+
+std::string WebSocket::AcceptKey(std::string_view key) {
+    auto digest = Sha1(std::string(key) + WEBSOCKET_GUID);
+    return base64_encode(std::string((const char*)digest.data(), digest.size()));
+}
+
+// Strict UTF-8: no overlong forms, surrogates or code points past U+10FFFF
+bool WebSocket::IsValidUtf8(std::string_view s) {
+    size_t i = 0;
+    while (i < s.size()) {
+        uint8_t c = (uint8_t)s[i];
+        size_t extra;
+        uint32_t cp;
+        if (c < 0x80) {
+            ++i;
+            continue;
+        } else if ((c & 0xE0) == 0xC0) {
+            extra = 1;
+            cp = c & 0x1F;
+        } else if ((c & 0xF0) == 0xE0) {
+            extra = 2;
+            cp = c & 0x0F;
+        } else if ((c & 0xF8) == 0xF0) {
+            extra = 3;
+            cp = c & 0x07;
+        } else {
+            return false;
+        }
+        if (i + extra >= s.size()) return false;
+        for (size_t j = 1; j <= extra; ++j) {
+            uint8_t cc = (uint8_t)s[i + j];
+            if ((cc & 0xC0) != 0x80) return false;
+            cp = (cp << 6) | (cc & 0x3F);
+        }
+        static const uint32_t min_cp[4] = { 0, 0x80, 0x800, 0x10000 };
+        if (cp < min_cp[extra] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return false;
+        i += extra + 1;
+    }
+    return true;
+}
+
+bool WebSocket::ValidCloseCode(uint16_t code) {
+    if (code >= 3000 && code <= 4999) return true;
+    return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1011);
+}
+
+static bool SendAll(socket_t sock, const char* data, size_t size) {
+    while (size > 0) {
+        if (select_write(sock, FRAME_TIMEOUT_S, 0) <= 0) return false;
+        ssize_t n = send_socket(sock, data, size, CPPHTTPLIB_SEND_FLAGS);
+        if (n <= 0) return false;
+        data += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+// A request already read into memory, answered into a string
+class BufferedStream final : public httplib::Stream {
+public:
+    BufferedStream(socket_t sock, std::string_view in, std::string& out) : sock_(sock), in_(in), out_(out) {}
+
+    bool is_readable() const override { return pos_ < in_.size(); }
+    bool wait_readable() const override { return true; }
+    bool wait_writable() const override { return true; }
+    ssize_t read(char* ptr, size_t size) override {
+        size = std::min(size, in_.size() - pos_);
+        memcpy(ptr, in_.data() + pos_, size);
+        pos_ += size;
+        return (ssize_t)size;
+    }
+    ssize_t write(const char* ptr, size_t size) override {
+        out_.append(ptr, size);
+        return (ssize_t)size;
+    }
+    void get_remote_ip_and_port(std::string& ip, int& port) const override {
+        httplib::detail::get_remote_ip_and_port(sock_, ip, port);
+    }
+    void get_local_ip_and_port(std::string& ip, int& port) const override {
+        httplib::detail::get_local_ip_and_port(sock_, ip, port);
+    }
+    socket_t socket() const override { return sock_; }
+    time_t duration() const override { return 0; }
+
+private:
+    socket_t sock_;
+    std::string_view in_;
+    size_t pos_ = 0;
+    std::string& out_;
+};
+
+// Set while ServeBuffered runs a request on this thread; Stream() routes
+// park their poll here instead of driving it
+static thread_local WebSocketServer::StreamPoll* t_deferred_poll = nullptr;
+
+// ---- WebSocket ------------------------------------------------------------
+
+WebSocket::WebSocket(socket_t sock, size_t max_message, std::function<bool()> stopping)
+    : sock_(sock), max_message_(max_message), stopping_(std::move(stopping)) {}
+
+bool WebSocket::ReadExact(void* data, size_t size) {
+    char* out = (char*)data;
+    while (size > 0) {
+        if (select_read(sock_, FRAME_TIMEOUT_S, 0) <= 0) return false;
+        ssize_t n = read_socket(sock_, out, size, 0);
+        if (n <= 0) return false;
+        out += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+WebSocket::FrameStatus WebSocket::ReadFrame(bool& fin, Opcode& opcode, std::string& payload, int timeout_ms) {
+    ssize_t ready = select_read(sock_, timeout_ms / 1000, (timeout_ms % 1000) * 1000);
+    if (ready == 0) return FrameStatus::Timeout;
+
+    uint8_t head[2];
+    if (ready < 0 || !ReadExact(head, 2)) {
+        open_ = false;
+        return FrameStatus::Closed;
+    }
+    fin = (head[0] & 0x80) != 0;
+    uint8_t op = head[0] & 0x0F;
+    bool masked = (head[1] & 0x80) != 0;
+    uint64_t length = head[1] & 0x7F;
+
+    // No extensions are negotiated, so RSV bits must be clear; clients must mask
+    bool known = op <= 0x2 || (op >= 0x8 && op <= 0xA);
+    bool control = (op & 0x8) != 0;
+    if ((head[0] & 0x70) || !masked || !known || (control && (!fin || length > 125))) {
+        Fail(CLOSE_PROTOCOL_ERROR);
+        return FrameStatus::Closed;
+    }
+    opcode = (Opcode)op;
+
+    if (length >= 126) {
+        uint8_t ext[8];
+        size_t ext_size = length == 126 ? 2 : 8;
+        if (!ReadExact(ext, ext_size)) {
+            open_ = false;
+            return FrameStatus::Closed;
+        }
+        length = 0;
+        for (size_t i = 0; i < ext_size; ++i) length = (length << 8) | ext[i];
+        if (length >> 63) {
+            Fail(CLOSE_PROTOCOL_ERROR);
+            return FrameStatus::Closed;
+        }
+    }
+    if (length > max_message_) {
+        Fail(CLOSE_TOO_BIG);
+        return FrameStatus::Closed;
+    }
+
+    uint8_t mask[4];
+    payload.resize((size_t)length);
+    if (!ReadExact(mask, 4) || !ReadExact(payload.data(), payload.size())) {
+        open_ = false;
+        return FrameStatus::Closed;
+    }
+    for (size_t i = 0; i < payload.size(); ++i) payload[i] ^= (char)mask[i & 3];
+    return FrameStatus::Ok;
+}
+
+WebSocket::ReadStatus WebSocket::Read(std::string& message, Opcode& opcode, int timeout_ms) {
+    std::string payload;
+    for (;;) {
+        if (!open_) return ReadStatus::Closed;
+        if (stopping_ && stopping_()) {
+            Close(CLOSE_GOING_AWAY);
+            return ReadStatus::Closed;
+        }
+
+        bool fin = false;
+        Opcode op = Opcode::Continuation;
+        FrameStatus status = ReadFrame(fin, op, payload, timeout_ms);
+        if (status == FrameStatus::Closed) return ReadStatus::Closed;
+        if (status == FrameStatus::Timeout) return ReadStatus::Timeout;
+
+        switch (op) {
+        case Opcode::Ping: {
+            std::lock_guard<std::mutex> lock(send_mutex_);
+            if (!close_sent_) SendFrame(Opcode::Pong, payload.data(), payload.size());
+            continue;
+        }
+        case Opcode::Pong:
+            continue;
+        case Opcode::Close: {
+            close_received_ = true;
+            uint16_t code = CLOSE_NORMAL;
+            if (payload.size() == 1) {
+                Fail(CLOSE_PROTOCOL_ERROR);
+                return ReadStatus::Closed;
+            }
+            if (payload.size() >= 2) {
+                code = (uint16_t)((uint8_t)payload[0] << 8 | (uint8_t)payload[1]);
+                if (!ValidCloseCode(code)) {
+                    Fail(CLOSE_PROTOCOL_ERROR);
+                    return ReadStatus::Closed;
+                }
+                if (!IsValidUtf8(std::string_view(payload).substr(2))) {
+                    Fail(CLOSE_INVALID_PAYLOAD);
+                    return ReadStatus::Closed;
+                }
+            }
+            // Echo the peer's code to complete the closing handshake
+            Close(code);
+            return ReadStatus::Closed;
+        }
+        case Opcode::Text:
+        case Opcode::Binary:
+            if (partial_opcode_ != Opcode::Continuation) {
+                // A new message may not start inside a fragmented one
+                Fail(CLOSE_PROTOCOL_ERROR);
+                return ReadStatus::Closed;
+            }
+            if (!fin) {
+                partial_opcode_ = op;
+                partial_ = std::move(payload);
+                payload.clear();
+                continue;
+            }
+            message = std::move(payload);
+            opcode = op;
+            break;
+        case Opcode::Continuation:
+            if (partial_opcode_ == Opcode::Continuation) {
+                Fail(CLOSE_PROTOCOL_ERROR);
+                return ReadStatus::Closed;
+            }
+            if (partial_.size() + payload.size() > max_message_) {
+                Fail(CLOSE_TOO_BIG);
+                return ReadStatus::Closed;
+            }
+            partial_ += payload;
+            if (!fin) continue;
+            message = std::move(partial_);
+            opcode = partial_opcode_;
+            partial_.clear();
+            partial_opcode_ = Opcode::Continuation;
+            break;
+        }
+
+        if (opcode == Opcode::Text && !IsValidUtf8(message)) {
+            Fail(CLOSE_INVALID_PAYLOAD);
+            return ReadStatus::Closed;
+        }
+        return ReadStatus::Message;
+    }
+}
+
+void WebSocket::EncodeFrame(std::string& out, Opcode opcode, const void* data, size_t size) {
+    out.reserve(out.size() + size + 10);
+    out.push_back((char)(0x80 | (uint8_t)opcode));
+    if (size < 126) {
+        out.push_back((char)size);
+    } else if (size <= 0xFFFF) {
+        out.push_back((char)126);
+        out.push_back((char)(size >> 8));
+        out.push_back((char)size);
+    } else {
+        out.push_back((char)127);
+        for (int i = 7; i >= 0; --i) out.push_back((char)((uint64_t)size >> (i * 8)));
+    }
+    out.append((const char*)data, size);
+}
+
+bool WebSocket::SendFrame(Opcode opcode, const void* data, size_t size) {
+    // Header and payload go out in one send so small frames are one segment
+    std::string frame;
+    EncodeFrame(frame, opcode, data, size);
+    if (!SendAll(sock_, frame.data(), frame.size())) {
+        open_ = false;
+        return false;
+    }
+    return true;
+}
+
+bool WebSocket::Send(Opcode opcode, const void* data, size_t size) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    if (close_sent_ || !open_) return false;
+    return SendFrame(opcode, data, size);
+}
+
+bool WebSocket::SendEncoded(std::string_view frame) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    if (close_sent_ || !open_) return false;
+    if (!SendAll(sock_, frame.data(), frame.size())) {
+        open_ = false;
+        return false;
+    }
+    return true;
+}
+
+void WebSocket::Close(uint16_t code, std::string_view reason) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    if (close_sent_) return;
+    close_sent_ = true;
+    std::string payload;
+    payload.push_back((char)(code >> 8));
+    payload.push_back((char)code);
+    payload.append(reason.substr(0, 123));
+    if (open_) SendFrame(Opcode::Close, payload.data(), payload.size());
+    open_ = false;
+}
+
+void WebSocket::Fail(uint16_t code) {
+    failed_ = true;
+    Close(code);
+}
+
+void WebSocket::Finish() {
+    if (open_) Close(stopping_ && stopping_() ? CLOSE_GOING_AWAY : CLOSE_NORMAL);
+    if (failed_ || close_received_) return;
+
+    // Give the peer a moment to answer our Close so the TCP close is clean
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    std::string payload;
+    while (std::chrono::steady_clock::now() < deadline) {
+        bool fin;
+        Opcode op;
+        if (ReadFrame(fin, op, payload, 100) == FrameStatus::Closed) return;
+        if (op == Opcode::Close) return;
+    }
+}
+
+// ---- WebSocketServer --------------------------------------------------------
+
+WebSocketServer& WebSocketServer::Upgrade(const std::string& path, Handler handler) {
+    upgrades_.emplace_back(path, std::move(handler));
+    return *this;
+}
+
+WebSocketServer& WebSocketServer::Stream(const std::string& pattern, StreamHandler handler) {
+    Get(pattern, [this, handler = std::move(handler)](const httplib::Request& req, httplib::Response& res) {
+        StreamPoll poll = handler(req, res);
+        if (!poll) return;
+        std::string type = res.get_header_value("Content-Type");
+        res.headers.erase("Content-Type");
+        if (t_deferred_poll) {
+            // ServeBuffered is on the stack: hand the poll to its caller. The
+            // provider only makes httplib write the head; returning false
+            // stops it before any of the body.
+            *t_deferred_poll = std::move(poll);
+            res.set_chunked_content_provider(type, [](size_t, httplib::DataSink&) { return false; });
+            return;
+        }
+        res.set_chunked_content_provider(
+            type, [this, poll = std::move(poll), out = std::string()](size_t, httplib::DataSink& sink) mutable {
+                uint64_t seen;
+                {
+                    std::lock_guard<std::mutex> lock(wake_mutex_);
+                    seen = wake_count_;
+                }
+                out.clear();
+                bool more = poll(out);
+                if (!out.empty() && !sink.write(out.data(), out.size())) return false;
+                if (!more) {
+                    sink.done();
+                } else if (out.empty()) {
+                    WaitForWake(seen, std::chrono::seconds(1));
+                }
+                return true;
+            });
+    });
+    return *this;
+}
+
+void WebSocketServer::Wake() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        ++wake_count_;
+    }
+    wake_cv_.notify_all();
+}
+
+void WebSocketServer::WaitForWake(uint64_t seen, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    wake_cv_.wait_for(lock, timeout, [&]() { return wake_count_ != seen || IsStopping(); });
+}
+
+void WebSocketServer::Stop() {
+    stop();
+    Wake();
+}
+
+const WebSocketServer::Handler* WebSocketServer::FindUpgrade(std::string_view request_line, bool& need_more) const {
+    need_more = false;
+    for (const auto& [path, handler] : upgrades_) {
+        std::string prefix = "GET " + path;
+        size_t common = std::min(request_line.size(), prefix.size());
+        if (request_line.substr(0, common) != std::string_view(prefix).substr(0, common)) continue;
+        if (request_line.size() <= prefix.size()) {
+            need_more = true;
+            continue;
+        }
+        char next = request_line[prefix.size()];
+        if (next == ' ' || next == '?') return &handler;
+    }
+    return nullptr;
+}
+
+// Peeks at the request line without consuming it, so anything that isn't
+// an upgrade path goes to httplib untouched
+const WebSocketServer::Handler* WebSocketServer::MatchUpgrade(socket_t sock) const {
+    if (upgrades_.empty()) return nullptr;
+
+    auto deadline = std::chrono::steady_clock::now() + UPGRADE_SNIFF_TIMEOUT;
+    char buf[256];
+    while (!IsStopping() && std::chrono::steady_clock::now() < deadline) {
+        if (select_read(sock, 0, 100000) <= 0) continue;
+        ssize_t n = read_socket(sock, buf, sizeof(buf), MSG_PEEK);
+        if (n <= 0) return nullptr;
+
+        bool need_more;
+        const Handler* handler = FindUpgrade(std::string_view(buf, (size_t)n), need_more);
+        if (handler || !need_more) return handler;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return nullptr;
+}
+
+static void SendHttpError(socket_t sock, const char* status, const char* extra_headers = "") {
+    std::string response = std::string("HTTP/1.1 ") + status + "\r\n" + extra_headers +
+                           "Content-Length: 0\r\nConnection: close\r\n\r\n";
+    SendAll(sock, response.data(), response.size());
+}
+
+bool WebSocketServer::Handshake(socket_t sock, httplib::Request& req) {
+    // Consume exactly the request head; a client may not send frames before our 101
+    std::string head;
+    auto deadline = std::chrono::steady_clock::now() + UPGRADE_SNIFF_TIMEOUT;
+    size_t end = std::string::npos;
+    while (end == std::string::npos) {
+        if (std::chrono::steady_clock::now() >= deadline || head.size() >= MAX_HANDSHAKE_SIZE) {
+            SendHttpError(sock, "400 Bad Request");
+            return false;
+        }
+        if (select_read(sock, 0, 100000) <= 0) continue;
+        char buf[1024];
+        ssize_t n = read_socket(sock, buf, sizeof(buf), MSG_PEEK);
+        if (n <= 0) return false;
+        std::string_view peeked(buf, (size_t)n);
+        size_t found = (head + std::string(peeked)).find("\r\n\r\n");
+        size_t take = found == std::string::npos ? (size_t)n : found + 4 - head.size();
+        if (read_socket(sock, buf, take, 0) != (ssize_t)take) return false;
+        head.append(buf, take);
+        if (found != std::string::npos) end = found;
+    }
+    return AcceptUpgrade(sock, head, req);
+}
+
+bool WebSocketServer::AcceptUpgrade(socket_t sock, std::string_view head_view, httplib::Request& req) {
+    std::string head(head_view);
+    size_t end = head.find("\r\n\r\n");
+    if (end == std::string::npos) {
+        SendHttpError(sock, "400 Bad Request");
+        return false;
+    }
+
+    // Request line and headers
+    size_t line_end = head.find("\r\n");
+    std::string request_line = head.substr(0, line_end);
+    size_t sp1 = request_line.find(' ');
+    size_t sp2 = request_line.rfind(' ');
+    if (sp1 == std::string::npos || sp2 <= sp1) {
+        SendHttpError(sock, "400 Bad Request");
+        return false;
+    }
+    req.method = request_line.substr(0, sp1);
+    req.target = request_line.substr(sp1 + 1, sp2 - sp1 - 1);
+    req.version = request_line.substr(sp2 + 1);
+    size_t query = req.target.find('?');
+    req.path = httplib::decode_path_component(req.target.substr(0, query));
+    if (query != std::string::npos) parse_query_text(req.target.substr(query + 1), req.params);
+
+    for (size_t pos = line_end + 2; pos < end;) {
+        size_t next = head.find("\r\n", pos);
+        std::string line = head.substr(pos, next - pos);
+        pos = next + 2;
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        size_t value_start = line.find_first_not_of(" \t", colon + 1);
+        req.headers.emplace(line.substr(0, colon),
+                            value_start == std::string::npos ? "" : line.substr(value_start));
+    }
+
+    auto contains_token = [](std::string value, const char* token) {
+        for (auto& c : value) c = (char)tolower((unsigned char)c);
+        return value.find(token) != std::string::npos;
+    };
+    std::string key = req.get_header_value("Sec-WebSocket-Key");
+    if (req.method != "GET" || req.version != "HTTP/1.1" ||
+        !contains_token(req.get_header_value("Upgrade"), "websocket") ||
+        !contains_token(req.get_header_value("Connection"), "upgrade") || key.empty()) {
+        SendHttpError(sock, "400 Bad Request");
+        return false;
+    }
+    if (req.get_header_value("Sec-WebSocket-Version") != "13") {
+        SendHttpError(sock, "426 Upgrade Required", "Sec-WebSocket-Version: 13\r\n");
+        return false;
+    }
+
+    std::string accept = WebSocket::AcceptKey(key);
+    std::string response = "HTTP/1.1 101 Switching Protocols\r\n"
+                           "Upgrade: websocket\r\n"
+                           "Connection: Upgrade\r\n"
+                           "Sec-WebSocket-Accept: " + accept + "\r\n\r\n";
+    return SendAll(sock, response.data(), response.size());
+}
+
+// httplib::Server::process_and_close_socket is private; this is its body,
+// built from the protected pieces
+bool WebSocketServer::ServeHttp(socket_t sock) {
+    std::string remote_addr;
+    int remote_port = 0;
+    get_remote_ip_and_port(sock, remote_addr, remote_port);
+    std::string local_addr;
+    int local_port = 0;
+    get_local_ip_and_port(sock, local_addr, local_port);
+
+    bool ret = process_server_socket(
+        svr_sock_, sock, keep_alive_max_count_, keep_alive_timeout_sec_, read_timeout_sec_, read_timeout_usec_,
+        write_timeout_sec_, write_timeout_usec_,
+        [&](httplib::Stream& strm, bool close_connection, bool& connection_closed) {
+            return process_request(strm, remote_addr, remote_port, local_addr, local_port, close_connection,
+                                   connection_closed, nullptr);
+        });
+
+    shutdown_socket(sock);
+    close_socket(sock);
+    return ret;
+}
+
+void WebSocketServer::RunUpgrade(socket_t sock, const Handler& handler, const httplib::Request& req) {
+    // Frames are small and latency matters more than segment count
+    int nodelay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&nodelay, sizeof(nodelay));
+
+    WebSocket ws(sock, max_message_, [this]() { return IsStopping(); });
+    handler(req, ws);
+    ws.Finish();
+}
+
+bool WebSocketServer::process_and_close_socket(socket_t sock) {
+    const Handler* handler = MatchUpgrade(sock);
+    if (!handler) return ServeHttp(sock);
+
+    httplib::Request req;
+    if (Handshake(sock, req)) RunUpgrade(sock, *handler, req);
+    shutdown_socket(sock);
+    close_socket(sock);
+    return true;
+}
+
+bool WebSocketServer::ServeBuffered(socket_t sock, std::string_view request, std::string& out,
+                                    bool close_connection, bool& connection_closed, StreamPoll& poll) {
+    BufferedStream strm(sock, request, out);
+    std::string remote_addr, local_addr;
+    int remote_port = 0, local_port = 0;
+    get_remote_ip_and_port(sock, remote_addr, remote_port);
+    get_local_ip_and_port(sock, local_addr, local_port);
+
+    poll = nullptr;
+    t_deferred_poll = &poll;
+    bool ret = process_request(strm, remote_addr, remote_port, local_addr, local_port, close_connection,
+                               connection_closed, nullptr);
+    t_deferred_poll = nullptr;
+    // A deferred stream "fails" on purpose once its head is written
+    return ret || poll;
+}
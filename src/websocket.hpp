@@ -0,0 +1,161 @@
+#pragma once
+#include "httplib.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Server side of an RFC 6455 connection. httplib hands over the socket
+// right after the handshake; from then on one thread reads (Read) and any
+// thread may write (Send). Control frames are answered inside Read.
+class WebSocket {
+public:
+    enum class Opcode : uint8_t {
+        Continuation = 0x0,
+        Text = 0x1,
+        Binary = 0x2,
+        Close = 0x8,
+        Ping = 0x9,
+        Pong = 0xA,
+    };
+
+    enum class ReadStatus {
+        Message,  // a complete text or binary message
+        Timeout,  // nothing arrived within timeout_ms
+        Closed,   // closing handshake done, peer gone, or protocol error
+    };
+
+    // Close codes used by the server (RFC 6455 section 7.4.1)
+    enum : uint16_t {
+        CLOSE_NORMAL = 1000,
+        CLOSE_GOING_AWAY = 1001,
+        CLOSE_PROTOCOL_ERROR = 1002,
+        CLOSE_UNSUPPORTED = 1003,
+        CLOSE_INVALID_PAYLOAD = 1007,
+        CLOSE_POLICY = 1008,
+        CLOSE_TOO_BIG = 1009,
+    };
+
+    WebSocket(socket_t sock, size_t max_message, std::function<bool()> stopping);
+
+    // Waits up to timeout_ms for the next data message. Fragments are
+    // reassembled and text is checked to be UTF-8.
+    ReadStatus Read(std::string& message, Opcode& opcode, int timeout_ms);
+
+    // One unfragmented frame. Returns false once the connection is closed.
+    bool Send(Opcode opcode, const void* data, size_t size);
+    bool SendText(std::string_view text) { return Send(Opcode::Text, text.data(), text.size()); }
+    bool SendBinary(const void* data, size_t size) { return Send(Opcode::Binary, data, size); }
+    // A frame built with EncodeFrame, so one encoding serves every client
+    bool SendEncoded(std::string_view frame);
+    // Appends a complete unmasked server frame to out
+    static void EncodeFrame(std::string& out, Opcode opcode, const void* data, size_t size);
+
+    // Starts the closing handshake; Read() returns Closed from then on
+    void Close(uint16_t code, std::string_view reason = {});
+    bool IsOpen() const { return open_; }
+
+    // Protocol pieces, public so the tests can check them directly
+    static std::array<uint8_t, 20> Sha1(std::string_view input);
+    // Sec-WebSocket-Accept for a client's Sec-WebSocket-Key
+    static std::string AcceptKey(std::string_view key);
+    static bool IsValidUtf8(std::string_view s);
+    // Whether a peer may send this code in a Close frame
+    static bool ValidCloseCode(uint16_t code);
+
+private:
+    friend class WebSocketServer;
+
+    enum class FrameStatus { Ok, Timeout, Closed };
+    FrameStatus ReadFrame(bool& fin, Opcode& opcode, std::string& payload, int timeout_ms);
+    bool ReadExact(void* data, size_t size);
+    bool SendFrame(Opcode opcode, const void* data, size_t size);
+    void Fail(uint16_t code);
+    // After the handler: close if it didn't and wait briefly for the echo
+    void Finish();
+
+    socket_t sock_;
+    size_t max_message_;
+    std::function<bool()> stopping_;
+    std::atomic<bool> open_{true};
+    bool close_sent_ = false;  // under send_mutex_
+    std::mutex send_mutex_;
+
+    // Reader thread only
+    bool failed_ = false;          // protocol error; no closing handshake
+    bool close_received_ = false;
+    std::string partial_;          // fragmented message being reassembled
+    Opcode partial_opcode_ = Opcode::Continuation;
+};
+
+// httplib::Server that also accepts WebSocket upgrades on registered
+// paths. The connection is claimed before httplib parses the request, so
+// the handler owns the socket (and its worker thread) until it returns.
+//
+// Stream() routes answer over time without blocking: their poll is called
+// again after every Wake() and at least once a second. Here each one is
+// driven from its worker thread; EpollServer drives them all from its loop.
+class WebSocketServer : public httplib::Server {
+public:
+    using Handler = std::function<void(const httplib::Request& req, WebSocket& ws)>;
+    // Appends whatever is ready to out, which goes out as one chunk.
+    // Returns false once the response is complete. Must not block.
+    using StreamPoll = std::function<bool(std::string& out)>;
+    // Sets the status and headers (Content-Type included) and returns the
+    // poll that writes the body; or fills res completely and returns none
+    using StreamHandler = std::function<StreamPoll(const httplib::Request& req, httplib::Response& res)>;
+
+    // httplib writes a response's head and body separately; with Nagle on,
+    // the body waits for the client's delayed ACK on every keep-alive request
+    WebSocketServer() { set_tcp_nodelay(true); }
+
+    WebSocketServer& Upgrade(const std::string& path, Handler handler);
+    WebSocketServer& Stream(const std::string& pattern, StreamHandler handler);
+
+    // Largest message a client may send; bigger ones close with 1009
+    void set_websocket_max_message(size_t size) { max_message_ = size; }
+
+    // Thread-safe: something Stream() polls may be waiting for has changed
+    virtual void Wake();
+    // Serves on the socket from bind_to_port until Stop()
+    virtual bool Listen() { return listen_after_bind(); }
+    virtual void Stop();
+
+protected:
+    virtual bool IsStopping() const { return !is_running(); }
+
+    // The route for a request line ("GET /path?query HTTP/1.1"). need_more
+    // is set when the line is cut short and might still match.
+    const Handler* FindUpgrade(std::string_view request_line, bool& need_more) const;
+    // Parses a complete request head and answers the handshake
+    bool AcceptUpgrade(socket_t sock, std::string_view head, httplib::Request& req);
+    // Runs an accepted upgrade to the end on the calling thread
+    void RunUpgrade(socket_t sock, const Handler& handler, const httplib::Request& req);
+
+    // Routes one complete request that was read into memory. The response
+    // is appended to out; for a Stream() route only its head is, and the
+    // poll for the body comes back in poll.
+    bool ServeBuffered(socket_t sock, std::string_view request, std::string& out, bool close_connection,
+                       bool& connection_closed, StreamPoll& poll);
+
+private:
+    bool process_and_close_socket(socket_t sock) override;
+    bool ServeHttp(socket_t sock);
+    const Handler* MatchUpgrade(socket_t sock) const;
+    bool Handshake(socket_t sock, httplib::Request& req);
+    // Blocks until Wake() is called after `seen` was read, or the timeout passes
+    void WaitForWake(uint64_t seen, std::chrono::milliseconds timeout);
+
+    std::vector<std::pair<std::string, Handler>> upgrades_;
+    size_t max_message_ = 64 * 1024;
+
+    std::mutex wake_mutex_;
+    std::condition_variable wake_cv_;
+    uint64_t wake_count_ = 0;
+};
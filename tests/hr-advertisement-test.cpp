@@ -0,0 +1,115 @@
+#include "hr-advertisement.hpp"
+#include "test.hpp"
+#include <vector>
+
+// Advertisements as they appear on air (flags, name, data sections),
+// scan response appended where a band puts the data there.
+
+// Mi Band in "heart rate broadcast" mode: Huami manufacturer data, BPM 0x4E
+static const std::vector<uint8_t> kMiBandBroadcast = {
+    0x02, 0x01, 0x06,                                                  // flags
+    0x0F, 0xFF, 0x57, 0x01, 0x02, 0xFF, 0xFF, 0x4E, 0x00, 0x00, 0x00,  // Huami data
+    0x00, 0x00, 0x00, 0x00, 0x00,
+    0x0C, 0x09, 'X', 'i', 'a', 'o', 'm', 'i', ' ', 'B', 'a', 'n', 'd',  // complete name
+};
+
+// Same band before it has a reading
+static const std::vector<uint8_t> kMiBandNoReading = {
+    0x02, 0x01, 0x06,
+    0x0F, 0xFF, 0x57, 0x01, 0x02, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+// Standard service data: UUID 0x180D followed by a 0x2A37 measurement
+// (contact detected, 8-bit BPM 63, one RR interval of 975/1024 s)
+static const std::vector<uint8_t> kServiceData = {
+    0x02, 0x01, 0x06,
+    0x03, 0x03, 0x0D, 0x18,                          // complete list of 16-bit UUIDs
+    0x08, 0x16, 0x0D, 0x18, 0x16, 0x3F, 0xCF, 0x03, 0x00,  // service data, trailing odd byte
+};
+
+static void TestHuamiBroadcast() {
+    HeartRateMeasurement m;
+    CHECK(DecodeAdvertisementHeartRate(kMiBandBroadcast, m));
+    CHECK_EQ(m.bpm, 0x4E);
+    CHECK_EQ(m.rr_count, 0);
+    CHECK(!DecodeAdvertisementHeartRate(kMiBandNoReading, m));
+
+    std::vector<uint8_t> zero = kMiBandBroadcast;
+    zero[10] = 0x00;
+    CHECK(!DecodeAdvertisementHeartRate(zero, m));
+
+    // Another company's data with the same shape is not a heart rate
+    std::vector<uint8_t> other = kMiBandBroadcast;
+    other[5] = 0x4C;
+    other[6] = 0x00;
+    CHECK(!DecodeAdvertisementHeartRate(other, m));
+}
+
+static void TestServiceData() {
+    HeartRateMeasurement m;
+    CHECK(DecodeAdvertisementHeartRate(kServiceData, m));
+    CHECK_EQ(m.bpm, 63);
+    CHECK(m.contact_supported);
+    CHECK(m.contact_detected);
+    CHECK_EQ(m.rr_count, 1);
+    CHECK_EQ(m.rr_intervals[0], 975);
+
+    // A zero BPM is no reading
+    std::vector<uint8_t> zero = kServiceData;
+    zero[12] = 0;
+    CHECK(!DecodeAdvertisementHeartRate(zero, m));
+
+    // Service data for another UUID
+    std::vector<uint8_t> battery = kServiceData;
+    battery[9] = 0x0F;
+    CHECK(!DecodeAdvertisementHeartRate(battery, m));
+}
+
+static void TestMalformed() {
+    HeartRateMeasurement m;
+    CHECK(!DecodeAdvertisementHeartRate({}, m));
+
+    // Length runs past the end
+    std::vector<uint8_t> overrun(kMiBandBroadcast.begin(), kMiBandBroadcast.begin() + 10);
+    CHECK(!DecodeAdvertisementHeartRate(overrun, m));
+
+    // Zero padding ends the structures; data after it is ignored
+    std::vector<uint8_t> padded = { 0x02, 0x01, 0x06, 0x00 };
+    padded.insert(padded.end(), kMiBandBroadcast.begin() + 3, kMiBandBroadcast.end());
+    CHECK(!DecodeAdvertisementHeartRate(padded, m));
+
+    // Huami data too short to hold a BPM
+    CHECK(!DecodeAdvertisementHeartRate(std::vector<uint8_t>{ 0x05, 0xFF, 0x57, 0x01, 0x02, 0xFF }, m));
+}
+
+static void TestBuilderRoundTrip() {
+    // How WinRT and BlueZ hand the sections over: already parsed
+    const uint8_t huami[] = { 0x02, 0xFF, 0xFF, 0x4E, 0x00 };
+    AdvertisementBuilder builder;
+    CHECK(builder.Append(AD_TYPE_COMPLETE_NAME, std::span<const uint8_t>((const uint8_t*)"Band", 4)));
+    CHECK(builder.AppendManufacturer(COMPANY_ID_HUAMI, huami));
+    HeartRateMeasurement m;
+    CHECK(DecodeAdvertisementHeartRate(builder.data(), m));
+    CHECK_EQ(m.bpm, 0x4E);
+
+    const uint8_t measurement[] = { 0x00, 88 };
+    AdvertisementBuilder service;
+    CHECK(service.AppendServiceData16(0x180D, measurement));
+    CHECK(DecodeAdvertisementHeartRate(service.data(), m));
+    CHECK_EQ(m.bpm, 88);
+
+    // Sections that don't fit are refused, not truncated
+    std::vector<uint8_t> big(AdvertisementBuilder::kCapacity, 0);
+    AdvertisementBuilder full;
+    CHECK(!full.Append(AD_TYPE_MANUFACTURER_DATA, big));
+    CHECK(full.data().empty());
+}
+
+int main() {
+    RUN_TEST(TestHuamiBroadcast);
+    RUN_TEST(TestServiceData);
+    RUN_TEST(TestMalformed);
+    RUN_TEST(TestBuilderRoundTrip);
+    return TestResult();
+}
@@ -0,0 +1,107 @@
+#include "hr-capture.hpp"
+#include "test.hpp"
+#include <cstring>
+#include <string>
+
+static std::string TempPath(const char* name) {
+    const char* dir = getenv("TMPDIR");
+    return std::string(dir && *dir ? dir : "/tmp") + "/" + name;
+}
+
+static void TestRoundTripWithStreams() {
+    std::string path = TempPath("hr-capture-test.hrcap");
+    {
+        auto writer = CaptureWriter::Open(path);
+        CHECK(writer != nullptr);
+        if (!writer) return;
+        const uint8_t a[] = { 0x00, 72 };
+        const uint8_t b[] = { 0x10, 90, 0x00, 0x04 };
+        writer->Write(0, 1000000000ull, a);
+        writer->Write(3, 1000500000ull, b);
+        writer->Write(0, 1001000000ull, a);
+        // Longer than a record can hold: clipped, not dropped
+        uint8_t big[300] = {};
+        writer->Write(7, 1300001000000ull, big);
+    }
+
+    CaptureReader reader;
+    CHECK(reader.Load(path));
+    CaptureRecord record;
+    CHECK(reader.Next(record));
+    CHECK_EQ(record.stream_id, 0);
+    CHECK_EQ(record.offset_us, 0);
+    CHECK_EQ(record.payload.size(), 2u);
+    CHECK(reader.Next(record));
+    CHECK_EQ(record.stream_id, 3);
+    CHECK_EQ(record.offset_us, 500);
+    CHECK_EQ(record.payload[1], 90);
+    CHECK(reader.Next(record));
+    CHECK_EQ(record.stream_id, 0);
+    CHECK_EQ(record.offset_us, 1000);
+    CHECK(reader.Next(record));
+    CHECK_EQ(record.stream_id, 7);
+    CHECK_EQ(record.offset_us, (1300001000000ull - 1000000000ull) / 1000);
+    CHECK_EQ(record.payload.size(), 255u);
+    CHECK(!reader.Next(record));
+
+    // A copy starts where the original was and moves on its own
+    reader.Rewind();
+    CHECK(reader.Next(record));
+    CaptureReader copy = reader;
+    CHECK(copy.Next(record));
+    CHECK_EQ(record.stream_id, 3);
+    CHECK(reader.Next(record));
+    CHECK_EQ(record.stream_id, 3);
+    remove(path.c_str());
+}
+
+static void TestVersion1() {
+    // Written before records carried a stream: everything is stream 0
+    std::string path = TempPath("hr-capture-test-v1.hrcap");
+    const uint8_t file[] = {
+        'H', 'R', 'C', 'A', 'P', 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0x00, 2, 0x00, 61,
+        0xE8, 0x07, 2, 0x00, 62,  // 1000 us later
+    };
+    FILE* f = fopen(path.c_str(), "wb");
+    CHECK(f != nullptr);
+    if (!f) return;
+    fwrite(file, 1, sizeof(file), f);
+    fclose(f);
+
+    CaptureReader reader;
+    CHECK(reader.Load(path));
+    CaptureRecord record;
+    CHECK(reader.Next(record));
+    CHECK_EQ(record.stream_id, 0);
+    CHECK_EQ(record.payload[1], 61);
+    CHECK(reader.Next(record));
+    CHECK_EQ(record.stream_id, 0);
+    CHECK_EQ(record.offset_us, 1000);
+    CHECK_EQ(record.payload[1], 62);
+    CHECK(!reader.Next(record));
+    remove(path.c_str());
+}
+
+static void TestRejectsUnknownVersion() {
+    std::string path = TempPath("hr-capture-test-v9.hrcap");
+    const uint8_t file[16] = { 'H', 'R', 'C', 'A', 'P', 9 };
+    FILE* f = fopen(path.c_str(), "wb");
+    CHECK(f != nullptr);
+    if (!f) return;
+    fwrite(file, 1, sizeof(file), f);
+    fclose(f);
+
+    CaptureReader reader;
+    CHECK(!reader.Load(path));
+    CaptureRecord record;
+    CHECK(!reader.Next(record));
+    remove(path.c_str());
+}
+
+int main() {
+    RUN_TEST(TestRoundTripWithStreams);
+    RUN_TEST(TestVersion1);
+    RUN_TEST(TestRejectsUnknownVersion);
+    return TestResult();
+}
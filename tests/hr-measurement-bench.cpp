@@ -0,0 +1,37 @@
+// Decoder throughput on typical notifications. Not run by ctest:
+//   hr-measurement-bench [iterations]
+#include "hr-measurement.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+int main(int argc, char** argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 10000000;
+
+    struct Case {
+        const char* name;
+        std::vector<uint8_t> payload;
+    };
+    std::vector<Case> cases = {
+        { "bpm only", { 0x00, 72 } },
+        { "contact + 2 rr", { HR_FLAG_CONTACT_SUPPORTED | HR_FLAG_CONTACT_DETECTED | HR_FLAG_RR_PRESENT, 72,
+                              0x45, 0x03, 0x2C, 0x03 } },
+        { "u16 + energy + 9 rr", { HR_FLAG_VALUE_U16 | HR_FLAG_ENERGY_PRESENT | HR_FLAG_RR_PRESENT, 72, 0, 0x34,
+                                   0x12 } },
+    };
+    for (int i = 0; i < 9; ++i) cases.back().payload.insert(cases.back().payload.end(), { 0x45, 0x03 });
+
+    HeartRateMeasurement m;
+    for (const Case& c : cases) {
+        uint64_t sink = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (long i = 0; i < iterations; ++i) {
+            DecodeHeartRateMeasurement(c.payload, m);
+            sink += m.bpm + m.rr_count;
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        printf("%-22s %6.1f ns/decode  (%llu)\n", c.name, ns / iterations, (unsigned long long)sink);
+    }
+    return 0;
+}
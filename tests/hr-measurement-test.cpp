@@ -0,0 +1,88 @@
+#include "hr-measurement.hpp"
+#include "test.hpp"
+#include <vector>
+
+static bool Decode(std::vector<uint8_t> payload, HeartRateMeasurement& out) {
+    return DecodeHeartRateMeasurement(payload, out);
+}
+
+static void TestEveryFlagCombination() {
+    // Field order is fixed by the spec: flags, BPM, energy, RR...
+    for (uint8_t flags = 0; flags < 0x20; ++flags) {
+        std::vector<uint8_t> payload = { flags };
+        if (flags & HR_FLAG_VALUE_U16) {
+            payload.insert(payload.end(), { 0x2C, 0x01 });  // 300
+        } else {
+            payload.push_back(72);
+        }
+        if (flags & HR_FLAG_ENERGY_PRESENT) payload.insert(payload.end(), { 0x34, 0x12 });
+        if (flags & HR_FLAG_RR_PRESENT) payload.insert(payload.end(), { 0x45, 0x03, 0x2C, 0x03 });
+
+        HeartRateMeasurement m;
+        CHECK(Decode(payload, m));
+        CHECK_EQ(m.bpm, (flags & HR_FLAG_VALUE_U16) ? 300 : 72);
+        CHECK_EQ(m.contact_supported, (flags & HR_FLAG_CONTACT_SUPPORTED) != 0);
+        // Contact detected means nothing without contact support
+        CHECK_EQ(m.contact_detected, (flags & HR_FLAG_CONTACT_SUPPORTED) && (flags & HR_FLAG_CONTACT_DETECTED));
+        CHECK_EQ(m.has_energy, (flags & HR_FLAG_ENERGY_PRESENT) != 0);
+        CHECK_EQ(m.energy_expended, (flags & HR_FLAG_ENERGY_PRESENT) ? 0x1234 : 0);
+        CHECK_EQ(m.rr_count, (flags & HR_FLAG_RR_PRESENT) ? 2 : 0);
+        if (flags & HR_FLAG_RR_PRESENT) {
+            CHECK_EQ(m.rr_intervals[0], 837);
+            CHECK_EQ(m.rr_intervals[1], 812);
+        }
+        CHECK(!m.rr_truncated);
+    }
+}
+
+static void TestTruncatedInput() {
+    HeartRateMeasurement m;
+    CHECK(!Decode({}, m));
+    CHECK(!Decode({ 0x00 }, m));                               // no BPM
+    CHECK(!Decode({ HR_FLAG_VALUE_U16, 0x48 }, m));            // half a 16-bit BPM
+    CHECK(!Decode({ HR_FLAG_ENERGY_PRESENT, 72 }, m));         // energy missing
+    CHECK(!Decode({ HR_FLAG_ENERGY_PRESENT, 72, 0x10 }, m));   // half the energy
+    CHECK(!Decode({ HR_FLAG_VALUE_U16 | HR_FLAG_ENERGY_PRESENT, 0x48, 0x00, 0x01 }, m));
+
+    // RR present with nothing after it is an empty list, not an error
+    CHECK(Decode({ HR_FLAG_RR_PRESENT, 72 }, m));
+    CHECK_EQ(m.rr_count, 0);
+
+    // A trailing odd byte is dropped
+    CHECK(Decode({ HR_FLAG_RR_PRESENT, 72, 0x00, 0x04, 0x99 }, m));
+    CHECK_EQ(m.rr_count, 1);
+    CHECK_EQ(m.rr_intervals[0], 1024);
+}
+
+static void TestFailureResetsOutput() {
+    HeartRateMeasurement m;
+    CHECK(Decode({ HR_FLAG_RR_PRESENT | HR_FLAG_CONTACT_SUPPORTED, 90, 0x00, 0x04 }, m));
+    CHECK(!Decode({ HR_FLAG_ENERGY_PRESENT, 72 }, m));
+    CHECK_EQ(m.rr_count, 0);
+    CHECK(!m.contact_supported);
+}
+
+static void TestRrCap() {
+    std::vector<uint8_t> payload = { HR_FLAG_RR_PRESENT, 60 };
+    for (size_t i = 0; i < kMaxRrIntervals; ++i) payload.insert(payload.end(), { (uint8_t)i, 0x04 });
+
+    HeartRateMeasurement m;
+    CHECK(Decode(payload, m));
+    CHECK_EQ(m.rr_count, kMaxRrIntervals);
+    CHECK(!m.rr_truncated);
+    CHECK_EQ(m.rr_intervals[kMaxRrIntervals - 1], 0x0400 + kMaxRrIntervals - 1);
+
+    payload.insert(payload.end(), { 0xFF, 0x03 });
+    CHECK(Decode(payload, m));
+    CHECK_EQ(m.rr_count, kMaxRrIntervals);
+    CHECK(m.rr_truncated);
+    CHECK_EQ(m.rr_intervals[0], 0x0400);
+}
+
+int main() {
+    RUN_TEST(TestEveryFlagCombination);
+    RUN_TEST(TestTruncatedInput);
+    RUN_TEST(TestFailureResetsOutput);
+    RUN_TEST(TestRrCap);
+    return TestResult();
+}
@@ -0,0 +1,240 @@
+#include "hr-shm.hpp"
+#include "miband-hr-shm.h"
+#include "test.hpp"
+#include <atomic>
+#include <csignal>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+
+// Unique per run, so parallel test runs don't meet in /dev/shm
+static std::string SegmentName(const char* test) {
+    return std::string("miband-hr-test-") + test + "-" + std::to_string(getpid());
+}
+
+static HeartRateSample MakeSample(uint16_t bpm, std::initializer_list<uint16_t> rr) {
+    HeartRateSample sample = {};
+    sample.measurement.bpm = bpm;
+    sample.measurement.contact_supported = true;
+    sample.measurement.contact_detected = true;
+    for (uint16_t interval : rr) sample.measurement.rr_intervals[sample.measurement.rr_count++] = interval;
+    sample.receive_timestamp_ns = 1000u * bpm;
+    return sample;
+}
+
+static void TestPublishAndRead() {
+    std::string name = SegmentName("read");
+    HrSharedMemory shm;
+    CHECK(shm.Open(name.c_str()));
+
+    miband_hr_shm_reader reader;
+    CHECK_EQ(miband_hr_shm_open(&reader, name.c_str()), 0);
+    if (!reader.header) return;
+    CHECK(miband_hr_shm_running(&reader));
+    CHECK_EQ(reader.header->writer_pid, getpid());
+    CHECK_EQ(reader.header->stream_count, MIBAND_HR_SHM_STREAMS);
+
+    // Samples for a stream without a band are dropped
+    shm.Publish(2, 1, MakeSample(70, {}), true);
+    miband_hr_shm_stream block;
+    CHECK_EQ(miband_hr_shm_read(&reader, 2, &block), 0);
+    CHECK_EQ(block.seq, 0);
+    CHECK_EQ(block.flags, 0);
+
+    shm.SetDevice(2, "212205442170880", true);
+    shm.Publish(2, 5, MakeSample(77, { 800, 810 }), true);
+    CHECK_EQ(miband_hr_shm_read(&reader, 2, &block), 0);
+    CHECK_EQ(block.seq, 5);
+    CHECK_EQ(block.bpm, 77);
+    CHECK_EQ(block.timestamp_ns, 77000);
+    CHECK_EQ(block.flags, MIBAND_HR_SHM_ACTIVE | MIBAND_HR_SHM_CONNECTED | MIBAND_HR_SHM_CONTACT_SUPPORTED |
+                              MIBAND_HR_SHM_CONTACT_DETECTED);
+    CHECK(std::string(block.device) == "212205442170880");
+    CHECK_EQ(block.rr_total, 2);
+    CHECK_EQ(block.version % 2, 0);
+
+    shm.SetConnected(2, false);
+    CHECK_EQ(miband_hr_shm_read(&reader, 2, &block), 0);
+    CHECK_EQ(block.flags & MIBAND_HR_SHM_CONNECTED, 0);
+    CHECK_EQ(miband_hr_shm_read(&reader, MIBAND_HR_SHM_STREAMS, &block), -1);
+
+    // Freed stream: no device, no flags
+    shm.SetDevice(2, "", false);
+    CHECK_EQ(miband_hr_shm_read(&reader, 2, &block), 0);
+    CHECK_EQ(block.flags, 0);
+    CHECK_EQ((int)block.device[0], 0);
+    CHECK_EQ(block.seq, 0);
+    CHECK_EQ(block.bpm, 0);
+
+    // The same band again keeps its sample; another band starts with none
+    shm.SetDevice(2, "212205442170880", true);
+    shm.Publish(2, 6, MakeSample(78, { 790 }), true);
+    shm.SetDevice(2, "212205442170880", true);
+    CHECK_EQ(miband_hr_shm_read(&reader, 2, &block), 0);
+    CHECK_EQ(block.seq, 6);
+    CHECK_EQ(block.bpm, 78);
+    shm.SetDevice(2, "187004930293120", true);
+    CHECK_EQ(miband_hr_shm_read(&reader, 2, &block), 0);
+    CHECK(std::string(block.device) == "187004930293120");
+    CHECK_EQ(block.flags, MIBAND_HR_SHM_ACTIVE | MIBAND_HR_SHM_CONNECTED);
+    CHECK_EQ(block.seq, 0);
+    CHECK_EQ(block.timestamp_ns, 0);
+    CHECK_EQ(block.bpm, 0);
+    CHECK_EQ(block.rr_total, 3);
+
+    // A reader already mapped sees the plugin stop; a new one finds nothing
+    shm.Close();
+    CHECK(!miband_hr_shm_running(&reader));
+    miband_hr_shm_close(&reader);
+    CHECK_EQ(miband_hr_shm_open(&reader, name.c_str()), -1);
+}
+
+static void TestRrSince() {
+    std::string name = SegmentName("rr");
+    HrSharedMemory shm;
+    CHECK(shm.Open(name.c_str()));
+    miband_hr_shm_reader reader;
+    CHECK_EQ(miband_hr_shm_open(&reader, name.c_str()), 0);
+    if (!reader.header) return;
+    shm.SetDevice(0, "1", true);
+
+    uint16_t out[2 * MIBAND_HR_SHM_RR_CAPACITY];
+    uint64_t cursor = 0, lost = 99;
+    miband_hr_shm_stream block;
+    shm.Publish(0, 1, MakeSample(60, { 1, 2, 3 }), true);
+    CHECK_EQ(miband_hr_shm_read(&reader, 0, &block), 0);
+    CHECK_EQ(miband_hr_shm_rr_since(&block, &cursor, out, 128, &lost), 3);
+    CHECK_EQ(out[0], 1);
+    CHECK_EQ(out[2], 3);
+    CHECK_EQ(cursor, 3);
+    CHECK_EQ(lost, 0);
+
+    // Interval n is n + 1; 100 of them overrun the 64-entry ring
+    for (uint64_t seq = 2; seq <= 33; ++seq) {
+        uint16_t n = (uint16_t)(3 + (seq - 2) * 3);
+        shm.Publish(0, seq, MakeSample(60, { (uint16_t)(n + 1), (uint16_t)(n + 2), (uint16_t)(n + 3) }), true);
+    }
+    shm.Publish(0, 34, MakeSample(60, { 100 }), true);
+    CHECK_EQ(miband_hr_shm_read(&reader, 0, &block), 0);
+    CHECK_EQ(block.rr_total, 100);
+
+    // Taken a few at a time: the first call skips what was overwritten
+    CHECK_EQ(miband_hr_shm_rr_since(&block, &cursor, out, 10, &lost), 10);
+    CHECK_EQ(lost, 100 - MIBAND_HR_SHM_RR_CAPACITY - 3);
+    CHECK_EQ(out[0], 100 - MIBAND_HR_SHM_RR_CAPACITY + 1);
+    CHECK_EQ(out[9], 100 - MIBAND_HR_SHM_RR_CAPACITY + 10);
+    CHECK_EQ(miband_hr_shm_rr_since(&block, &cursor, out, 128, &lost), MIBAND_HR_SHM_RR_CAPACITY - 10);
+    CHECK_EQ(lost, 0);
+    CHECK_EQ(out[MIBAND_HR_SHM_RR_CAPACITY - 11], 100);
+    CHECK_EQ(cursor, 100);
+    CHECK_EQ(miband_hr_shm_rr_since(&block, &cursor, out, 128, nullptr), 0);
+
+    // A cursor from an earlier run restarts at the current end
+    cursor = 5000;
+    CHECK_EQ(miband_hr_shm_rr_since(&block, &cursor, out, 128, &lost), 0);
+    CHECK_EQ(cursor, 100);
+    miband_hr_shm_close(&reader);
+}
+
+static void TestSeqlock() {
+    std::string name = SegmentName("seqlock");
+    HrSharedMemory shm;
+    CHECK(shm.Open(name.c_str()));
+    miband_hr_shm_reader reader;
+    CHECK_EQ(miband_hr_shm_open(&reader, name.c_str()), 0);
+    if (!reader.header) return;
+    shm.SetDevice(1, "1", true);
+
+    // Every field of a sample follows from its seq; a torn copy mixes two
+    std::atomic<bool> done{ false };
+    std::thread writer([&]() {
+        for (uint64_t seq = 1; seq <= 200000; ++seq) {
+            uint16_t bpm = (uint16_t)(seq % 200 + 1);
+            shm.Publish(1, seq, MakeSample(bpm, { bpm, bpm }), true);
+        }
+        done = true;
+    });
+    uint64_t reads = 0, torn = 0, last_seq = 0;
+    bool ordered = true;
+    while (!done) {
+        miband_hr_shm_stream block;
+        if (miband_hr_shm_read(&reader, 1, &block) != 0) continue;
+        ++reads;
+        if (block.seq == 0) continue;
+        uint16_t bpm = (uint16_t)(block.seq % 200 + 1);
+        uint16_t newest = block.rr[(block.rr_total - 1) % MIBAND_HR_SHM_RR_CAPACITY];
+        if (block.bpm != bpm || block.timestamp_ns != 1000u * bpm || block.rr_total != 2 * block.seq ||
+            newest != bpm) {
+            ++torn;
+        }
+        if (block.seq < last_seq) ordered = false;
+        last_seq = block.seq;
+    }
+    writer.join();
+    CHECK(reads > 0);
+    CHECK_EQ(torn, 0);
+    CHECK(ordered);
+
+    // A writer that died mid-update leaves the version odd; reads give up
+    int fd = shm_open(("/" + name).c_str(), O_RDWR, 0);
+    CHECK(fd >= 0);
+    size_t size = sizeof(miband_hr_shm_header) + MIBAND_HR_SHM_STREAMS * sizeof(miband_hr_shm_stream);
+    void* view = fd >= 0 ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (fd >= 0) close(fd);
+    CHECK(view != MAP_FAILED);
+    if (view == MAP_FAILED) return;
+    auto* streams = reinterpret_cast<miband_hr_shm_stream*>(static_cast<char*>(view) + sizeof(miband_hr_shm_header));
+    ++streams[3].version;
+    miband_hr_shm_stream block;
+    CHECK_EQ(miband_hr_shm_read(&reader, 3, &block), 1);
+    --streams[3].version;
+    CHECK_EQ(miband_hr_shm_read(&reader, 3, &block), 0);
+    munmap(view, size);
+    miband_hr_shm_close(&reader);
+}
+
+static void TestTakeover() {
+    std::string name = SegmentName("takeover");
+    int ready[2];
+    CHECK_EQ(pipe(ready), 0);
+    pid_t child = fork();
+    if (child == 0) {
+        // Another OBS: holds the segment until killed, never closing it
+        HrSharedMemory shm;
+        char ok = shm.Open(name.c_str()) ? 1 : 0;
+        if (write(ready[1], &ok, 1) != 1) _exit(1);
+        for (;;) pause();
+    }
+    CHECK(child > 0);
+    if (child <= 0) return;
+    char ok = 0;
+    CHECK_EQ(read(ready[0], &ok, 1), 1);
+    CHECK_EQ((int)ok, 1);
+    close(ready[0]);
+    close(ready[1]);
+
+    // Its writer is alive: the segment is left alone
+    HrSharedMemory shm;
+    CHECK(!shm.Open(name.c_str()));
+    miband_hr_shm_reader reader;
+    CHECK_EQ(miband_hr_shm_open(&reader, name.c_str()), 0);
+    if (reader.header) CHECK_EQ(reader.header->writer_pid, child);
+    miband_hr_shm_close(&reader);
+
+    // Killed without closing: running stays set, yet the segment is taken over
+    kill(child, SIGKILL);
+    waitpid(child, nullptr, 0);
+    CHECK(shm.Open(name.c_str()));
+    CHECK_EQ(miband_hr_shm_open(&reader, name.c_str()), 0);
+    if (reader.header) CHECK_EQ(reader.header->writer_pid, getpid());
+    miband_hr_shm_close(&reader);
+    shm.Close();
+}
+
+int main() {
+    RUN_TEST(TestPublishAndRead);
+    RUN_TEST(TestRrSince);
+    RUN_TEST(TestSeqlock);
+    RUN_TEST(TestTakeover);
+    return TestResult();
+}
@@ -0,0 +1,54 @@
+// Keep-alive request rate of the read endpoints, against a running
+// plugin (OBS started with MIBAND_HR_BACKEND=sim gives it a device).
+// Not run by ctest:
+//   http-bench [requests per endpoint] [port]
+#include "httplib.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+int main(int argc, char** argv) {
+    int requests = argc > 1 ? atoi(argv[1]) : 20000;
+    int port = argc > 2 ? atoi(argv[2]) : 17878;
+
+    httplib::Client cli("127.0.0.1", port);
+    cli.set_keep_alive(true);
+    cli.set_tcp_nodelay(true);
+
+    // Scan and connect the first device so the endpoints have a sample to report
+    if (!cli.Post("/api/scan", "", "application/json")) {
+        fprintf(stderr, "no server on port %d\n", port);
+        return 1;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(2500));
+    auto devices = cli.Get("/api/devices");
+    if (devices && devices->status == 200) {
+        size_t id = devices->body.find("\"id\":\"");
+        if (id != std::string::npos) {
+            size_t start = id + 6;
+            std::string body = "{\"id\":\"" + devices->body.substr(start, devices->body.find('"', start) - start) + "\"}";
+            cli.Post("/api/connect", body, "application/json");
+            std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+        }
+    }
+
+    const char* paths[] = { "/api/hr", "/api/devices", "/api/state", "/api/metrics", "/api/hr/all" };
+    for (const char* path : paths) {
+        cli.Get(path);  // warm up
+        size_t body_size = 0;
+        int failed = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < requests; ++i) {
+            auto res = cli.Get(path);
+            if (!res) {
+                ++failed;
+                continue;
+            }
+            body_size = res->body.size();
+        }
+        double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%-14s %8.0f req/s  body %5zu bytes  %d failed\n", path, requests / s, body_size, failed);
+    }
+    return 0;
+}
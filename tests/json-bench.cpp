@@ -0,0 +1,93 @@
+// JsonWriter against the stringstream formatting it replaced, and
+// JsonReader on a typical request body. Not run by ctest:
+//   json-bench [iterations]
+#include "json.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+
+// Every allocation on this thread is counted
+static size_t g_allocs = 0;
+static size_t g_alloc_bytes = 0;
+
+void* operator new(size_t size) {
+    ++g_allocs;
+    g_alloc_bytes += size;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+// One /api/hr sample as the server writes it
+struct Sample {
+    std::string device = "212205442170880";
+    uint64_t seq = 3;
+    uint64_t notify_ts_ns = 5412284451436;
+    uint64_t receive_ts_ns = 5412284464346;
+    uint16_t rr[2] = { 837, 812 };
+    int rr_count = 2;
+};
+
+static void EncodeStringstream(std::string& out, const Sample& s, int hr) {
+    std::stringstream ss;
+    ss << "{\"device\": \"" << s.device << "\", \"stream\": " << 0 << ", \"hr\": " << hr << ", \"seq\": " << s.seq
+       << ", \"ble_seq\": " << s.seq << ", \"notify_ts_ns\": " << s.notify_ts_ns
+       << ", \"receive_ts_ns\": " << s.receive_ts_ns << ", \"rr\": [";
+    for (int i = 0; i < s.rr_count; ++i) {
+        if (i) ss << ",";
+        ss << s.rr[i];
+    }
+    ss << "]}";
+    out = ss.str();
+}
+
+static void EncodeJsonWriter(std::string& out, const Sample& s, int hr) {
+    out.clear();
+    JsonWriter w(out);
+    w.BeginObject()
+        .Field("device", s.device)
+        .Field("stream", 0)
+        .Field("hr", hr)
+        .Field("seq", s.seq)
+        .Field("ble_seq", s.seq)
+        .Field("notify_ts_ns", s.notify_ts_ns)
+        .Field("receive_ts_ns", s.receive_ts_ns);
+    w.Key("rr").BeginArray();
+    for (int i = 0; i < s.rr_count; ++i) w.Uint(s.rr[i]);
+    w.EndArray().EndObject();
+}
+
+template <typename F>
+static void Run(const char* name, long iterations, F&& fn) {
+    g_allocs = g_alloc_bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; ++i) fn(i);
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    printf("%-20s %7.1f ns/op  %7.1f bytes/op  %5.2f allocs/op\n", name, ns / iterations,
+           (double)g_alloc_bytes / iterations, (double)g_allocs / iterations);
+}
+
+int main(int argc, char** argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+
+    Sample sample;
+    std::string out;
+    out.reserve(256);
+    Run("encode stringstream", iterations, [&](long i) { EncodeStringstream(out, sample, 60 + (int)(i & 31)); });
+    Run("encode JsonWriter", iterations, [&](long i) { EncodeJsonWriter(out, sample, 60 + (int)(i & 31)); });
+
+    // A /api/connect body
+    std::string body = "{\"id\": \"212205442170880\", \"mode\": \"advertisement\"}";
+    size_t sink = 0;
+    Run("parse JsonReader", iterations, [&](long) {
+        JsonReader::ForEachMember(body, [&](std::string_view key, JsonReader& reader, JsonReader::Token) {
+            if (key == "mode") sink += reader.Value().size();
+        });
+    });
+    printf("(%zu)\n", sink);
+    return 0;
+}
@@ -0,0 +1,212 @@
+#include "json.hpp"
+#include "test.hpp"
+#include <string>
+#include <vector>
+
+using Token = JsonReader::Token;
+
+// Reads the whole document; true if it ends without an error
+static bool Parses(std::string_view text) {
+    JsonReader reader(text);
+    for (;;) {
+        Token token = reader.Next();
+        if (token == Token::End) return true;
+        if (token == Token::Error) return false;
+    }
+}
+
+// The value of a one-string document, or "<error>"
+static std::string DecodeString(std::string_view text) {
+    JsonReader reader(text);
+    if (reader.Next() != Token::String) return "<error>";
+    std::string value(reader.Value());
+    return reader.Next() == Token::End ? value : "<error>";
+}
+
+static void TestWellFormed() {
+    CHECK(Parses("{}"));
+    CHECK(Parses("[]"));
+    CHECK(Parses(" { \"a\" : [1, -2.5e+3, 0, true, false, null, \"x\"], \"b\": {} } \r\n"));
+    CHECK(Parses("0"));
+    CHECK(Parses("-0.0E-0"));
+    CHECK(Parses("\"\""));
+
+    JsonReader reader("{\"id\": \"abc\", \"n\": [12, {}]}");
+    CHECK(reader.Next() == Token::ObjectStart);
+    CHECK(reader.Next() == Token::Key);
+    CHECK(reader.Value() == "id");
+    CHECK(reader.Next() == Token::String);
+    CHECK(reader.Value() == "abc");
+    CHECK(reader.Next() == Token::Key);
+    CHECK(reader.Next() == Token::ArrayStart);
+    CHECK_EQ(reader.Depth(), 2);
+    CHECK(reader.Next() == Token::Number);
+    CHECK(reader.Value() == "12");
+    CHECK(reader.Next() == Token::ObjectStart);
+    CHECK(reader.Next() == Token::ObjectEnd);
+    CHECK(reader.Next() == Token::ArrayEnd);
+    CHECK(reader.Next() == Token::ObjectEnd);
+    CHECK_EQ(reader.Depth(), 0);
+    CHECK(reader.Next() == Token::End);
+}
+
+static void TestMalformed() {
+    const char* bad[] = {
+        "",
+        "[1,]",          // trailing comma
+        "{\"a\": 1,}",
+        "[,1]",
+        "{\"a\" 1}",     // missing colon
+        "{\"a\": 1 \"b\": 2}",
+        "{1: 2}",        // key must be a string
+        "[1 2]",
+        "01",            // leading zero
+        "[01]",
+        "-",
+        "1.",
+        ".5",
+        "1e",
+        "+1",
+        "tru",
+        "nul",
+        "[1]]",
+        "{\"a\": 1}}",
+        "[1",
+        "{\"a\"",
+        "\"open",
+        "\"tab\there\"",  // raw control byte
+        "\"\\x\"",        // unknown escape
+        "\"\\u12\"",      // short \u
+        "\"\xC3\"",       // cut-off UTF-8
+        "\"\xC0\xAF\"",   // overlong
+        "1 2",
+    };
+    for (const char* text : bad) {
+        if (Parses(text)) {
+            fprintf(stderr, "accepted: %s\n", text);
+            CHECK(!Parses(text));
+        }
+    }
+
+    // An error sticks
+    JsonReader reader("[1,]");
+    CHECK(reader.Next() == Token::ArrayStart);
+    CHECK(reader.Next() == Token::Number);
+    CHECK(reader.Next() == Token::Error);
+    CHECK(reader.Next() == Token::Error);
+}
+
+static void TestNestingLimit() {
+    std::string ok(64, '[');
+    ok.append(64, ']');
+    CHECK(Parses(ok));
+    std::string deep(65, '[');
+    deep.append(65, ']');
+    CHECK(!Parses(deep));
+}
+
+static void TestEscapes() {
+    CHECK(DecodeString("\"plain\"") == "plain");
+    CHECK(DecodeString("\"\\\"\\\\\\/\\b\\f\\n\\r\\t\"") == "\"\\/\b\f\n\r\t");
+    CHECK(DecodeString("\"\\u0041\\u00e9\\u20AC\"") == "A\xC3\xA9\xE2\x82\xAC");
+    CHECK(DecodeString("\"a\\u0000b\"") == std::string("a\0b", 3));
+    // U+1F600 as a surrogate pair
+    CHECK(DecodeString("\"\\ud83d\\ude00\"") == "\xF0\x9F\x98\x80");
+    CHECK(DecodeString("\"\xE5\xBF\x83\xE7\x8E\x87\"") == "\xE5\xBF\x83\xE7\x8E\x87");
+
+    // Surrogates must come as a high / low pair
+    CHECK(DecodeString("\"\\ud83d\"") == "<error>");
+    CHECK(DecodeString("\"\\ud83dx\"") == "<error>");
+    CHECK(DecodeString("\"\\ud83d\\u0041\"") == "<error>");
+    CHECK(DecodeString("\"\\ude00\"") == "<error>");
+    CHECK(DecodeString("\"\\ude00\\ud83d\"") == "<error>");
+
+    // A key and a string value each keep their own decoded text
+    JsonReader reader("{\"k\\u0031\": \"v\\u0032\"}");
+    CHECK(reader.Next() == Token::ObjectStart);
+    CHECK(reader.Next() == Token::Key);
+    std::string_view key = reader.Value();
+    CHECK(reader.Next() == Token::String);
+    CHECK(key == "k1");
+    CHECK(reader.Value() == "v2");
+}
+
+static void TestForEachMember() {
+    // Nested values the callback ignores are skipped whole
+    std::vector<std::string> keys;
+    std::string mode;
+    bool ok = JsonReader::ForEachMember(
+        "{\"opts\": {\"a\": [1, {\"mode\": \"x\"}], \"b\": {}}, \"list\": [[], [2]], \"mode\": \"advertisement\"}",
+        [&](std::string_view key, JsonReader& reader, Token token) {
+            keys.emplace_back(key);
+            if (key == "mode" && token == Token::String) mode = reader.Value();
+        });
+    CHECK(ok);
+    CHECK_EQ(keys.size(), 3);
+    if (keys.size() == 3) CHECK(keys[0] == "opts" && keys[1] == "list" && keys[2] == "mode");
+    CHECK(mode == "advertisement");
+
+    // A callback may read into a nested value; the rest is still skipped
+    std::vector<std::string> devices;
+    ok = JsonReader::ForEachMember("{\"devices\": [\"a\", \"b\", {\"c\": 1}], \"x\": 1}",
+                                   [&](std::string_view key, JsonReader& reader, Token token) {
+                                       if (key != "devices" || token != Token::ArrayStart) return;
+                                       if (reader.Next() == Token::String) devices.emplace_back(reader.Value());
+                                   });
+    CHECK(ok);
+    CHECK_EQ(devices.size(), 1);
+
+    auto ignore = [](std::string_view, JsonReader&, Token) {};
+    CHECK(JsonReader::ForEachMember("{}", ignore));
+    CHECK(!JsonReader::ForEachMember("[]", ignore));
+    CHECK(!JsonReader::ForEachMember("{\"a\": [1,]}", ignore));
+    CHECK(!JsonReader::ForEachMember("{\"a\": {\"b\": 1}", ignore));
+    CHECK(!JsonReader::ForEachMember("{\"a\": 1} {}", ignore));
+    CHECK(!JsonReader::ForEachMember("{\"a\": }", ignore));
+}
+
+static std::string Write(std::string_view value) {
+    std::string out;
+    JsonWriter(out).String(value);
+    return out;
+}
+
+static void TestWriterEscaping() {
+    CHECK(Write("plain") == "\"plain\"");
+    CHECK(Write("q\"b\\") == "\"q\\\"b\\\\\"");
+    CHECK(Write("\n\r\t") == "\"\\n\\r\\t\"");
+    CHECK(Write(std::string("\x01\x1F\x7F", 3)) == "\"\\u0001\\u001f\x7F\"");
+    CHECK(Write(std::string("a\0b", 3)) == "\"a\\u0000b\"");
+    // Valid UTF-8 passes through; anything else becomes U+FFFD byte by byte
+    CHECK(Write("\xC3\xA9\xF0\x9F\x98\x80") == "\"\xC3\xA9\xF0\x9F\x98\x80\"");
+    CHECK(Write("a\xFF") == "\"a\xEF\xBF\xBD\"");
+    CHECK(Write("\xC3") == "\"\xEF\xBF\xBD\"");
+    CHECK(Write("\xC0\xAF") == "\"\xEF\xBF\xBD\xEF\xBF\xBD\"");
+    CHECK(Write("\xED\xA0\x80") == "\"\xEF\xBF\xBD\xEF\xBF\xBD\xEF\xBF\xBD\"");  // encoded surrogate
+
+    // What the writer escapes, the reader decodes back
+    std::string text = std::string("x\x01\"\\\n\xC3\xA9", 7);
+    CHECK(DecodeString(Write(text)) == text);
+}
+
+static void TestWriterStructure() {
+    std::string out;
+    JsonWriter w(out);
+    w.BeginObject().Field("a", 1).Field("b", -2).Field("c", true).Field("d", "s\"");
+    w.Key("e").BeginArray().Uint(18446744073709551615ull).Null().BeginObject().EndObject().BeginArray().EndArray();
+    w.EndArray().Key("k\n").Raw("{\"r\":1}").EndObject();
+    CHECK(out == "{\"a\":1,\"b\":-2,\"c\":true,\"d\":\"s\\\"\",\"e\":[18446744073709551615,null,{},[]],"
+                 "\"k\\n\":{\"r\":1}}");
+    CHECK(Parses(out));
+}
+
+int main() {
+    RUN_TEST(TestWellFormed);
+    RUN_TEST(TestMalformed);
+    RUN_TEST(TestNestingLimit);
+    RUN_TEST(TestEscapes);
+    RUN_TEST(TestForEachMember);
+    RUN_TEST(TestWriterEscaping);
+    RUN_TEST(TestWriterStructure);
+    return TestResult();
+}
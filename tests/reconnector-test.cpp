@@ -0,0 +1,208 @@
+#include "reconnector.hpp"
+#include "test.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+// A clock that only moves when the test says so, and a Reconnector whose
+// attempts are counted. Real time is only spent waiting for its thread.
+struct Harness {
+    std::atomic<int64_t> now_ms{ 1000000 };
+    std::atomic<double> random{ 0.5 };
+    std::mutex mutex;
+    std::condition_variable cv;
+    int attempts = 0;
+    Reconnector reconnector;
+
+    explicit Harness(ReconnectOptions options = {})
+        : reconnector([this]() { Attempted(); }, WithFakes(options)) {}
+
+    ReconnectOptions WithFakes(ReconnectOptions options) {
+        options.now = [this]() { return Clock::time_point(std::chrono::milliseconds(now_ms.load())); };
+        options.unit_random = [this]() { return random.load(); };
+        return options;
+    }
+
+    void Attempted() {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++attempts;
+        cv.notify_all();
+    }
+
+    void Advance(std::chrono::milliseconds by) {
+        now_ms += by.count();
+        reconnector.Poll();
+    }
+
+    // True once `count` attempts have been made
+    bool WaitForAttempts(int count) {
+        std::unique_lock<std::mutex> lock(mutex);
+        return cv.wait_for(lock, 2s, [&]() { return attempts >= count; });
+    }
+
+    // True if no attempt beyond `count` starts in a short real-time window
+    bool StaysAt(int count) {
+        std::unique_lock<std::mutex> lock(mutex);
+        return !cv.wait_for(lock, 30ms, [&]() { return attempts > count; });
+    }
+};
+
+static void TestBackoffDelay() {
+    ReconnectOptions options;
+    options.jitter = 0.0;
+    // The first retry goes out at once
+    CHECK_EQ(Reconnector::BackoffDelay(options, 0, 0.99).count(), 0);
+    // Then doubles from the initial delay up to the cap
+    int64_t expected[] = { 500, 1000, 2000, 4000, 8000, 16000, 30000, 30000 };
+    for (uint32_t failures = 1; failures <= 8; ++failures) {
+        CHECK_EQ(Reconnector::BackoffDelay(options, failures, 0.5).count(), expected[failures - 1]);
+    }
+    CHECK_EQ(Reconnector::BackoffDelay(options, 1000, 0.5).count(), 30000);
+
+    // Jitter spreads the top half of each delay, never past the nominal one
+    options.jitter = 0.5;
+    for (uint32_t failures = 1; failures <= 10; ++failures) {
+        int64_t nominal = std::min<int64_t>(500ll << (failures - 1), 30000);
+        int64_t low = Reconnector::BackoffDelay(options, failures, 0.0).count();
+        int64_t mid = Reconnector::BackoffDelay(options, failures, 0.5).count();
+        int64_t high = Reconnector::BackoffDelay(options, failures, 0.999999).count();
+        CHECK_EQ(low, nominal / 2);
+        CHECK_EQ(mid, nominal * 3 / 4);
+        CHECK(high <= nominal && high >= nominal - 1);
+    }
+}
+
+static void TestFirstAttemptIsImmediate() {
+    Harness h;
+    CHECK(h.StaysAt(0));  // nothing before Enable
+    h.reconnector.Enable();
+    CHECK(h.WaitForAttempts(1));
+    h.reconnector.OnConnected();
+    CHECK(h.StaysAt(1));
+
+    // A drop is retried at once too, without the clock moving
+    h.reconnector.OnDisconnected();
+    CHECK(h.WaitForAttempts(2));
+    CHECK_EQ(h.reconnector.Stats().attempts, 2);
+}
+
+static void TestBackoffSchedule() {
+    ReconnectOptions options;
+    options.jitter = 0.5;
+    Harness h(options);
+    h.random = 0.0;  // every delay at its lower bound: half the nominal one
+    h.reconnector.Enable();
+    CHECK(h.WaitForAttempts(1));
+
+    int64_t nominal[] = { 500, 1000, 2000, 4000, 8000, 16000, 30000, 30000 };
+    for (int i = 0; i < 8; ++i) {
+        int64_t delay = nominal[i] / 2;
+        h.reconnector.OnAttemptFailed();
+        h.Advance(std::chrono::milliseconds(delay - 1));
+        CHECK(h.StaysAt(i + 1));
+        h.Advance(1ms);
+        CHECK(h.WaitForAttempts(i + 2));
+    }
+    CHECK_EQ(h.reconnector.Stats().attempts, 9);
+
+    // A link that comes up resets the backoff
+    h.reconnector.OnConnected();
+    h.reconnector.OnDisconnected();
+    CHECK(h.WaitForAttempts(10));
+    h.reconnector.OnAttemptFailed();
+    h.Advance(249ms);
+    CHECK(h.StaysAt(10));
+    h.Advance(1ms);
+    CHECK(h.WaitForAttempts(11));
+}
+
+static void TestAttemptTimeout() {
+    ReconnectOptions options;
+    options.jitter = 0.0;
+    options.attempt_timeout = 5000ms;
+    Harness h(options);
+    h.reconnector.Enable();
+    CHECK(h.WaitForAttempts(1));
+
+    // The attempt never reports: once the timeout passes it counts as failed
+    h.Advance(4999ms);
+    CHECK(h.StaysAt(1));
+    h.Advance(1ms);
+    CHECK(h.StaysAt(1));  // first failure: 500 ms backoff
+    h.Advance(500ms);
+    CHECK(h.WaitForAttempts(2));
+
+    // A late failure report for an attempt that already timed out is ignored
+    h.Advance(5000ms);
+    CHECK(h.StaysAt(2));
+    h.reconnector.OnAttemptFailed();
+    h.Advance(999ms);
+    CHECK(h.StaysAt(2));
+    h.Advance(1ms);
+    CHECK(h.WaitForAttempts(3));
+}
+
+static void TestReconnectStats() {
+    ReconnectOptions options;
+    options.jitter = 0.0;
+    Harness h(options);
+    h.reconnector.Enable();
+    CHECK(h.WaitForAttempts(1));
+    h.Advance(300ms);
+    h.reconnector.OnConnected();
+
+    // The first connect is not a reconnect
+    ReconnectStats stats = h.reconnector.Stats();
+    CHECK_EQ(stats.attempts, 1);
+    CHECK_EQ(stats.disconnects, 0);
+    CHECK_EQ(stats.reconnects, 0);
+
+    // Down for 1234 ms across one failed attempt
+    h.Advance(10000ms);
+    h.reconnector.OnDisconnected();
+    CHECK(h.WaitForAttempts(2));
+    h.Advance(34ms);
+    h.reconnector.OnAttemptFailed();
+    h.Advance(500ms);
+    CHECK(h.WaitForAttempts(3));
+    h.Advance(700ms);
+    h.reconnector.OnConnected();
+    stats = h.reconnector.Stats();
+    CHECK_EQ(stats.attempts, 3);
+    CHECK_EQ(stats.disconnects, 1);
+    CHECK_EQ(stats.reconnects, 1);
+    CHECK_EQ(stats.last_reconnect_ms, 1234);
+    CHECK_EQ(stats.max_reconnect_ms, 1234);
+    CHECK_EQ(stats.total_reconnect_ms, 1234);
+
+    // A shorter second outage keeps the max
+    h.reconnector.OnDisconnected();
+    CHECK(h.WaitForAttempts(4));
+    h.Advance(66ms);
+    h.reconnector.OnConnected();
+    stats = h.reconnector.Stats();
+    CHECK_EQ(stats.reconnects, 2);
+    CHECK_EQ(stats.last_reconnect_ms, 66);
+    CHECK_EQ(stats.max_reconnect_ms, 1234);
+    CHECK_EQ(stats.total_reconnect_ms, 1300);
+
+    // Disabled: drops are no longer retried
+    h.reconnector.Disable();
+    h.reconnector.OnDisconnected();
+    h.Advance(60000ms);
+    CHECK(h.StaysAt(4));
+}
+
+int main() {
+    RUN_TEST(TestBackoffDelay);
+    RUN_TEST(TestFirstAttemptIsImmediate);
+    RUN_TEST(TestBackoffSchedule);
+    RUN_TEST(TestAttemptTimeout);
+    RUN_TEST(TestReconnectStats);
+    return TestResult();
+}
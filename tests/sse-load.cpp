@@ -0,0 +1,87 @@
+// Holds many /api/hr/stream subscribers open at once and reports how many
+// got the response and at least one event. Not run by ctest:
+//   sse-load [subscribers] [seconds] [port]
+// Past a few hundred subscribers, run the plugin with MIBAND_HR_SERVER=epoll
+// and raise the file limit (ulimit -n) on both sides.
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+int main(int argc, char** argv) {
+    int subscribers = argc > 1 ? atoi(argv[1]) : 1000;
+    int seconds = argc > 2 ? atoi(argv[2]) : 10;
+    int port = argc > 3 ? atoi(argv[3]) : 17878;
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    const char request[] = "GET /api/hr/stream HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+
+    int epoll_fd = epoll_create1(0);
+    std::vector<int> fds(subscribers, -1);
+    std::vector<long> events(subscribers, 0);
+    int connect_failed = 0;
+    for (int i = 0; i < subscribers; ++i) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0 ||
+            send(fd, request, sizeof(request) - 1, 0) < 0) {
+            if (!connect_failed++) perror("connect");
+            if (fd >= 0) close(fd);
+            continue;
+        }
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u32 = (uint32_t)i;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+        fds[i] = fd;
+    }
+
+    // Counts "data:" lines; one may be split across reads now and then
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+    epoll_event ready[512];
+    char buf[64 * 1024];
+    int closed = 0;
+    while (std::chrono::steady_clock::now() < end) {
+        int n = epoll_wait(epoll_fd, ready, 512, 100);
+        for (int j = 0; j < n; ++j) {
+            uint32_t i = ready[j].data.u32;
+            for (;;) {
+                ssize_t r = recv(fds[i], buf, sizeof(buf), 0);
+                if (r > 0) {
+                    for (ssize_t k = 0; k + 5 <= r; ++k) {
+                        if (memcmp(buf + k, "data:", 5) == 0) ++events[i];
+                    }
+                    continue;
+                }
+                if (r < 0 && (errno == EAGAIN || errno == EINTR)) break;
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fds[i], nullptr);
+                close(fds[i]);
+                fds[i] = -1;
+                ++closed;
+                break;
+            }
+        }
+    }
+
+    int still_open = 0, served = 0;
+    long total = 0;
+    for (int i = 0; i < subscribers; ++i) {
+        if (fds[i] >= 0) ++still_open;
+        if (events[i] > 0) ++served;
+        total += events[i];
+    }
+    printf("subscribers=%d connect_failed=%d closed=%d open=%d got_events=%d total_events=%ld\n", subscribers,
+           connect_failed, closed, still_open, served, total);
+    return served == subscribers ? 0 : 1;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <type_traits>
+#include <utility>
+
+// Minimal assertions for the unit tests: a failed CHECK prints where and
+// keeps going; the test exits non-zero if anything failed.
+inline int g_test_failures = 0;
+
+// Integers compare by value whatever their signedness
+template <typename A, typename B>
+bool TestEqual(const A& a, const B& b) {
+    if constexpr (std::is_integral_v<A> && std::is_integral_v<B> && !std::is_same_v<A, bool> &&
+                  !std::is_same_v<B, bool>) {
+        return std::cmp_equal(a, b);
+    } else {
+        return a == b;
+    }
+}
+
+#define CHECK(cond)                                                                 \
+    do {                                                                            \
+        if (!(cond)) {                                                              \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            ++g_test_failures;                                                      \
+        }                                                                           \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                                                   \
+    do {                                                                                                 \
+        auto check_a_ = (a);                                                                             \
+        auto check_b_ = (b);                                                                             \
+        if (!TestEqual(check_a_, check_b_)) {                                                            \
+            fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, \
+                    (long long)check_a_, (long long)check_b_);                                           \
+            ++g_test_failures;                                                                           \
+        }                                                                                                \
+    } while (0)
+
+// Runs one test function and reports it by name
+#define RUN_TEST(fn)                             \
+    do {                                         \
+        int before_ = g_test_failures;           \
+        fn();                                    \
+        printf("%s %s\n", g_test_failures == before_ ? "ok  " : "FAIL", #fn); \
+    } while (0)
+
+inline int TestResult() {
+    if (g_test_failures) fprintf(stderr, "%d check(s) failed\n", g_test_failures);
+    return g_test_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
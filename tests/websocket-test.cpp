@@ -0,0 +1,233 @@
+#include "websocket.hpp"
+#include "test.hpp"
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static std::string Hex(const std::array<uint8_t, 20>& digest) {
+    static const char digits[] = "0123456789abcdef";
+    std::string out;
+    for (uint8_t b : digest) {
+        out.push_back(digits[b >> 4]);
+        out.push_back(digits[b & 15]);
+    }
+    return out;
+}
+
+// A masked client frame; length encoding follows the payload size
+static std::string ClientFrame(uint8_t first, std::string_view payload) {
+    static const uint8_t mask[4] = { 0x37, 0xFA, 0x21, 0x3D };
+    std::string frame;
+    frame.push_back((char)first);
+    if (payload.size() < 126) {
+        frame.push_back((char)(0x80 | payload.size()));
+    } else {
+        frame.push_back((char)(0x80 | 126));
+        frame.push_back((char)(payload.size() >> 8));
+        frame.push_back((char)payload.size());
+    }
+    frame.append((const char*)mask, 4);
+    for (size_t i = 0; i < payload.size(); ++i) frame.push_back((char)(payload[i] ^ mask[i & 3]));
+    return frame;
+}
+
+static std::string CloseFrame(uint16_t code, std::string_view reason = {}) {
+    std::string payload = { (char)(code >> 8), (char)code };
+    payload.append(reason);
+    return ClientFrame(0x88, payload);
+}
+
+// The server end of a socket pair, fed by the test from the client end
+struct Connection {
+    int fds[2] = { -1, -1 };
+    Connection() { socketpair(AF_UNIX, SOCK_STREAM, 0, fds); }
+    ~Connection() {
+        close(fds[0]);
+        close(fds[1]);
+    }
+    void Send(std::string_view bytes) { CHECK_EQ(write(fds[1], bytes.data(), bytes.size()), bytes.size()); }
+    // Everything the server has written so far
+    std::string Received() {
+        std::string out;
+        char buf[512];
+        ssize_t n;
+        while ((n = recv(fds[1], buf, sizeof(buf), MSG_DONTWAIT)) > 0) out.append(buf, (size_t)n);
+        return out;
+    }
+};
+
+// The code of the Close frame the server sent, or 0 if it sent none
+static uint16_t SentCloseCode(const std::string& received) {
+    if (received.size() < 4 || (uint8_t)received[0] != 0x88) return 0;
+    return (uint16_t)((uint8_t)received[2] << 8 | (uint8_t)received[3]);
+}
+
+// Feeds frames to a fresh connection and reads until it closes
+static uint16_t CloseCodeFor(std::string_view frames, size_t max_message = 1024) {
+    Connection conn;
+    WebSocket ws(conn.fds[0], max_message, nullptr);
+    conn.Send(frames);
+    std::string message;
+    WebSocket::Opcode opcode;
+    for (int i = 0; i < 8; ++i) {
+        if (ws.Read(message, opcode, 100) == WebSocket::ReadStatus::Closed) break;
+    }
+    CHECK(!ws.IsOpen());
+    return SentCloseCode(conn.Received());
+}
+
+static void TestSha1() {
+    // FIPS 180 examples, the second one spanning two blocks
+    CHECK(Hex(WebSocket::Sha1("abc")) == "a9993e364706816aba3e25717850c26c9cd0d89d");
+    CHECK(Hex(WebSocket::Sha1("")) == "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+    CHECK(Hex(WebSocket::Sha1("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq")) ==
+          "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+    // Padding exactly fills a block
+    CHECK(Hex(WebSocket::Sha1(std::string(55, 'a'))) == "c1c8bbdc22796e28c0e15163d20899b65621d65a");
+    CHECK(Hex(WebSocket::Sha1(std::string(64, 'a'))) == "0098ba824b5c16427bd7a1122a5a442a25ec644d");
+    // The key from RFC 6455 section 1.3
+    CHECK(WebSocket::AcceptKey("dGhlIHNhbXBsZSBub25jZQ==") == "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+}
+
+static void TestUtf8() {
+    CHECK(WebSocket::IsValidUtf8(""));
+    CHECK(WebSocket::IsValidUtf8("plain ascii"));
+    CHECK(WebSocket::IsValidUtf8("\xE5\xBF\x83\xE7\x8E\x87"));  // 心率
+    CHECK(WebSocket::IsValidUtf8("\xF0\x9F\x92\x93"));  // U+1F493
+    CHECK(WebSocket::IsValidUtf8("\xF4\x8F\xBF\xBF"));  // U+10FFFF
+    CHECK(WebSocket::IsValidUtf8("\xED\x9F\xBF"));  // U+D7FF
+    CHECK(!WebSocket::IsValidUtf8("\xC0\xAF"));  // overlong '/'
+    CHECK(!WebSocket::IsValidUtf8("\xE0\x80\xAF"));  // overlong '/'
+    CHECK(!WebSocket::IsValidUtf8("\xED\xA0\x80"));  // surrogate U+D800
+    CHECK(!WebSocket::IsValidUtf8("\xF4\x90\x80\x80"));  // past U+10FFFF
+    CHECK(!WebSocket::IsValidUtf8("\x80"));  // lone continuation
+    CHECK(!WebSocket::IsValidUtf8("\xFF"));
+    CHECK(!WebSocket::IsValidUtf8("\xE5\xBF"));  // cut short
+    CHECK(!WebSocket::IsValidUtf8("\xE5\x41\x83"));  // bad continuation
+}
+
+static void TestCloseCodes() {
+    for (uint16_t code : { 1000, 1001, 1002, 1003, 1007, 1008, 1009, 1010, 1011, 3000, 4999 })
+        CHECK(WebSocket::ValidCloseCode(code));
+    // Reserved, or only for reporting and never sent on the wire
+    for (uint16_t code : { 0, 999, 1004, 1005, 1006, 1012, 1015, 2999, 5000 })
+        CHECK(!WebSocket::ValidCloseCode(code));
+}
+
+static void TestEncodeFrame() {
+    std::string out;
+    WebSocket::EncodeFrame(out, WebSocket::Opcode::Text, "hi", 2);
+    CHECK(out == std::string("\x81\x02hi", 4));
+
+    std::string big(126, 'x');
+    out.clear();
+    WebSocket::EncodeFrame(out, WebSocket::Opcode::Binary, big.data(), big.size());
+    CHECK_EQ(out.size(), 4 + big.size());
+    CHECK_EQ((uint8_t)out[1], 126);
+    CHECK_EQ((uint8_t)out[3], 126);
+
+    big.assign(65536, 'x');
+    out.clear();
+    WebSocket::EncodeFrame(out, WebSocket::Opcode::Binary, big.data(), big.size());
+    CHECK_EQ(out.size(), 10 + big.size());
+    CHECK_EQ((uint8_t)out[1], 127);
+    CHECK_EQ((uint8_t)out[7], 1);
+}
+
+static void TestReadMessages() {
+    Connection conn;
+    WebSocket ws(conn.fds[0], 1024, nullptr);
+    std::string message;
+    WebSocket::Opcode opcode;
+    CHECK(ws.Read(message, opcode, 10) == WebSocket::ReadStatus::Timeout);
+
+    conn.Send(ClientFrame(0x81, "hello"));
+    CHECK(ws.Read(message, opcode, 100) == WebSocket::ReadStatus::Message);
+    CHECK(opcode == WebSocket::Opcode::Text);
+    CHECK(message == "hello");
+
+    // 16-bit length
+    std::string long_text(300, 'z');
+    conn.Send(ClientFrame(0x82, long_text));
+    CHECK(ws.Read(message, opcode, 100) == WebSocket::ReadStatus::Message);
+    CHECK(opcode == WebSocket::Opcode::Binary);
+    CHECK(message == long_text);
+
+    // Fragments with a ping between them; the pong goes out at once
+    conn.Send(ClientFrame(0x01, "frag"));
+    conn.Send(ClientFrame(0x89, "p"));
+    conn.Send(ClientFrame(0x00, "men"));
+    conn.Send(ClientFrame(0x80, "ted"));
+    CHECK(ws.Read(message, opcode, 100) == WebSocket::ReadStatus::Message);
+    CHECK(opcode == WebSocket::Opcode::Text);
+    CHECK(message == "fragmented");
+    CHECK(conn.Received() == std::string("\x8A\x01p", 3));
+
+    // The peer closes; its code is echoed
+    conn.Send(CloseFrame(3001, "bye"));
+    CHECK(ws.Read(message, opcode, 100) == WebSocket::ReadStatus::Closed);
+    CHECK_EQ(SentCloseCode(conn.Received()), 3001);
+    CHECK(!ws.SendText("late"));
+}
+
+static void TestProtocolErrors() {
+    // Unmasked client frame
+    CHECK_EQ(CloseCodeFor(std::string("\x81\x02hi", 4)), WebSocket::CLOSE_PROTOCOL_ERROR);
+    // RSV1 without an extension
+    CHECK_EQ(CloseCodeFor(ClientFrame(0xC1, "hi")), WebSocket::CLOSE_PROTOCOL_ERROR);
+    // Unknown opcode
+    CHECK_EQ(CloseCodeFor(ClientFrame(0x83, "hi")), WebSocket::CLOSE_PROTOCOL_ERROR);
+    // Fragmented or oversized control frames
+    CHECK_EQ(CloseCodeFor(ClientFrame(0x09, "p")), WebSocket::CLOSE_PROTOCOL_ERROR);
+    CHECK_EQ(CloseCodeFor(ClientFrame(0x89, std::string(126, 'p'))), WebSocket::CLOSE_PROTOCOL_ERROR);
+    // Continuation with nothing to continue
+    CHECK_EQ(CloseCodeFor(ClientFrame(0x80, "x")), WebSocket::CLOSE_PROTOCOL_ERROR);
+    // A new message inside a fragmented one
+    CHECK_EQ(CloseCodeFor(ClientFrame(0x01, "a") + ClientFrame(0x81, "b")), WebSocket::CLOSE_PROTOCOL_ERROR);
+    // Invalid UTF-8, also when split across fragments
+    CHECK_EQ(CloseCodeFor(ClientFrame(0x81, "\xC0\xAF")), WebSocket::CLOSE_INVALID_PAYLOAD);
+    CHECK_EQ(CloseCodeFor(ClientFrame(0x01, "\xE5") + ClientFrame(0x80, "\x41")), WebSocket::CLOSE_INVALID_PAYLOAD);
+    // A text message cut inside a character is fine once reassembled
+    {
+        Connection conn;
+        WebSocket ws(conn.fds[0], 1024, nullptr);
+        conn.Send(ClientFrame(0x01, "\xE5\xBF") + ClientFrame(0x80, "\x83"));
+        std::string message;
+        WebSocket::Opcode opcode;
+        CHECK(ws.Read(message, opcode, 100) == WebSocket::ReadStatus::Message);
+        CHECK(message == "\xE5\xBF\x83");
+    }
+}
+
+static void TestSizeLimits() {
+    // Refused from the header, before the payload arrives
+    CHECK_EQ(CloseCodeFor(ClientFrame(0x82, std::string(200, 'x')).substr(0, 8), 100), WebSocket::CLOSE_TOO_BIG);
+    // Each fragment fits but the message doesn't
+    CHECK_EQ(CloseCodeFor(ClientFrame(0x02, std::string(60, 'x')) + ClientFrame(0x80, std::string(60, 'x')), 100),
+             WebSocket::CLOSE_TOO_BIG);
+}
+
+static void TestPeerClose() {
+    // No payload is a normal close
+    CHECK_EQ(CloseCodeFor(ClientFrame(0x88, "")), WebSocket::CLOSE_NORMAL);
+    CHECK_EQ(CloseCodeFor(CloseFrame(WebSocket::CLOSE_GOING_AWAY)), WebSocket::CLOSE_GOING_AWAY);
+    // A lone byte can't hold a code
+    CHECK_EQ(CloseCodeFor(ClientFrame(0x88, "\x03")), WebSocket::CLOSE_PROTOCOL_ERROR);
+    // Codes a peer may not send
+    CHECK_EQ(CloseCodeFor(CloseFrame(1005)), WebSocket::CLOSE_PROTOCOL_ERROR);
+    CHECK_EQ(CloseCodeFor(CloseFrame(999)), WebSocket::CLOSE_PROTOCOL_ERROR);
+    // The reason must be UTF-8
+    CHECK_EQ(CloseCodeFor(CloseFrame(1000, "\xFF")), WebSocket::CLOSE_INVALID_PAYLOAD);
+}
+
+int main() {
+    RUN_TEST(TestSha1);
+    RUN_TEST(TestUtf8);
+    RUN_TEST(TestCloseCodes);
+    RUN_TEST(TestEncodeFrame);
+    RUN_TEST(TestReadMessages);
+    RUN_TEST(TestProtocolErrors);
+    RUN_TEST(TestSizeLimits);
+    RUN_TEST(TestPeerClose);
+    return TestResult();
+}